@@ -0,0 +1,409 @@
+//===-- Driver.cpp - Batch driver of the passes --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Non-interactive replacement of Comp.sh for a whole corpus:
+//   CompilatoriDriver <directory | compile_commands.json> -passes=loopfusionpass
+// For each C/C++ source it runs clang -O0 -emit-llvm, the pre-passes
+// (mem2reg) and the passes in-process, on a thread pool, and writes
+// <name>.ll and <name>.optimized.ll as Comp.sh does. The IR of each stage
+// is cached by content hash (preprocessed source, command, pipelines and
+// this executable), so a rerun only redoes the files that changed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Plugin.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/xxhash.h"
+#include <atomic>
+#include <mutex>
+
+using namespace llvm;
+
+static cl::opt<std::string> Input(cl::Positional, cl::Required,
+    cl::desc("<directory of sources | compile_commands.json>"));
+static cl::opt<std::string> Passes("passes", cl::init("loopfusionpass"), cl::desc("Passes, as for opt -passes"));
+static cl::opt<std::string> PrePasses("pre-passes", cl::init("mem2reg"), cl::desc("Passes before <name>.ll"));
+static cl::opt<std::string> Clang("clang", cl::init("clang"), cl::desc("clang used for -emit-llvm"));
+static cl::opt<unsigned> Jobs("j", cl::init(0), cl::desc("Threads (0: one per core)"));
+static cl::opt<std::string> CacheDir("cache-dir", cl::init(".compilatori-cache"), cl::desc("Cache of the IR of each stage"));
+static cl::opt<std::string> OutputDir("output-dir", cl::init(""), cl::desc("Directory of the .ll files (default: next to each source)"));
+
+/*Un file da compilare: sorgente, cartella di lavoro e argomenti di clang
+oltre a quelli del driver (-I, -D, -std del compile_commands.json)*/
+struct Job {
+  std::string file;
+  std::string directory;
+  std::vector<std::string> arguments;
+};
+
+enum class Outcome { Compiled, Cached, Failed };
+
+// Hash of the passes themselves: a rebuilt driver invalidates the cache
+std::string ToolHash;
+
+std::string hashKey(ArrayRef<StringRef> parts){
+  std::string data;
+  for(StringRef part : parts){
+    data += part;
+    // Separator: ("ab", "c") and ("a", "bc") are different keys
+    data += '\0';
+  }
+  return utohexstr(xxHash64(data), true, 16);
+}
+
+std::string cachePath(StringRef key){
+  SmallString<128> path(CacheDir);
+  sys::path::append(path, key + ".ll");
+  return std::string(path);
+}
+
+/*Scrive prima su un file temporaneo e poi lo rinomina: un altro thread o
+un altro processo non legge mai un file della cache a metà*/
+bool writeFile(StringRef path, function_ref<void(raw_ostream &)> write){
+  SmallString<128> temporary;
+  int fd;
+  if(sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temporary)){
+    return false;
+  }
+  {
+    raw_fd_ostream file(fd, true);
+    write(file);
+  }
+  return !sys::fs::rename(temporary, path);
+}
+
+bool copyFile(StringRef from, StringRef to){
+  return !sys::fs::copy_file(from, to);
+}
+
+bool isSource(StringRef path){
+  StringRef extension = sys::path::extension(path);
+  return extension == ".c" || extension == ".cpp" || extension == ".cc" || extension == ".cxx";
+}
+
+bool collectDirectory(StringRef directory, std::vector<Job> & jobs){
+  std::error_code EC;
+  for(sys::fs::recursive_directory_iterator it(directory, EC), end; it != end && !EC; it.increment(EC)){
+    if(isSource(it->path()) && it->type() != sys::fs::file_type::directory_file){
+      SmallString<128> absolute(it->path());
+      sys::fs::make_absolute(absolute);
+      jobs.push_back({std::string(absolute), std::string(sys::path::parent_path(absolute)), {}});
+    }
+  }
+  return !EC;
+}
+
+/*Dal compile_commands.json si tengono gli argomenti che cambiano il
+significato del sorgente; compilatore, -c, -o, -O e il file stesso li
+sceglie il driver*/
+bool collectCompileCommands(StringRef path, std::vector<Job> & jobs){
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  if(!buffer){
+    errs() << path << ": " << buffer.getError().message() << "\n";
+    return false;
+  }
+  Expected<json::Value> root = json::parse((*buffer)->getBuffer());
+  if(!root){
+    errs() << path << ": " << toString(root.takeError()) << "\n";
+    return false;
+  }
+  json::Array * entries = root->getAsArray();
+  if(!entries){
+    errs() << path << ": atteso un array di comandi\n";
+    return false;
+  }
+
+  for(json::Value & entry : *entries){
+    json::Object * command = entry.getAsObject();
+    if(!command){
+      continue;
+    }
+    Job job;
+    if(std::optional<StringRef> directory = command->getString("directory")){
+      job.directory = directory->str();
+    }
+    std::optional<StringRef> file = command->getString("file");
+    if(!file || !isSource(*file)){
+      continue;
+    }
+    SmallString<128> absolute(*file);
+    sys::fs::make_absolute(job.directory, absolute);
+    job.file = std::string(absolute);
+
+    SmallVector<std::string, 32> arguments;
+    if(json::Array * list = command->getArray("arguments")){
+      for(json::Value & argument : *list){
+        if(std::optional<StringRef> text = argument.getAsString()){
+          arguments.push_back(text->str());
+        }
+      }
+    }else if(std::optional<StringRef> line = command->getString("command")){
+      BumpPtrAllocator allocator;
+      StringSaver saver(allocator);
+      SmallVector<const char *, 32> tokens;
+      cl::TokenizeGNUCommandLine(*line, saver, tokens);
+      for(const char * token : tokens){
+        arguments.push_back(token);
+      }
+    }
+
+    for(unsigned k = 1; k < arguments.size(); ++k){
+      StringRef argument = arguments[k];
+      if(argument == "-o"){
+        k++;
+        continue;
+      }
+      if(argument == "-c" || argument.starts_with("-O") || argument == *file || argument == job.file){
+        continue;
+      }
+      job.arguments.push_back(argument.str());
+    }
+    jobs.push_back(std::move(job));
+  }
+  return true;
+}
+
+/*Esegue clang con gli argomenti del job più extra; in caso di errore
+riporta lo stderr di clang*/
+bool runClang(const Job & job, ArrayRef<std::string> extra, std::string & log){
+  std::vector<StringRef> arguments = {Clang};
+  // Relative paths of the command (-I, the source) are resolved against its directory
+  std::string directory = "-working-directory=" + job.directory;
+  if(!job.directory.empty()){
+    arguments.push_back(directory);
+  }
+  for(const std::string & argument : job.arguments){
+    arguments.push_back(argument);
+  }
+  for(const std::string & argument : extra){
+    arguments.push_back(argument);
+  }
+  arguments.push_back(job.file);
+
+  SmallString<128> stderrPath;
+  if(sys::fs::createTemporaryFile("compilatori-clang", "log", stderrPath)){
+    log = "file temporaneo non creato";
+    return false;
+  }
+  std::optional<StringRef> redirects[] = {std::nullopt, std::nullopt, StringRef(stderrPath)};
+  std::string error;
+  int result = sys::ExecuteAndWait(Clang, arguments, std::nullopt, redirects, 0, 0, &error);
+  if(result != 0){
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(stderrPath);
+    log = buffer ? (*buffer)->getBuffer().str() : error;
+  }
+  sys::fs::remove(stderrPath);
+  return result == 0;
+}
+
+/*Percorso dei .ll senza estensione: accanto al sorgente o in -output-dir
+con il solo nome del file*/
+std::string getOutputBase(const Job & job){
+  SmallString<128> outputBase(job.file);
+  sys::path::replace_extension(outputBase, "");
+  if(!OutputDir.empty()){
+    SmallString<128> base(OutputDir);
+    sys::path::append(base, sys::path::filename(outputBase));
+    outputBase = base;
+  }
+  return std::string(outputBase);
+}
+
+/*Due job che scrivono gli stessi .ll si sovrascriverebbero a vicenda, in
+parallelo: a/x.c e b/x.c con -output-dir, x.c e x.cpp nella stessa cartella
+o lo stesso file due volte nel compile_commands.json*/
+bool checkOutputCollisions(ArrayRef<Job> jobs){
+  StringMap<const Job *> outputs;
+  bool unique = true;
+  for(const Job & job : jobs){
+    auto inserted = outputs.try_emplace(getOutputBase(job), &job);
+    if(!inserted.second){
+      errs() << job.file << " e " << inserted.first->second->file << " scriverebbero entrambi " << inserted.first->first() << ".ll\n";
+      unique = false;
+    }
+  }
+  return unique;
+}
+
+/*Esegue la pipeline sul modulo come opt -passes*/
+bool runPipeline(Module & M, StringRef pipeline, std::string & error){
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  getCompilatoriPassesPluginInfo().RegisterPassBuilderCallbacks(PB);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if(Error err = PB.parsePassPipeline(MPM, pipeline)){
+    error = toString(std::move(err));
+    return false;
+  }
+  MPM.run(M, MAM);
+  return true;
+}
+
+/*Le tre fasi di un file, ognuna con la propria chiave nella cache:
+1. clang -O0 -emit-llvm, chiave dal sorgente preprocessato e dal comando
+2. pre-passes sul modulo della fase 1
+3. passes sul modulo della fase 2, senza rileggerlo da file
+Se la fase 3 è in cache non si esegue niente oltre al preprocessore*/
+Outcome processJob(const Job & job, std::string & log){
+  SmallString<128> preprocessed;
+  if(sys::fs::createTemporaryFile("compilatori", "i", preprocessed)){
+    log = "file temporaneo non creato";
+    return Outcome::Failed;
+  }
+  bool ok = runClang(job, {"-E", "-o", std::string(preprocessed)}, log);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> source = MemoryBuffer::getFile(preprocessed);
+  sys::fs::remove(preprocessed);
+  if(!ok || !source){
+    return Outcome::Failed;
+  }
+
+  std::string command;
+  for(const std::string & argument : job.arguments){
+    command += argument + " ";
+  }
+  std::string irKey = hashKey({ToolHash, Clang, command, (*source)->getBuffer()});
+  std::string preKey = hashKey({irKey, PrePasses});
+  std::string optKey = hashKey({preKey, Passes});
+
+  std::string outputBase = getOutputBase(job);
+  std::string intermediate = outputBase + ".ll";
+  std::string optimized = outputBase + ".optimized.ll";
+
+  if(sys::fs::exists(cachePath(optKey)) && sys::fs::exists(cachePath(preKey))){
+    bool copied = copyFile(cachePath(preKey), intermediate) && copyFile(cachePath(optKey), optimized);
+    log = copied ? "" : "copia dalla cache non riuscita";
+    return copied ? Outcome::Cached : Outcome::Failed;
+  }
+
+  LLVMContext C;
+  SMDiagnostic diagnostic;
+  std::unique_ptr<Module> M;
+  if(sys::fs::exists(cachePath(preKey))){
+    M = parseIRFile(cachePath(preKey), diagnostic, C);
+  }else{
+    if(!sys::fs::exists(cachePath(irKey))){
+      // optnone would make the passes skip every function; another job with
+      // the same source writes a different temporary file, as in writeFile
+      SmallString<128> ir;
+      if(sys::fs::createUniqueFile(cachePath(irKey) + ".%%%%%%.clang", ir)){
+        log = "file temporaneo non creato";
+        return Outcome::Failed;
+      }
+      if(!runClang(job, {"-O0", "-Xclang", "-disable-O0-optnone", "-S", "-emit-llvm", "-o", std::string(ir)}, log)){
+        sys::fs::remove(ir);
+        return Outcome::Failed;
+      }
+      sys::fs::rename(ir, cachePath(irKey));
+    }
+    M = parseIRFile(cachePath(irKey), diagnostic, C);
+    if(M && !runPipeline(*M, PrePasses, log)){
+      return Outcome::Failed;
+    }
+    if(M){
+      writeFile(cachePath(preKey), [&](raw_ostream & OS) { M->print(OS, nullptr); });
+    }
+  }
+  if(!M){
+    raw_string_ostream OS(log);
+    diagnostic.print(job.file.c_str(), OS);
+    return Outcome::Failed;
+  }
+
+  if(!runPipeline(*M, Passes, log)){
+    return Outcome::Failed;
+  }
+  writeFile(cachePath(optKey), [&](raw_ostream & OS) { M->print(OS, nullptr); });
+  if(!copyFile(cachePath(preKey), intermediate) || !copyFile(cachePath(optKey), optimized)){
+    log = "scrittura di " + optimized + " non riuscita";
+    return Outcome::Failed;
+  }
+  return Outcome::Compiled;
+}
+
+int main(int argc, char **argv){
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "Batch driver of the passes of the assignments\n");
+
+  if(ErrorOr<std::string> clang = sys::findProgramByName(Clang)){
+    Clang = *clang;
+  }else{
+    errs() << Clang << " non trovato\n";
+    return 1;
+  }
+  ErrorOr<std::unique_ptr<MemoryBuffer>> self = MemoryBuffer::getFile(sys::fs::getMainExecutable(argv[0], (void *)&main));
+  ToolHash = self ? utohexstr(xxHash64((*self)->getBuffer())) : "";
+  // clang runs in the directory of each command
+  SmallString<128> cacheDir(CacheDir);
+  sys::fs::make_absolute(cacheDir);
+  CacheDir = std::string(cacheDir);
+  if(sys::fs::create_directories(CacheDir) || (!OutputDir.empty() && sys::fs::create_directories(OutputDir))){
+    errs() << "Cartelle " << CacheDir << " e " << OutputDir << " non create\n";
+    return 1;
+  }
+
+  std::vector<Job> jobs;
+  bool collected = sys::fs::is_directory(Input) ? collectDirectory(Input, jobs) : collectCompileCommands(Input, jobs);
+  if(!collected || !checkOutputCollisions(jobs)){
+    return 1;
+  }
+
+#ifndef NDEBUG
+  // The -debug output of the passes goes to the one dbgs() stream: the files are processed one at a time
+  if(DebugFlag){
+    Jobs = 1;
+  }
+#endif
+  std::atomic<unsigned> compiled{0}, cached{0}, failed{0};
+  std::mutex reportMutex;
+  {
+    ThreadPool pool(hardware_concurrency(Jobs));
+    for(const Job & job : jobs){
+      pool.async([&job, &compiled, &cached, &failed, &reportMutex] {
+        std::string log;
+        switch(processJob(job, log)){
+          case Outcome::Compiled: compiled++; break;
+          case Outcome::Cached: cached++; break;
+          case Outcome::Failed: {
+            failed++;
+            std::lock_guard<std::mutex> lock(reportMutex);
+            errs() << job.file << ": errore\n" << log << "\n";
+            break;
+          }
+        }
+      });
+    }
+    pool.wait();
+  }
+
+  errs() << jobs.size() << " file: " << compiled << " compilati, " << cached << " dalla cache, " << failed << " errori\n";
+  return failed ? 1 : 0;
+}
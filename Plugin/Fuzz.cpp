@@ -0,0 +1,599 @@
+//===-- Fuzz.cpp - Differential fuzzing of the passes --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Generates random kernels (arithmetic, branches, loops and loop nests over
+// global arrays, loops with invariant loads, stores and calls, loops with a
+// break, loops over pointer parameters that may alias, in the shape of
+// clang -O0 + mem2reg), runs a pipeline of the passes on each one, verifies
+// the module and executes the original and the optimized kernel with the
+// interpreter on random inputs. An execution that runs out of steps is
+// reported as not terminating:
+//   CompilatoriFuzz -passes=loopfusionpass -seed=1 -iterations=1000
+// The report goes to stderr, like the messages of the passes under -debug.
+// Every failing kernel is saved as fuzz-<seed>.ll and fuzz-<seed>.optimized.ll.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Plugin.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/ExecutionEngine/Interpreter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <random>
+
+using namespace llvm;
+
+static cl::opt<std::string> Passes("passes", cl::init("loopfusionpass"),
+    cl::desc("Pipeline under test, as for opt -passes"));
+static cl::opt<unsigned> Seed("seed", cl::init(1), cl::desc("Seed of the first kernel"));
+static cl::opt<unsigned> Iterations("iterations", cl::init(100), cl::desc("Number of kernels"));
+static cl::opt<unsigned> Size("size", cl::init(6), cl::desc("Segments (statements, branches, loops) of a kernel"));
+static cl::opt<unsigned> Inputs("inputs", cl::init(8), cl::desc("Random inputs executed per kernel"));
+static cl::opt<bool> Scaling("scaling", cl::init(false),
+    cl::desc("Also time the pipeline on kernels of 1x, 2x, 4x, 8x the size"));
+static cl::opt<double> ScalingLimit("scaling-limit", cl::init(3.0),
+    cl::desc("Time ratio, when the size doubles, above which the compile time is reported as superlinear"));
+static cl::opt<std::string> OutputDir("output-dir", cl::init("."), cl::desc("Directory of the failing kernels"));
+static cl::opt<unsigned> MaxSteps("max-steps", cl::init(1u << 22),
+    cl::desc("Blocks an execution may enter before it is stopped as not terminating"));
+
+// Every access stays within the arrays: indices i + offset with |offset| <= Pad
+static const unsigned MaxN = 64, Pad = 2, GridN = 16;
+
+/*Generatore di un kernel i32 @kernel(i32 %n, i32 %x, i32 %y): inizializza
+gli array globali, esegue Size segmenti casuali e restituisce una somma di
+controllo di array, scalari e del contatore di @effect. Ogni loop ha la
+forma di clang -O0 + mem2reg (cond, body, inc, end) e ogni operazione è
+definita per ogni input: niente flag nsw/nuw/exact, divisori e shift
+costanti e validi, accessi dentro gli array anche attraverso i puntatori*/
+struct KernelGenerator {
+  std::mt19937 rng;
+  LLVMContext & C;
+  Module & M;
+  IRBuilder<> B;
+  Function * F = nullptr;
+  GlobalVariable * arrays[2];
+  GlobalVariable * grid = nullptr;
+  // Side effect of the calls: counter = counter * 31 + argument
+  GlobalVariable * counter = nullptr;
+  Function * effect = nullptr;
+  Value * n = nullptr;
+  Value * m = nullptr;
+  // Scalars that dominate the insertion point
+  SmallVector<Value *, 32> pool;
+  unsigned blocks = 0;
+
+  KernelGenerator(unsigned seed, Module & M) : rng(seed), C(M.getContext()), M(M), B(M.getContext()) {}
+
+  unsigned random(unsigned bound){
+    return std::uniform_int_distribution<unsigned>(0, bound - 1)(rng);
+  }
+
+  // Blocks are appended once their predecessors are, in the order of clang
+  BasicBlock * newBlock(const Twine & name, bool append = true){
+    return BasicBlock::Create(C, name + Twine(blocks++), append ? F : nullptr);
+  }
+
+  Value * constant(int value){
+    return B.getInt32(value);
+  }
+
+  // Identities and powers of two are what LocalOpts looks for
+  Value * operand(){
+    static const int interesting[] = {0, 1, -1, 2, 4, 8, 16, 3, 7, 15, 17, 31, 32, -8};
+    if(pool.empty() || random(3) == 0){
+      return constant(interesting[random(std::size(interesting))]);
+    }
+    return pool[random(pool.size())];
+  }
+
+  Value * binary(Value * L, Value * R){
+    static const int divisors[] = {1, 2, 3, 4, 5, 7, 8, 16, 64, -2, -4, -7, -8};
+    switch(random(13)){
+      case 0: return B.CreateAdd(L, R);
+      case 1: return B.CreateSub(L, R);
+      case 2: return B.CreateMul(L, R);
+      case 3: return B.CreateAnd(L, R);
+      case 4: return B.CreateOr(L, R);
+      case 5: return B.CreateXor(L, R);
+      case 6: return B.CreateShl(L, constant(random(32)));
+      case 7: return B.CreateLShr(L, constant(random(32)));
+      case 8: return B.CreateAShr(L, constant(random(32)));
+      case 9: return B.CreateSDiv(L, constant(divisors[random(std::size(divisors))]));
+      case 10: return B.CreateUDiv(L, constant(divisors[random(std::size(divisors))]));
+      case 11: return B.CreateSRem(L, constant(divisors[random(std::size(divisors))]));
+      default: return B.CreateURem(L, constant(divisors[random(std::size(divisors))]));
+    }
+  }
+
+  Value * arithmetic(){
+    Value * value = binary(operand(), operand());
+    // a = b + k, c = a - k: the pattern of multi-instruction optimization
+    if(random(4) == 0){
+      int k = random(16) + 1;
+      value = B.CreateSub(B.CreateAdd(value, constant(k)), constant(k));
+    }
+    pool.push_back(value);
+    return value;
+  }
+
+  Value * element(GlobalVariable * array, Value * index){
+    return B.CreateInBoundsGEP(array->getValueType(), array, {B.getInt32(0), index});
+  }
+
+  Value * element(Value * i, Value * j){
+    Type * row = cast<ArrayType>(grid->getValueType())->getElementType();
+    Value * rowPtr = B.CreateInBoundsGEP(grid->getValueType(), grid, {B.getInt32(0), i});
+    return B.CreateInBoundsGEP(row, rowPtr, {B.getInt32(0), j});
+  }
+
+  // Index i + offset of an array padded by pad elements on each side, offset in [-pad, pad]
+  Value * shifted(Value * i, unsigned pad){
+    return B.CreateAdd(i, constant(random(2 * pad + 1)));
+  }
+
+  /*Loop for(i = 0; i < bound; i++): body riceve l'indice e produce il
+  nuovo valore dello scalare portato dal loop, che resta disponibile dopo.
+  Con exitWhen il body inizia con if(exitWhen(i)) break;*/
+  void loop(Value * bound, const std::function<Value *(Value *, PHINode *)> & body,
+            const std::function<Value *(Value *)> & exitWhen = nullptr){
+    BasicBlock * preheader = B.GetInsertBlock();
+    BasicBlock * cond = newBlock("for.cond");
+    BasicBlock * bodyBB = newBlock("for.body");
+    BasicBlock * inc = newBlock("for.inc", false);
+    BasicBlock * end = newBlock("for.end", false);
+    Value * init = operand();
+    B.CreateBr(cond);
+
+    B.SetInsertPoint(cond);
+    PHINode * i = B.CreatePHI(B.getInt32Ty(), 2, "i");
+    PHINode * carried = B.CreatePHI(B.getInt32Ty(), 2, "s");
+    B.CreateCondBr(B.CreateICmpSLT(i, bound), bodyBB, end);
+
+    // Values of the body do not dominate for.end
+    unsigned scope = pool.size();
+    pool.push_back(carried);
+    B.SetInsertPoint(bodyBB);
+    if(exitWhen){
+      BasicBlock * breakBB = newBlock("if.then");
+      BasicBlock * restBB = newBlock("if.end", false);
+      B.CreateCondBr(exitWhen(i), breakBB, restBB);
+      B.SetInsertPoint(breakBB);
+      B.CreateBr(end);
+      restBB->insertInto(F);
+      B.SetInsertPoint(restBB);
+    }
+    Value * next = body(i, carried);
+    B.CreateBr(inc);
+    pool.resize(scope);
+
+    inc->insertInto(F);
+    end->insertInto(F);
+    B.SetInsertPoint(inc);
+    Value * iNext = B.CreateAdd(i, constant(1));
+    B.CreateBr(cond);
+    i->addIncoming(constant(0), preheader);
+    i->addIncoming(iNext, inc);
+    carried->addIncoming(init, preheader);
+    carried->addIncoming(next, inc);
+
+    B.SetInsertPoint(end);
+    pool.push_back(carried);
+  }
+
+  // Loop over the arrays with loads and stores at nearby indices
+  void arrayLoop(){
+    loop(n, [this](Value * i, PHINode * carried) {
+      Value * loaded = B.CreateLoad(B.getInt32Ty(), element(arrays[random(2)], shifted(i, Pad)));
+      pool.push_back(loaded);
+      // Invariant computations for LICM and LCM
+      if(random(2) == 0){
+        arithmetic();
+      }
+      Value * value = binary(loaded, operand());
+      B.CreateStore(value, element(arrays[random(2)], shifted(i, Pad)));
+      return binary(carried, value);
+    });
+  }
+
+  /*Load, store e chiamate con indirizzi e argomenti invarianti: la load può
+  leggere un elemento scritto dal loop, la store e la chiamata vanno
+  eseguite a ogni iterazione anche se nessuno usa il risultato*/
+  void invariantLoop(){
+    loop(n, [this](Value * i, PHINode * carried) {
+      Value * fixed = element(arrays[random(2)], constant(random(MaxN + 2 * Pad)));
+      Value * loaded = B.CreateLoad(B.getInt32Ty(), fixed);
+      pool.push_back(loaded);
+      switch(random(4)){
+        case 0: B.CreateStore(operand(), element(arrays[random(2)], constant(random(MaxN + 2 * Pad)))); break;
+        case 1: B.CreateStore(binary(loaded, operand()), element(arrays[random(2)], shifted(i, Pad))); break;
+        case 2: B.CreateCall(effect, {operand()}); break;
+        default: pool.push_back(B.CreateCall(effect, {operand()})); break;
+      }
+      return binary(carried, pool.back());
+    });
+  }
+
+  // Loop with a break: it has more exits and no single exit block
+  void earlyExitLoop(){
+    loop(n, [this](Value * i, PHINode * carried) {
+      Value * loaded = B.CreateLoad(B.getInt32Ty(), element(arrays[random(2)], shifted(i, Pad)));
+      Value * value = binary(loaded, operand());
+      B.CreateStore(value, element(arrays[random(2)], shifted(i, Pad)));
+      return binary(carried, value);
+    }, [this](Value * i) {
+      Value * loaded = B.CreateLoad(B.getInt32Ty(), element(arrays[random(2)], shifted(i, Pad)));
+      return B.CreateICmpSGT(loaded, operand());
+    });
+  }
+
+  /*Loop su due puntatori parametro di una funzione chiamata dal kernel: gli
+  argomenti sono elementi vicini dello stesso array o di array diversi,
+  quindi gli accessi dei due puntatori possono sovrapporsi*/
+  void pointerLoops(){
+    Type * i32 = B.getInt32Ty();
+    Type * ptr = PointerType::getUnqual(i32);
+    Function * callee = Function::Create(FunctionType::get(B.getVoidTy(), {ptr, ptr, i32}, false),
+        GlobalValue::InternalLinkage, "pointers", M);
+    // Offsets in [0, Pad] and indices i + [0, Pad] stay within the padding
+    GlobalVariable * first = arrays[random(2)];
+    GlobalVariable * second = random(2) ? first : arrays[random(2)];
+    B.CreateCall(callee, {element(first, constant(random(Pad + 1))), element(second, constant(random(Pad + 1))), n});
+
+    IRBuilderBase::InsertPoint caller = B.saveIP();
+    Function * kernel = F;
+    SmallVector<Value *, 32> scope = std::move(pool);
+    F = callee;
+    pool.assign({callee->getArg(2)});
+    B.SetInsertPoint(newBlock("entry"));
+    for(unsigned k = 0, loops = random(2) + 1; k < loops; ++k){
+      loop(callee->getArg(2), [&](Value * i, PHINode * carried) {
+        Value * from = callee->getArg(random(2));
+        Value * to = callee->getArg(random(2));
+        Value * loaded = B.CreateLoad(i32, B.CreateInBoundsGEP(i32, from, B.CreateAdd(i, constant(random(Pad + 1)))));
+        Value * value = binary(loaded, operand());
+        B.CreateStore(value, B.CreateInBoundsGEP(i32, to, B.CreateAdd(i, constant(random(Pad + 1)))));
+        return binary(carried, value);
+      });
+    }
+    B.CreateRetVoid();
+    F = kernel;
+    pool = std::move(scope);
+    B.restoreIP(caller);
+  }
+
+  void gridNest(){
+    loop(m, [this](Value * i, PHINode * outer) {
+      loop(m, [this, i](Value * j, PHINode * inner) {
+        Value * loaded = B.CreateLoad(B.getInt32Ty(), element(shifted(i, 1), shifted(j, 1)));
+        Value * value = binary(loaded, operand());
+        B.CreateStore(value, element(B.CreateAdd(i, constant(1)), B.CreateAdd(j, constant(1))));
+        return B.CreateAdd(inner, value);
+      });
+      return B.CreateXor(outer, pool.back());
+    });
+  }
+
+  void diamond(){
+    BasicBlock * thenBB = newBlock("if.then");
+    BasicBlock * elseBB = newBlock("if.else", false);
+    BasicBlock * endBB = newBlock("if.end", false);
+    CmpInst::Predicate predicates[] = {CmpInst::ICMP_EQ, CmpInst::ICMP_SLT, CmpInst::ICMP_UGT, CmpInst::ICMP_SGE};
+    B.CreateCondBr(B.CreateICmp(predicates[random(4)], operand(), operand()), thenBB, elseBB);
+
+    unsigned scope = pool.size();
+    B.SetInsertPoint(thenBB);
+    Value * thenValue = arithmetic();
+    B.CreateBr(endBB);
+    pool.resize(scope);
+    elseBB->insertInto(F);
+    B.SetInsertPoint(elseBB);
+    Value * elseValue = arithmetic();
+    B.CreateBr(endBB);
+    pool.resize(scope);
+
+    endBB->insertInto(F);
+    B.SetInsertPoint(endBB);
+    PHINode * phi = B.CreatePHI(B.getInt32Ty(), 2, "merge");
+    phi->addIncoming(thenValue, thenBB);
+    phi->addIncoming(elseValue, elseBB);
+    pool.push_back(phi);
+  }
+
+  Function * generate(unsigned size){
+    Type * i32 = Type::getInt32Ty(C);
+    for(unsigned k = 0; k < 2; ++k){
+      arrays[k] = new GlobalVariable(M, ArrayType::get(i32, MaxN + 2 * Pad), false, GlobalValue::InternalLinkage,
+          ConstantAggregateZero::get(ArrayType::get(i32, MaxN + 2 * Pad)), k == 0 ? "A" : "B");
+    }
+    ArrayType * row = ArrayType::get(i32, GridN + 2);
+    grid = new GlobalVariable(M, ArrayType::get(row, GridN + 2), false, GlobalValue::InternalLinkage,
+        ConstantAggregateZero::get(ArrayType::get(row, GridN + 2)), "G");
+    counter = new GlobalVariable(M, i32, false, GlobalValue::InternalLinkage, ConstantInt::get(i32, 0), "Counter");
+    effect = Function::Create(FunctionType::get(i32, {i32}, false), GlobalValue::InternalLinkage, "effect", M);
+    B.SetInsertPoint(BasicBlock::Create(C, "entry", effect));
+    Value * updated = B.CreateAdd(B.CreateMul(B.CreateLoad(i32, counter), constant(31)), effect->getArg(0));
+    B.CreateStore(updated, counter);
+    B.CreateRet(updated);
+
+    F = Function::Create(FunctionType::get(i32, {i32, i32, i32}, false), GlobalValue::ExternalLinkage, "kernel", M);
+    Value * x = F->getArg(1);
+    Value * y = F->getArg(2);
+    B.SetInsertPoint(newBlock("entry"));
+    n = B.CreateURem(F->getArg(0), constant(MaxN + 1), "n");
+    m = B.CreateURem(F->getArg(0), constant(GridN + 1), "m");
+    pool.append({x, y});
+
+    // Every element is initialized from the inputs, the counter too
+    B.CreateStore(y, counter);
+    loop(constant(MaxN + 2 * Pad), [&](Value * i, PHINode * carried) {
+      B.CreateStore(B.CreateAdd(B.CreateMul(i, x), y), element(arrays[0], i));
+      B.CreateStore(B.CreateXor(i, y), element(arrays[1], i));
+      return carried;
+    });
+    pool.pop_back();
+    loop(constant(GridN + 2), [&](Value * i, PHINode * outer) {
+      loop(constant(GridN + 2), [&](Value * j, PHINode * inner) {
+        B.CreateStore(B.CreateSub(B.CreateMul(i, j), x), element(i, j));
+        return inner;
+      });
+      return outer;
+    });
+    pool.resize(2);
+
+    for(unsigned s = 0; s < size; ++s){
+      switch(random(8)){
+        case 0: arithmetic(); break;
+        case 1: diamond(); break;
+        case 4: gridNest(); break;
+        case 5: invariantLoop(); break;
+        case 6: earlyExitLoop(); break;
+        case 7: pointerLoops(); break;
+        default: arrayLoop(); break;
+      }
+    }
+
+    // Checksum of the arrays and of the scalars still in scope
+    Value * checksum = B.CreateLoad(i32, counter);
+    for(Value * value : pool){
+      checksum = B.CreateAdd(B.CreateMul(checksum, constant(31)), value);
+    }
+    pool.assign({checksum});
+    loop(constant(MaxN + 2 * Pad), [&](Value * i, PHINode * carried) {
+      Value * a = B.CreateLoad(i32, element(arrays[0], i));
+      Value * b = B.CreateLoad(i32, element(arrays[1], i));
+      return B.CreateAdd(B.CreateMul(carried, constant(31)), B.CreateXor(a, b));
+    });
+    Value * arraysChecksum = pool.back();
+    loop(constant(GridN + 2), [&](Value * i, PHINode * outer) {
+      loop(constant(GridN + 2), [&](Value * j, PHINode * inner) {
+        return B.CreateAdd(B.CreateMul(inner, constant(7)), B.CreateLoad(i32, element(i, j)));
+      });
+      return B.CreateAdd(outer, pool.back());
+    });
+    B.CreateRet(B.CreateXor(arraysChecksum, pool.back()));
+    return F;
+  }
+};
+
+std::unique_ptr<Module> generateKernel(LLVMContext & C, unsigned seed, unsigned size){
+  auto M = std::make_unique<Module>("fuzz-" + std::to_string(seed), C);
+  KernelGenerator(seed, *M).generate(size);
+  return M;
+}
+
+/*Esegue la pipeline sul modulo come opt -passes; restituisce false se la
+pipeline non è valida*/
+bool runPipeline(Module & M, StringRef pipeline, std::string & error){
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  getCompilatoriPassesPluginInfo().RegisterPassBuilderCallbacks(PB);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if(Error err = PB.parsePassPipeline(MPM, pipeline)){
+    error = toString(std::move(err));
+    return false;
+  }
+  MPM.run(M, MAM);
+  return true;
+}
+
+double timePipeline(Module & M){
+  std::string error;
+  std::unique_ptr<Module> copy = CloneModule(M);
+  TimeRecord start = TimeRecord::getCurrentTime(true);
+  runPipeline(*copy, Passes, error);
+  TimeRecord end = TimeRecord::getCurrentTime(false);
+  return end.getProcessTime() - start.getProcessTime();
+}
+
+/*Ogni blocco, tranne quelli di ingresso, consuma un passo da un contatore
+globale; finiti i passi ogni funzione ritorna subito. Un loop che dopo la
+pipeline non termina si ferma invece di bloccare il fuzzer*/
+GlobalVariable * addFuel(Module & M){
+  LLVMContext & C = M.getContext();
+  IRBuilder<> B(C);
+  GlobalVariable * fuel = new GlobalVariable(M, B.getInt32Ty(), false, GlobalValue::InternalLinkage, B.getInt32(0), "fuel");
+  for(Function & F : M){
+    if(F.isDeclaration()){
+      continue;
+    }
+    SmallVector<BasicBlock *, 32> blocks;
+    for(BasicBlock & BB : drop_begin(F)){
+      blocks.push_back(&BB);
+    }
+    BasicBlock * outOfFuel = BasicBlock::Create(C, "out.of.fuel", &F);
+    B.SetInsertPoint(outOfFuel);
+    if(F.getReturnType()->isVoidTy()){
+      B.CreateRetVoid();
+    }else{
+      B.CreateRet(Constant::getNullValue(F.getReturnType()));
+    }
+
+    for(BasicBlock * BB : blocks){
+      BasicBlock * rest = BB->splitBasicBlock(BB->getFirstInsertionPt(), BB->getName() + ".fueled");
+      BB->getTerminator()->eraseFromParent();
+      B.SetInsertPoint(BB);
+      Value * left = B.CreateSub(B.CreateLoad(B.getInt32Ty(), fuel), B.getInt32(1));
+      B.CreateStore(left, fuel);
+      // Signed: after a callee ran out, the caller stops at its next block
+      B.CreateCondBr(B.CreateICmpSLE(left, B.getInt32(0)), outOfFuel, rest);
+    }
+  }
+  return fuel;
+}
+
+struct Execution {
+  std::unique_ptr<ExecutionEngine> engine;
+  Function * kernel = nullptr;
+  GlobalVariable * fuel = nullptr;
+
+  Execution(std::unique_ptr<Module> M){
+    kernel = M->getFunction("kernel");
+    fuel = addFuel(*M);
+    std::string error;
+    engine.reset(EngineBuilder(std::move(M)).setEngineKind(EngineKind::Interpreter).setErrorStr(&error).create());
+    if(!engine){
+      errs() << "Interprete non disponibile: " << error << "\n";
+      exit(1);
+    }
+  }
+
+  // Returns false if the execution ran out of steps
+  bool run(ArrayRef<uint32_t> args, uint32_t & result){
+    std::vector<GenericValue> values(args.size());
+    for(unsigned k = 0; k < args.size(); ++k){
+      values[k].IntVal = APInt(32, args[k]);
+    }
+    int32_t * steps = static_cast<int32_t *>(engine->getPointerToGlobal(fuel));
+    *steps = MaxSteps;
+    result = engine->runFunction(kernel, values).IntVal.getZExtValue();
+    return *steps > 0;
+  }
+};
+
+void saveKernel(const Module & M, unsigned seed, StringRef suffix){
+  SmallString<128> path(OutputDir);
+  sys::path::append(path, "fuzz-" + std::to_string(seed) + suffix.str() + ".ll");
+  std::error_code EC;
+  raw_fd_ostream file(path, EC, sys::fs::OF_Text);
+  if(!EC){
+    M.print(file, nullptr);
+  }
+}
+
+/*Un kernel: pipeline, verifica, confronto delle esecuzioni. Restituisce
+true se il kernel ottimizzato si comporta come l'originale*/
+bool fuzzKernel(LLVMContext & C, unsigned seed, std::mt19937 & inputs){
+  std::unique_ptr<Module> original = generateKernel(C, seed, Size);
+  std::unique_ptr<Module> optimized = CloneModule(*original);
+  std::string error;
+  if(!runPipeline(*optimized, Passes, error)){
+    errs() << "Pipeline non valida: " << error << "\n";
+    exit(1);
+  }
+
+  raw_string_ostream broken(error);
+  if(verifyModule(*optimized, &broken)){
+    errs() << "seed " << seed << ": modulo non valido dopo " << Passes << "\n" << broken.str();
+    saveKernel(*original, seed, "");
+    saveKernel(*optimized, seed, ".optimized");
+    return false;
+  }
+
+  bool same = true;
+  std::string report;
+  raw_string_ostream OS(report);
+  {
+    Execution reference(CloneModule(*original));
+    Execution transformed(CloneModule(*optimized));
+    for(unsigned k = 0; k < Inputs && same; ++k){
+      uint32_t args[3] = {(uint32_t)(inputs() % (3 * MaxN)), (uint32_t)inputs(), (uint32_t)inputs()};
+      // Small values too, where identities and shifts are more likely to matter
+      if(k % 2){
+        args[1] %= 64;
+        args[2] = (int32_t)(args[2] % 64) - 32;
+      }
+      // Inputs on which the original kernel itself runs out of steps are skipped
+      uint32_t expected, actual;
+      if(!reference.run(args, expected)){
+        continue;
+      }
+      bool finished = transformed.run(args, actual);
+      if(!finished || expected != actual){
+        OS << "seed " << seed << ": kernel(" << args[0] << ", " << (int32_t)args[1] << ", " << (int32_t)args[2]
+           << ") = " << expected << ", dopo " << Passes;
+        if(finished){
+          OS << " = " << actual << "\n";
+        }else{
+          OS << " non termina dopo " << MaxSteps << " blocchi\n";
+        }
+        same = false;
+      }
+    }
+  }
+  if(!same){
+    errs() << OS.str();
+    saveKernel(*original, seed, "");
+    saveKernel(*optimized, seed, ".optimized");
+  }
+  return same;
+}
+
+/*Tempo della pipeline su kernel di dimensione Size, 2, 4, 8 volte Size:
+segnala i kernel in cui raddoppiare la dimensione fa crescere il tempo più
+di ScalingLimit volte (sopra 1 ms, sotto domina il rumore)*/
+void checkScaling(LLVMContext & C, unsigned seed){
+  double previous = 0;
+  for(unsigned factor = 1; factor <= 8; factor *= 2){
+    std::unique_ptr<Module> M = generateKernel(C, seed, Size * factor);
+    // Best of three runs
+    double time = std::min({timePipeline(*M), timePipeline(*M), timePipeline(*M)});
+    if(factor > 1 && time > 1e-3 && time > ScalingLimit * previous){
+      errs() << "seed " << seed << ": tempo di " << Passes << " superlineare, " << format("%.2f", previous * 1e3)
+             << " ms con " << Size * factor / 2 << " segmenti, " << format("%.2f", time * 1e3) << " ms con "
+             << Size * factor << "\n";
+      saveKernel(*M, seed, ".scaling");
+    }
+    previous = time;
+  }
+}
+
+int main(int argc, char **argv){
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "Differential fuzzing of the passes of the assignments\n");
+
+  LLVMContext C;
+  std::mt19937 inputs(Seed);
+  unsigned failures = 0;
+  for(unsigned seed = Seed; seed < Seed + Iterations; ++seed){
+    if(!fuzzKernel(C, seed, inputs)){
+      failures++;
+    }
+    if(Scaling){
+      checkScaling(C, seed);
+    }
+  }
+  errs() << Iterations << " kernel, " << failures << " con risultati diversi dopo " << Passes << "\n";
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+//===-- Plugin.cpp - Pass plugin of the assignments ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Plugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/LocalOpts.h"
+#include "llvm/Transforms/Utils/LoopWalk.h"
+#include "llvm/Transforms/Utils/LoopFusionPass.h"
+#include "llvm/Transforms/Utils/LoopFissionPass.h"
+#include "llvm/Transforms/Utils/LoopTilingPass.h"
+#include "llvm/Transforms/Utils/LoopStrideInterchangePass.h"
+#include "llvm/Transforms/Utils/LoopJamPass.h"
+#include "llvm/Transforms/Utils/DataflowAnalyses.h"
+#include "llvm/Transforms/Utils/SparseConstantPropagation.h"
+#include "llvm/Transforms/Utils/LazyCodeMotionPass.h"
+
+using namespace llvm;
+
+// With clang the flags are given as -mllvm, the plugin must also be loaded with -Xclang -load
+static cl::opt<bool> LocalOptsPeephole("localopts-peephole", cl::init(false), cl::Hidden,
+    cl::desc("Run LocalOpts after each InstCombine of the -O1/-O2/-O3 pipelines"));
+static cl::opt<bool> LoopWalkLoopOptimizerEnd("loopwalk-loop-optimizer-end", cl::init(false), cl::Hidden,
+    cl::desc("Run LoopWalk at the end of the loop pipeline of -O1/-O2/-O3"));
+static cl::opt<bool> LoopFusionVectorizerStart("loopfusion-vectorizer-start", cl::init(false), cl::Hidden,
+    cl::desc("Run LoopFusionPass before the loop vectorizer of -O1/-O2/-O3"));
+
+/*Nomi accettati da -passes, come nel parser di PassBuilder: i passi di
+PluginRegistry.def e require<...>/invalidate<...> per le analisi*/
+void registerPipelineParsing(PassBuilder &PB){
+  PB.registerPipelineParsingCallback([](StringRef Name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>) {
+#define MODULE_PASS(NAME, CREATE_PASS)                                         \
+  if (Name == NAME) {                                                          \
+    MPM.addPass(CREATE_PASS);                                                  \
+    return true;                                                               \
+  }
+#include "PluginRegistry.def"
+    return false;
+  });
+
+  PB.registerPipelineParsingCallback([](StringRef Name, FunctionPassManager &FPM, ArrayRef<PassBuilder::PipelineElement>) {
+#define FUNCTION_PASS(NAME, CREATE_PASS)                                       \
+  if (Name == NAME) {                                                          \
+    FPM.addPass(CREATE_PASS);                                                  \
+    return true;                                                               \
+  }
+#define FUNCTION_ANALYSIS(NAME, CREATE_PASS)                                   \
+  if (Name == "require<" NAME ">") {                                           \
+    FPM.addPass(                                                               \
+        RequireAnalysisPass<std::remove_reference_t<decltype(CREATE_PASS)>,    \
+                            Function>());                                      \
+    return true;                                                               \
+  }                                                                            \
+  if (Name == "invalidate<" NAME ">") {                                        \
+    FPM.addPass(InvalidateAnalysisPass<                                        \
+                std::remove_reference_t<decltype(CREATE_PASS)>>());            \
+    return true;                                                               \
+  }
+#include "PluginRegistry.def"
+    return false;
+  });
+
+  PB.registerPipelineParsingCallback([](StringRef Name, LoopPassManager &LPM, ArrayRef<PassBuilder::PipelineElement>) {
+#define LOOP_PASS(NAME, CREATE_PASS)                                           \
+  if (Name == NAME) {                                                          \
+    LPM.addPass(CREATE_PASS);                                                  \
+    return true;                                                               \
+  }
+#include "PluginRegistry.def"
+    return false;
+  });
+}
+
+/*Le analisi devono essere registrate nel FunctionAnalysisManager prima che
+un passo ne chieda il risultato*/
+void registerAnalyses(PassBuilder &PB){
+  PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM) {
+#define FUNCTION_ANALYSIS(NAME, CREATE_PASS)                                   \
+  FAM.registerPass([] { return CREATE_PASS; });
+#include "PluginRegistry.def"
+  });
+}
+
+/*Punti di estensione delle pipeline predefinite (-O1/-O2/-O3): ogni passo
+viene aggiunto solo se il rispettivo flag è attivo, così caricare il plugin
+non cambia le pipeline*/
+void registerExtensionPoints(PassBuilder &PB){
+  PB.registerPeepholeEPCallback([](FunctionPassManager &FPM, OptimizationLevel Level) {
+    if(LocalOptsPeephole){
+      FPM.addPass(LocalOpts());
+    }
+  });
+
+  PB.registerLoopOptimizerEndEPCallback([](LoopPassManager &LPM, OptimizationLevel Level) {
+    if(LoopWalkLoopOptimizerEnd){
+      LPM.addPass(LoopWalk());
+    }
+  });
+
+  // Fused loops are vectorized as one loop
+  PB.registerVectorizerStartEPCallback([](FunctionPassManager &FPM, OptimizationLevel Level) {
+    if(LoopFusionVectorizerStart){
+      FPM.addPass(LoopFusionPass());
+    }
+  });
+}
+
+PassPluginLibraryInfo getCompilatoriPassesPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "CompilatoriPasses", LLVM_VERSION_STRING, [](PassBuilder &PB) {
+    registerPipelineParsing(PB);
+    registerAnalyses(PB);
+    registerExtensionPoints(PB);
+  }};
+}
+
+// Entry point of opt -load-pass-plugin and clang -fpass-plugin
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return getCompilatoriPassesPluginInfo();
+}
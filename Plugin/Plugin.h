@@ -0,0 +1,13 @@
+#ifndef LLVM_TRANSFORMS_COMPILATORIPASSES_PLUGIN_H
+#define LLVM_TRANSFORMS_COMPILATORIPASSES_PLUGIN_H
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+/*Registrazione dei passi in un PassBuilder, condivisa dal plugin e dagli
+strumenti che eseguono i passi senza opt*/
+void registerPipelineParsing(llvm::PassBuilder &PB);
+void registerAnalyses(llvm::PassBuilder &PB);
+void registerExtensionPoints(llvm::PassBuilder &PB);
+llvm::PassPluginLibraryInfo getCompilatoriPassesPluginInfo();
+
+#endif // LLVM_TRANSFORMS_COMPILATORIPASSES_PLUGIN_H
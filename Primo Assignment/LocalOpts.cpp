@@ -7,111 +7,292 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Utils/LocalOpts.h"
+#include "llvm/Transforms/Utils/SparseConstantPropagation.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/InstrTypes.h"
-#include <vector>
-#include <functional>
 #include <cstring>
 
 using namespace llvm;
 
-bool optimizeAdd(BinaryOperator &BinaryI) {
-  for (unsigned i = 0; i < BinaryI.getNumOperands(); ++i) {
-    // Check if operand is an immediate
-    ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI.getOperand(i));
-    if (!Immediate) {
-      continue;
+#define DEBUG_TYPE "localopts"
+
+STATISTIC(NumAddOfSub, "Number of (a - k) + k replaced by a (multi-instruction optimization)");
+STATISTIC(NumSubOfAdd, "Number of (a + k) - k replaced by a (multi-instruction optimization)");
+STATISTIC(NumMulToShl, "Number of mul by 2^n replaced by a shl (strength reduction)");
+STATISTIC(NumMulToShlSub, "Number of mul by 2^n - 1 replaced by a shl and a sub (strength reduction)");
+STATISTIC(NumMulToShlAdd, "Number of mul by 2^n + 1 replaced by a shl and an add (strength reduction)");
+STATISTIC(NumSDivToShift, "Number of sdiv by 2^n replaced by a shift (strength reduction)");
+STATISTIC(NumFDivToFMul, "Number of fdiv by a constant replaced by a fmul by its reciprocal (strength reduction)");
+STATISTIC(NumFMulChains, "Number of fmul chains of one value replaced by square and multiply (strength reduction)");
+STATISTIC(NumAlgebraicIdentities, "Number of add/sub of 0 and mul/sdiv by 1, also floating point, erased (algebraic identity)");
+STATISTIC(NumExpressionNodes, "Number of distinct subexpressions in the expression DAGs");
+
+ExpressionNode *ExpressionDAG::getLeaf(Value *V, ConstantInt *Constant) {
+  const Value *Key = Constant ? Constant : V;
+  ExpressionNode *&Leaf = leaves[Key];
+  if (Leaf) {
+    return Leaf;
+  }
+
+  Leaf = new (allocator.Allocate()) ExpressionNode();
+  Leaf->id = size++;
+
+  // Check if the floating point constant has a normal reciprocal, and if it is exact (2^n)
+  if (ConstantFP *FP = dyn_cast<ConstantFP>(V)) {
+    Leaf->constant = Leaf;
+    Leaf->fpValue = FP;
+    APFloat Reciprocal(FP->getValueAPF().getSemantics(), 1);
+    if (FP->getValueAPF().getExactInverse(&Reciprocal)) {
+      Leaf->exactReciprocal = true;
+    } else {
+      Reciprocal.divide(FP->getValueAPF(), APFloat::rmNearestTiesToEven);
     }
+    if (Reciprocal.isNormal()) {
+      Leaf->reciprocal = ConstantFP::get(FP->getContext(), Reciprocal);
+    }
+    return Leaf;
+  }
+
+  if (!Constant) {
+    return Leaf;
+  }
 
-    // Check if other operand is an Instruction
-    Instruction *Operand = dyn_cast<Instruction>(BinaryI.getOperand((i+1)%BinaryI.getNumOperands()));
-    if (!Operand) {
+  // Check if the constant is a power of 2 or "almost" power of 2 (absolute difference <= 1)
+  Leaf->constant = Leaf;
+  Leaf->value = Constant;
+  for (int Adjust : {0, 1, -1}) {
+    APInt Adjusted = Constant->getValue() + Adjust;
+    if (Adjusted.isPowerOf2()) {
+      Leaf->shift = Adjusted.exactLogBase2();
+      Leaf->adjust = Adjust;
+      break;
+    }
+  }
+  return Leaf;
+}
+
+ExpressionNode *ExpressionDAG::getOperator(unsigned Opcode, unsigned Flags, ExpressionNode *Op0, ExpressionNode *Op1, ConstantInt *Constant) {
+  // Canonical order of commutative operators: immediate second, otherwise the older node first
+  if (Instruction::isCommutative(Opcode)) {
+    bool Swap = (Op0->constant && !Op1->constant) || (!Op0->constant == !Op1->constant && Op0->id > Op1->id);
+    if (Swap) {
+      std::swap(Op0, Op1);
+    }
+  }
+
+  ExpressionNode *&Operator = operators[std::make_tuple(Opcode, Flags, Op0, Op1)];
+  if (Operator) {
+    return Operator;
+  }
+
+  Operator = new (allocator.Allocate()) ExpressionNode();
+  Operator->id = size++;
+  Operator->opcode = Opcode;
+  Operator->operands[0] = Op0;
+  Operator->operands[1] = Op1;
+  if (Constant) {
+    Operator->constant = getLeaf(Constant, Constant);
+  }
+  return Operator;
+}
+
+ExpressionNode *ExpressionDAG::getNode(Value *V) {
+  auto Found = nodes.find(V);
+  if (Found != nodes.end()) {
+    return Found->second;
+  }
+
+  // Iterative, long chains of unrolled code would overflow the stack
+  SmallVector<Value *, 16> Worklist;
+  Worklist.push_back(V);
+  while (!Worklist.empty()) {
+    Value *Current = Worklist.back();
+    if (nodes.count(Current)) {
+      Worklist.pop_back();
       continue;
     }
-    
-    // Check if other operand is a BinaryOperator
-    BinaryOperator *BinaryOperand = dyn_cast<BinaryOperator>(Operand);
-    if (!BinaryOperand) {
+
+    // Unreachable code can use itself without a PHI, its instructions are leaves
+    ConstantInt *Constant = constants.getConstantInt(Current);
+    BinaryOperator *BinaryI = dyn_cast<BinaryOperator>(Current);
+    if (!BinaryI || !constants.isExecutable(BinaryI->getParent())) {
+      nodes[Current] = getLeaf(Current, Constant);
+      Worklist.pop_back();
       continue;
     }
 
-    // Check if other operand is a Sub Instruction
-    if (BinaryOperand->getOpcode() != Instruction::Sub) {
+    // Check if the nodes of the operands are ready
+    bool Ready = true;
+    for (Value *Operand : BinaryI->operands()) {
+      if (!nodes.count(Operand)) {
+        Worklist.push_back(Operand);
+        Ready = false;
+      }
+    }
+    if (!Ready) {
       continue;
     }
 
-    // Check if the second operand of the Sub Instruction is an immediate
-    ConstantInt *OperandImmediate = dyn_cast<ConstantInt>(BinaryOperand->getOperand(1));
-    if (!OperandImmediate) {
+    // The optional data of a binary operator are its nsw, nuw, exact and fast-math flags:
+    // rewrites through a node hold for every instruction that shares it
+    Worklist.pop_back();
+    nodes[Current] = getOperator(BinaryI->getOpcode(), BinaryI->getRawSubclassOptionalData(), nodes[BinaryI->getOperand(0)], nodes[BinaryI->getOperand(1)], Constant);
+  }
+
+  return nodes[V];
+}
+
+void ExpressionDAG::reset(SparseConstantPropagationInfo &&functionConstants) {
+  constants = std::move(functionConstants);
+  nodes.clear();
+  leaves.clear();
+  operators.clear();
+  allocator.DestroyAll();
+  size = 0;
+}
+
+void ExpressionDAG::forget(const Instruction *I) {
+  nodes.erase(I);
+  constants.forget(I);
+}
+
+// The nodes of instructions replaced by an equal value keep the old operands:
+// the rules read the operands of the instruction, nullptr if none has the node
+
+// The operand of the instruction with the given node
+Value *getOperandWithNode(BinaryOperator &BinaryI, const ExpressionNode *Node, ExpressionDAG &DAG) {
+  for (Value *Operand : BinaryI.operands()) {
+    if (DAG.getNode(Operand) == Node) {
+      return Operand;
+    }
+  }
+  return nullptr;
+}
+
+// The operand of the instruction other than the immediate with the given leaf
+Value *getOtherOperand(BinaryOperator &BinaryI, const ExpressionNode *Constant, ExpressionDAG &DAG) {
+  for (unsigned i = 0; i < BinaryI.getNumOperands(); ++i) {
+    if (DAG.getNode(BinaryI.getOperand(i))->constant == Constant) {
+      return BinaryI.getOperand((i+1)%BinaryI.getNumOperands());
+    }
+  }
+  return nullptr;
+}
+
+// (a - k) + k: the Sub node, nullptr if the rule does not apply
+const ExpressionNode *matchAddOfSub(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
+  unsigned SubOpcode = Node.opcode == Instruction::FAdd ? Instruction::FSub : Instruction::Sub;
+
+  for (unsigned i = 0; i < 2; ++i) {
+    // Check if operand is an immediate
+    const ExpressionNode *Immediate = Node.operands[i]->constant;
+    if (!Immediate) {
       continue;
     }
 
-    // Check if the value of the immediate of the Instruction and the immediate of the Sub Instruction match
-    APInt OperandImmediateValue = OperandImmediate->getValue();
-    APInt ImmediateValue = Immediate->getValue();
-    if (OperandImmediateValue != ImmediateValue) {
+    // Check if other operand is a Sub Instruction by the same immediate
+    const ExpressionNode *Operand = Node.operands[1 - i];
+    if (Operand->opcode != SubOpcode || Operand->operands[1]->constant != Immediate) {
       continue;
     }
 
-    // Replace the Instruction with the other operand of the Sub Instruction
-    Value *Val = BinaryOperand->getOperand(0);
-    BinaryI.replaceAllUsesWith(Val);
-    return true;
+    return Operand;
   }
 
-  return false;
+  return nullptr;
 }
 
-bool optimizeSub(BinaryOperator &BinaryI) {
+// (a + k) - k: the Add node, nullptr if the rule does not apply
+const ExpressionNode *matchSubOfAdd(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
   // Check if the second operand is an immediate
-  ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI.getOperand(1));
+  const ExpressionNode *Immediate = Node.operands[1]->constant;
   if (!Immediate) {
+    return nullptr;
+  }
+
+  // Check if the first operand is an Add Instruction with the same immediate
+  unsigned AddOpcode = Node.opcode == Instruction::FSub ? Instruction::FAdd : Instruction::Add;
+  const ExpressionNode *Operand = Node.operands[0];
+  if (Operand->opcode != AddOpcode) {
+    return nullptr;
+  }
+  if (Operand->operands[0]->constant != Immediate && Operand->operands[1]->constant != Immediate) {
+    return nullptr;
+  }
+
+  return Operand;
+}
+
+// Floating point cancellations need reassoc and nsz, as in InstSimplify: (-0.0 - 0.0) + 0.0 is +0.0
+bool canCancel(BinaryOperator &BinaryI) {
+  return !isa<FPMathOperator>(BinaryI) || (BinaryI.hasAllowReassoc() && BinaryI.hasNoSignedZeros());
+}
+
+bool optimizeAdd(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  if (!canCancel(BinaryI)) {
     return false;
   }
 
-  // Check if the first operand is an Instruction
-  Instruction *Operand = dyn_cast<Instruction>(BinaryI.getOperand(0));
-  if (!Operand) {
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  if (!Node.cancellation.computed) {
+    Node.cancellation.node = matchAddOfSub(Node);
+    Node.cancellation.computed = true;
+  }
+  if (!Node.cancellation.node) {
     return false;
   }
 
-  // Check if the first operand is a BinaryOperator
-  BinaryOperator *BinaryOperand = dyn_cast<BinaryOperator>(Operand);
+  BinaryOperator *BinaryOperand = dyn_cast_or_null<BinaryOperator>(getOperandWithNode(BinaryI, Node.cancellation.node, DAG));
   if (!BinaryOperand) {
     return false;
   }
-  
-  // Check if the first operand is an Add Instruction
-  if (BinaryOperand->getOpcode() != Instruction::Add) {
+
+  // Replace the Instruction with the other operand of the Sub Instruction
+  Value *Val = BinaryOperand->getOperand(0);
+  BinaryI.replaceAllUsesWith(Val);
+  ++NumAddOfSub;
+  return true;
+}
+
+bool optimizeSub(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  if (!canCancel(BinaryI)) {
     return false;
   }
 
-  for (unsigned i = 0; i < BinaryOperand->getNumOperands(); ++i) {
-    // Check if the operand an immediate
-    ConstantInt *OperandImmediate = dyn_cast<ConstantInt>(BinaryOperand->getOperand(i));
-    if (!OperandImmediate) {
-      continue;
-    }
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  if (!Node.cancellation.computed) {
+    Node.cancellation.node = matchSubOfAdd(Node);
+    Node.cancellation.computed = true;
+  }
+  if (!Node.cancellation.node) {
+    return false;
+  }
 
-    // Check if the value of the immediate of the instruction and the immediate of the Add Instruction match
-    APInt OperandImmediateValue = OperandImmediate->getValue();
-    APInt ImmediateValue = Immediate->getValue();
-    if (OperandImmediateValue != ImmediateValue) {
-      continue;
-    }
-    
-    // Replace the Instruction with the other operand of the Add Instruction
-    Value *Val = BinaryOperand->getOperand((i+1)%(BinaryOperand->getNumOperands()));
-    BinaryI.replaceAllUsesWith(Val);
-    return true;
+  BinaryOperator *BinaryOperand = dyn_cast_or_null<BinaryOperator>(getOperandWithNode(BinaryI, Node.cancellation.node, DAG));
+  Value *Val = BinaryOperand ? getOtherOperand(*BinaryOperand, Node.operands[1]->constant, DAG) : nullptr;
+  if (!Val) {
+    return false;
   }
 
-  return false;
+  // Replace the Instruction with the other operand of the Add Instruction
+  BinaryI.replaceAllUsesWith(Val);
+  ++NumSubOfAdd;
+  return true;
 }
 
-bool runOnBasicBlockMultiInstructionOptimization(BasicBlock &B) {
+bool runOnBasicBlockMultiInstructionOptimization(BasicBlock &B, ExpressionDAG &DAG) {
   bool Transformed = false;
-  std::vector<Instruction*> toErase;
+  SmallVector<Instruction*, 16> toErase;
 
   for (auto Iter = B.begin(); Iter != B.end(); ++Iter) {
     Instruction &I = *Iter;
@@ -123,10 +304,10 @@ bool runOnBasicBlockMultiInstructionOptimization(BasicBlock &B) {
 
     // Optimize the instruction
     bool optimized = false;
-    if (BinaryI->getOpcode() == Instruction::Add) {
-      optimized = optimizeAdd(*BinaryI);
-    } else if (BinaryI->getOpcode() == Instruction::Sub) {
-      optimized = optimizeSub(*BinaryI);
+    if (BinaryI->getOpcode() == Instruction::Add || BinaryI->getOpcode() == Instruction::FAdd) {
+      optimized = optimizeAdd(*BinaryI, DAG);
+    } else if (BinaryI->getOpcode() == Instruction::Sub || BinaryI->getOpcode() == Instruction::FSub) {
+      optimized = optimizeSub(*BinaryI, DAG);
     } else {
       continue;
     }
@@ -138,102 +319,392 @@ bool runOnBasicBlockMultiInstructionOptimization(BasicBlock &B) {
     // Add old instruction to vector of instructions to be erased
     toErase.push_back(&I);
 
-    outs() << *BinaryI << " has been erased (multi-instruction optimization)\n";
+    LLVM_DEBUG(dbgs() << *BinaryI << " has been erased (multi-instruction optimization)\n");
     Transformed = true;
   }
 
   // Erase old instructions
   for (auto Iter = toErase.begin(); Iter != toErase.end(); ++Iter) {
     Instruction &InstToErase = **Iter;
+    DAG.forget(&InstToErase);
     InstToErase.eraseFromParent();
   }
 
   return Transformed;
 }
 
-bool optimizeSDiv(BinaryOperator &BinaryI) {
-  // Check if the second operand is an immediate
-  ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI.getOperand(1));
+// sdiv by 2^n: the leaf of the immediate, nullptr if the rule does not apply
+const ExpressionNode *matchSDivByPowerOf2(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
+  // Check if the second operand is an immediate power of 2, positive: sdiv by the sign bit is not a shift
+  const ExpressionNode *Immediate = Node.operands[1]->constant;
+  if (!Immediate || Immediate->shift < 0 || Immediate->adjust != 0 || Immediate->value->isNegative()) {
+    return nullptr;
+  }
+  return Immediate;
+}
+
+// mul by 2^n, 2^n - 1 or 2^n + 1: the leaf of the immediate, nullptr if the rule does not apply
+const ExpressionNode *matchMulByPowerOf2(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
+  // Check if there are immediate operands powers of 2 or "almost" power of 2, exact powers first
+  for (int Adjust : {0, 1, -1}) {
+    for (const ExpressionNode *Operand : Node.operands) {
+      const ExpressionNode *Immediate = Operand->constant;
+      if (Immediate && Immediate->shift >= 0 && Immediate->adjust == Adjust) {
+        return Immediate;
+      }
+    }
+  }
+  return nullptr;
+}
+
+bool optimizeSDiv(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  if (!Node.reduction.computed) {
+    Node.reduction.node = matchSDivByPowerOf2(Node);
+    Node.reduction.computed = true;
+  }
+  const ExpressionNode *Immediate = Node.reduction.node;
+  if (!Immediate) {
+    return false;
+  }
+
   Value *Val = BinaryI.getOperand(0);
+  Type *Ty = BinaryI.getType();
+  unsigned BitWidth = Ty->getScalarSizeInBits();
+  int32_t N = Immediate->shift;
+
+  // Division by 1
+  if (N == 0) {
+    BinaryI.replaceAllUsesWith(Val);
+    LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by its dividend (strength reduction)\n");
+    ++NumSDivToShift;
+    return true;
+  }
+
+  // Without remainder the ashr is exact, like the sdiv
+  if (BinaryI.isExact()) {
+    Instruction *NewInst = BinaryOperator::CreateExactAShr(Val, ConstantInt::get(Ty, N));
+    NewInst->insertAfter(&BinaryI);
+    BinaryI.replaceAllUsesWith(NewInst);
+
+    LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by an ashr exact instruction (strength reduction)\n");
+    ++NumSDivToShift;
+    return true;
+  }
+
+  // sdiv rounds toward zero, ashr toward -inf: 2^N - 1 is added to negative dividends first
+  Instruction *Sign = BinaryOperator::Create(BinaryOperator::AShr, Val, ConstantInt::get(Ty, BitWidth - 1));
+  Sign->insertAfter(&BinaryI);
+  Instruction *Bias = BinaryOperator::Create(BinaryOperator::LShr, Sign, ConstantInt::get(Ty, BitWidth - N));
+  Bias->insertAfter(Sign);
+
+  // Only negative dividends get a bias, smaller than the divisor: the add cannot overflow
+  Instruction *Rounded = BinaryOperator::CreateNSWAdd(Val, Bias);
+  Rounded->insertAfter(Bias);
+  Instruction *NewInst = BinaryOperator::Create(BinaryOperator::AShr, Rounded, ConstantInt::get(Ty, N));
+  NewInst->insertAfter(Rounded);
+  BinaryI.replaceAllUsesWith(NewInst);
+
+  LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by an ashr, a lshr, an add and an ashr instruction (strength reduction)\n");
+  ++NumSDivToShift;
+  return true;
+}
+
+bool optimizeMul(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  if (!Node.reduction.computed) {
+    Node.reduction.node = matchMulByPowerOf2(Node);
+    Node.reduction.computed = true;
+  }
+  const ExpressionNode *Immediate = Node.reduction.node;
   if (!Immediate) {
     return false;
   }
 
-  // Check if the second operand is a power of 2
-  APInt ImmediateValue = Immediate->getValue();
-  if (!ImmediateValue.isPowerOf2()) {
+  Value *Val = getOtherOperand(BinaryI, Immediate, DAG);
+  if (!Val) {
     return false;
   }
 
-  // Create lshr instruction
-  int32_t N = ImmediateValue.exactLogBase2();
-  ConstantInt *Shifts = ConstantInt::get(Immediate->getType(), N);
+  // Wrap flags of the mul that hold for the shl and the add too. x * 2^n and x * 2^n + x never
+  // exceed x * (2^n + 1) in absolute value, but x * 2^n can overflow when x * (2^n - 1) does not;
+  // 2^n is negative as a signed immediate when n is the sign bit
+  bool NUW = BinaryI.hasNoUnsignedWrap() && Immediate->adjust != 1;
+  bool NSW = BinaryI.hasNoSignedWrap() && Immediate->adjust != 1 &&
+             Immediate->shift < (int)Immediate->value->getBitWidth() - 1;
 
-  Instruction *NewInst = BinaryOperator::Create(
-  BinaryOperator::LShr, Val, Shifts);
-  
-  // Insert new instruction
+  // Create shl instruction
+  ConstantInt *Shifts = ConstantInt::get(Immediate->value->getType(), Immediate->shift);
+
+  Instruction *NewInst = BinaryOperator::Create(BinaryOperator::Shl, Val, Shifts);
+  NewInst->setHasNoUnsignedWrap(NUW);
+  NewInst->setHasNoSignedWrap(NSW);
+
+  // Insert shl instruction
   NewInst->insertAfter(&BinaryI);
+
+  // Insert eventual add or sub instruction
+  std::string str = "";
+  if (Immediate->adjust == 1) {
+    Instruction &prev = *NewInst;
+    NewInst = BinaryOperator::Create(BinaryOperator::Sub, &prev, Val);
+    NewInst->insertAfter(&prev);
+    str = " and a sub";
+    ++NumMulToShlSub;
+  } else if (Immediate->adjust == -1) {
+    Instruction &prev = *NewInst;
+    NewInst = BinaryOperator::Create(BinaryOperator::Add, &prev, Val);
+    NewInst->setHasNoUnsignedWrap(NUW);
+    NewInst->setHasNoSignedWrap(NSW);
+    NewInst->insertAfter(&prev);
+    str = " and an add";
+    ++NumMulToShlAdd;
+  } else {
+    ++NumMulToShl;
+  }
   BinaryI.replaceAllUsesWith(NewInst);
 
-  outs() << BinaryI << " has been replaced by a lshr instruction (strength reduction)\n";
+  LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by a shl" << str << " instruction (strength reduction)\n");
+
   return true;
 }
 
-bool optimizeMul(BinaryOperator &BinaryI) {
-  // Check if there are immediate operands powers of 2 or "almost" power of 2
-  int32_t diff = 1;
-  for (unsigned i = 0; i < 3; ++i, diff = (diff+1)%3) {
-    for (unsigned j = 0; j != BinaryI.getNumOperands(); ++j) {
-      ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI.getOperand(j));
-      if (!Immediate) {
-        continue;
+// fdiv by an immediate with a normal reciprocal: the leaf of the immediate, nullptr if the rule does not apply
+const ExpressionNode *matchFDivByConstant(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
+  const ExpressionNode *Immediate = Node.operands[1]->constant;
+  if (!Immediate || !Immediate->reciprocal) {
+    return nullptr;
+  }
+  return Immediate;
+}
+
+bool optimizeFDiv(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  if (!Node.reduction.computed) {
+    Node.reduction.node = matchFDivByConstant(Node);
+    Node.reduction.computed = true;
+  }
+  const ExpressionNode *Immediate = Node.reduction.node;
+  if (!Immediate) {
+    return false;
+  }
+
+  // The reciprocal of 2^n is exact, the others are rounded: only with arcp
+  if (!Immediate->exactReciprocal && !BinaryI.hasAllowReciprocal()) {
+    return false;
+  }
+
+  Instruction *NewInst = BinaryOperator::CreateFMulFMF(BinaryI.getOperand(0), Immediate->reciprocal, &BinaryI);
+  NewInst->insertAfter(&BinaryI);
+  BinaryI.replaceAllUsesWith(NewInst);
+
+  LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by a fmul instruction (strength reduction)\n");
+  ++NumFDivToFMul;
+  return true;
+}
+
+// fmul chains of one value (x * x * x * x): the node of x and the power in the node
+void matchFMulPower(ExpressionNode &Root) {
+  // Iterative in post-order like the DAG, long chains of unrolled code would overflow the stack
+  SmallVector<ExpressionNode *, 16> Worklist;
+  Worklist.push_back(&Root);
+  while (!Worklist.empty()) {
+    ExpressionNode &Node = *Worklist.back();
+    if (Node.reduction.computed) {
+      Worklist.pop_back();
+      continue;
+    }
+
+    // Instructions of unreachable code are leaves
+    if (!Node.opcode) {
+      Node.reduction.computed = true;
+      Worklist.pop_back();
+      continue;
+    }
+
+    // Check if the chains of the operands are matched
+    bool Ready = true;
+    for (ExpressionNode *Operand : Node.operands) {
+      if (Operand->opcode == Instruction::FMul && !Operand->reduction.computed) {
+        Worklist.push_back(Operand);
+        Ready = false;
       }
-  
-      // Check if it is power of 2 or "almost" power of 2 (absolute difference <= 1)
-      APInt ImmediateValue = Immediate->getValue();
-      ImmediateValue += (diff-1);
-      if (!ImmediateValue.isPowerOf2()) {
-        continue;
+    }
+    if (!Ready) {
+      continue;
+    }
+    Worklist.pop_back();
+    Node.reduction.computed = true;
+
+    // Check if the operands are the same value or chains of it
+    const ExpressionNode *Bases[2];
+    unsigned Powers[2], Multiplies[2];
+    for (unsigned i = 0; i < 2; ++i) {
+      ExpressionNode *Operand = Node.operands[i];
+      Bases[i] = Operand;
+      Powers[i] = 1;
+      Multiplies[i] = 0;
+      if (Operand->opcode == Instruction::FMul && Operand->reduction.node) {
+        Bases[i] = Operand->reduction.node;
+        Powers[i] = Operand->power;
+        Multiplies[i] = Operand->multiplies;
       }
-  
-      Value* Val = BinaryI.getOperand((j+1)%(BinaryI.getNumOperands()));
-
-      // Create shl instruction
-      int32_t N = ImmediateValue.exactLogBase2();
-      ConstantInt *Shifts = ConstantInt::get(Immediate->getType(), N);
-  
-      Instruction *NewInst = BinaryOperator::Create(BinaryOperator::Shl, Val, Shifts);
-  
-      // Insert shl instruction
-      NewInst->insertAfter(&BinaryI);
-
-      // Insert eventual add or sub instruction
-      std::string str = "";
-      if ((diff-1) == 1) {
-        Instruction &prev = *NewInst;
-	NewInst = BinaryOperator::Create(BinaryOperator::Sub, &prev, Val);
-	NewInst->insertAfter(&prev);
-	str = " and a sub";
-      } else if ((diff-1) == -1) {
-        Instruction &prev = *NewInst;
-	NewInst = BinaryOperator::Create(BinaryOperator::Add, &prev, Val);
-	NewInst->insertAfter(&prev);
-	str = " and an add";
+    }
+
+    // Powers double at each fmul of a chain of squares
+    if (Bases[0] != Bases[1] || Powers[0] + Powers[1] > (1u << 16)) {
+      continue;
+    }
+    Node.reduction.node = Bases[0];
+    Node.power = Powers[0] + Powers[1];
+    Node.multiplies = 1 + Multiplies[0] + (Node.operands[0] == Node.operands[1] ? 0 : Multiplies[1]);
+  }
+}
+
+// The value of x in a chain, nullptr if an fmul of the chain does not allow reassoc,
+// and in Chain the fmul of the chain, each once even if shared, V first
+Value *getChainBase(Value *V, const ExpressionNode *Base, ExpressionDAG &DAG, SmallVectorImpl<BinaryOperator *> &Chain) {
+  // Iterative, a value shared by more fmuls is visited once
+  SmallPtrSet<Value *, 16> Visited;
+  SmallVector<Value *, 16> Worklist;
+  Worklist.push_back(V);
+  Value *Found = nullptr;
+  Chain.clear();
+  while (!Worklist.empty()) {
+    Value *Current = Worklist.pop_back_val();
+    if (DAG.getNode(Current) == Base) {
+      Found = Current;
+      continue;
+    }
+
+    BinaryOperator *BinaryI = dyn_cast<BinaryOperator>(Current);
+    if (!BinaryI || BinaryI->getOpcode() != Instruction::FMul || !BinaryI->hasAllowReassoc()) {
+      return nullptr;
+    }
+    Chain.push_back(BinaryI);
+    for (Value *Operand : BinaryI->operands()) {
+      if (Visited.insert(Operand).second) {
+        Worklist.push_back(Operand);
       }
-      BinaryI.replaceAllUsesWith(NewInst);
-  
-      outs() << BinaryI << " has been replaced by a shl" << str << " instruction (strength reduction)\n";
-  
-      return true;
     }
   }
-  return false;
+  return Found;
 }
 
-bool runOnBasicBlockStrengthReduction(BasicBlock &B) {
+// The fmul of the chain that die when its end is replaced: the ones used only by dying fmul
+unsigned countDeadChain(ArrayRef<BinaryOperator *> Chain) {
+  SmallPtrSet<const Value *, 16> Dead;
+  Dead.insert(Chain.front());
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (BinaryOperator *BinaryI : Chain.drop_front()) {
+      if (!Dead.count(BinaryI) && all_of(BinaryI->users(), [&](const User *U) { return Dead.count(U); })) {
+        Dead.insert(BinaryI);
+        Changed = true;
+      }
+    }
+  }
+  return Dead.size();
+}
+
+// Square and multiply: x^2, x^4, ... and the product of the ones of the bits of the power
+unsigned getSquareMultiplyCost(unsigned Power) {
+  unsigned Cost = 0;
+  for (; Power > 1; Power >>= 1) {
+    Cost += 1 + (Power & 1);
+  }
+  return Cost;
+}
+
+bool optimizeFMul(BinaryOperator &BinaryI, ExpressionDAG &DAG) {
+  // Reassociating the chain needs reassoc
+  if (!BinaryI.hasAllowReassoc()) {
+    return false;
+  }
+
+  ExpressionNode &Node = *DAG.getNode(&BinaryI);
+  matchFMulPower(Node);
+  if (!Node.reduction.node || getSquareMultiplyCost(Node.power) >= Node.multiplies) {
+    return false;
+  }
+
+  // Only the end of the chain is replaced
+  for (User *U : BinaryI.users()) {
+    BinaryOperator *UserI = dyn_cast<BinaryOperator>(U);
+    if (!UserI || UserI->getOpcode() != Instruction::FMul) {
+      continue;
+    }
+    ExpressionNode &UserNode = *DAG.getNode(UserI);
+    matchFMulPower(UserNode);
+    if (UserNode.reduction.node == Node.reduction.node) {
+      return false;
+    }
+  }
+
+  // Only the fmul of the chain without other users die: a chain in square and
+  // multiply form shares its squares, and an fmul used outside the chain stays
+  SmallVector<BinaryOperator *, 16> Chain;
+  Value *Val = getChainBase(&BinaryI, Node.reduction.node, DAG, Chain);
+  if (!Val || getSquareMultiplyCost(Node.power) >= countDeadChain(Chain)) {
+    return false;
+  }
+
+  // The new fmul have only the fast-math flags common to the whole chain
+  FastMathFlags FMF = BinaryI.getFastMathFlags();
+  for (BinaryOperator *Member : Chain) {
+    FMF &= Member->getFastMathFlags();
+  }
+
+  // Create the fmul instructions
+  Instruction *Last = &BinaryI;
+  Value *Square = Val;
+  Value *Result = nullptr;
+  for (unsigned Power = Node.power; Power; Power >>= 1) {
+    if (Power & 1) {
+      if (!Result) {
+        Result = Square;
+      } else {
+        Instruction *NewInst = BinaryOperator::CreateFMul(Result, Square);
+        NewInst->setFastMathFlags(FMF);
+        NewInst->insertAfter(Last);
+        Last = NewInst;
+        Result = NewInst;
+      }
+    }
+    if (Power > 1) {
+      Instruction *NewInst = BinaryOperator::CreateFMul(Square, Square);
+      NewInst->setFastMathFlags(FMF);
+      NewInst->insertAfter(Last);
+      Last = NewInst;
+      Square = NewInst;
+    }
+  }
+  BinaryI.replaceAllUsesWith(Result);
+
+  LLVM_DEBUG(dbgs() << BinaryI << " has been replaced by " << getSquareMultiplyCost(Node.power) << " fmul instructions (strength reduction)\n");
+  ++NumFMulChains;
+  return true;
+}
+
+bool runOnBasicBlockStrengthReduction(BasicBlock &B, ExpressionDAG &DAG) {
   bool Transformed = false;
-  std::vector<Instruction*> toErase;
+  SmallVector<Instruction*, 16> toErase;
 
   for (auto Iter = B.begin(); Iter != B.end(); ++Iter) {
     Instruction &I = *Iter;
@@ -246,9 +717,13 @@ bool runOnBasicBlockStrengthReduction(BasicBlock &B) {
     // Optimize the instruction
     bool optimized = false;
     if (BinaryI->getOpcode() == Instruction::Mul) {
-      optimized = optimizeMul(*BinaryI);
+      optimized = optimizeMul(*BinaryI, DAG);
     } else if (BinaryI->getOpcode() == Instruction::SDiv) {
-      optimized = optimizeSDiv(*BinaryI);
+      optimized = optimizeSDiv(*BinaryI, DAG);
+    } else if (BinaryI->getOpcode() == Instruction::FDiv) {
+      optimized = optimizeFDiv(*BinaryI, DAG);
+    } else if (BinaryI->getOpcode() == Instruction::FMul) {
+      optimized = optimizeFMul(*BinaryI, DAG);
     } else {
       continue;
     }
@@ -265,15 +740,42 @@ bool runOnBasicBlockStrengthReduction(BasicBlock &B) {
   // Erase old instructions
   for (auto Iter = toErase.begin(); Iter != toErase.end(); ++Iter) {
     Instruction &InstToErase = **Iter;
+    DAG.forget(&InstToErase);
     InstToErase.eraseFromParent();
   }
 
   return Transformed;
 }
 
-bool runOnBasicBlockAlgebraicIdentity(BasicBlock &B) {
+// x + 0, x - 0, x * 1, x / 1: the leaf of the identity, nullptr if the rule does not apply
+const ExpressionNode *matchAlgebraicIdentity(ExpressionNode &Node) {
+  // Instructions of unreachable code are leaves
+  if (!Node.opcode) {
+    return nullptr;
+  }
+
+  int32_t Identity = (Node.opcode == Instruction::Add || Node.opcode == Instruction::Sub ||
+                      Node.opcode == Instruction::FAdd || Node.opcode == Instruction::FSub) ? 0 : 1;
+
+  // Sub and sdiv only have the identity as second operand
+  unsigned First = Instruction::isCommutative(Node.opcode) ? 0 : 1;
+  for (unsigned i = First; i < 2; ++i) {
+    // Check if operand is an immediate identity, 0.0 of either sign for floating point
+    const ExpressionNode *Immediate = Node.operands[i]->constant;
+    if (!Immediate) {
+      continue;
+    }
+    if (Immediate->fpValue ? Immediate->fpValue->isExactlyValue(Identity) || (Identity == 0 && Immediate->fpValue->isZero())
+                           : Immediate->value->getValue() == Identity) {
+      return Immediate;
+    }
+  }
+  return nullptr;
+}
+
+bool runOnBasicBlockAlgebraicIdentity(BasicBlock &B, ExpressionDAG &DAG) {
   bool Transformed = false;
-  std::vector<Instruction*> toErase;
+  SmallVector<Instruction*, 16> toErase;
 
   for (auto Iter = B.begin(); Iter != B.end(); ++Iter) {
     Instruction &I = *Iter;
@@ -283,51 +785,36 @@ bool runOnBasicBlockAlgebraicIdentity(BasicBlock &B) {
       continue;
     }
     
-    // Check if the instruction is an add, sub, mul or sdiv
-    int32_t Identity;
-    if (BinaryI->getOpcode() == Instruction::Add || BinaryI->getOpcode() == Instruction::Sub) {
-      Identity = 0;
-    } else if (BinaryI->getOpcode() == Instruction::Mul || BinaryI->getOpcode() == Instruction::SDiv) {
-      Identity = 1;
-    } else {
+    // Check if the instruction is an add, sub, mul or sdiv, integer or floating point
+    unsigned Opcode = BinaryI->getOpcode();
+    if (Opcode != Instruction::Add && Opcode != Instruction::Sub && Opcode != Instruction::Mul && Opcode != Instruction::SDiv &&
+        Opcode != Instruction::FAdd && Opcode != Instruction::FSub && Opcode != Instruction::FMul && Opcode != Instruction::FDiv) {
       continue;
     }
 
     // Check if it is an algebraic identity
-    Value *Val = nullptr;
-    if (BinaryI->getOpcode() == Instruction::Add || BinaryI->getOpcode() == Instruction::Mul) {
-      for (unsigned i = 0; i < BinaryI->getNumOperands(); ++i) {
-        // Check if operand is an immediate
-        ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI->getOperand(i));
-        if (!Immediate) {
-          continue;
-        }
-  
-        // Check if immediate is an identity
-        APInt ImmediateValue = Immediate->getValue();
-        if (ImmediateValue != Identity) {
-          continue;
-        }
-  
-        Val = BinaryI->getOperand((i+1)%(BinaryI->getNumOperands()));
-        break;
-      }
-    } else { // sub and sdiv case
-      // Check if operand is an immediate
-      ConstantInt *Immediate = dyn_cast<ConstantInt>(BinaryI->getOperand(1));
-      if (!Immediate) {
-        continue;
-      }
+    ExpressionNode &Node = *DAG.getNode(BinaryI);
+    if (!Node.identity.computed) {
+      Node.identity.node = matchAlgebraicIdentity(Node);
+      Node.identity.computed = true;
+    }
+    if (!Node.identity.node) {
+      continue;
+    }
 
-      // Check if immediate is an identity
-      APInt ImmediateValue = Immediate->getValue();
-      if (ImmediateValue != Identity) {
-        continue;
-      }
+    // x + -0.0 and x - 0.0 are x, x + 0.0 and x - -0.0 are +0.0 for x = -0.0: only with nsz
+    const ConstantFP *FPIdentity = Node.identity.node->fpValue;
+    if (FPIdentity && FPIdentity->isNegative() == (Opcode == Instruction::FSub) && FPIdentity->isZero() && !BinaryI->hasNoSignedZeros()) {
+      continue;
+    }
 
+    Value *Val = nullptr;
+    if (Opcode == Instruction::Add || Opcode == Instruction::Mul || Opcode == Instruction::FAdd || Opcode == Instruction::FMul) {
+      Val = getOtherOperand(*BinaryI, Node.identity.node, DAG);
+    } else { // sub and sdiv case
       Val = BinaryI->getOperand(0);
     }
-      
+
     if (!Val) {
       continue;
     }
@@ -338,51 +825,95 @@ bool runOnBasicBlockAlgebraicIdentity(BasicBlock &B) {
     // Add algebraic identities to vector of instructions to be erased
     toErase.push_back(&I);
 
-    outs() << *BinaryI << " has been erased (algebraic identity)\n";
+    LLVM_DEBUG(dbgs() << *BinaryI << " has been erased (algebraic identity)\n");
+    ++NumAlgebraicIdentities;
     Transformed = true;
   }
 
   // Erase algebraic identities
   for (auto Iter = toErase.begin(); Iter != toErase.end(); ++Iter) {
     Instruction &InstToErase = **Iter;
+    DAG.forget(&InstToErase);
     InstToErase.eraseFromParent();
   }
 
   return Transformed;
 }
 
-bool runOnFunction(Function &F, std::function<bool(BasicBlock&)> runOnBasicBlock) {
+// Templated on the rules, so that they are called directly for each block
+template <typename RunOnBasicBlock>
+bool runOnFunction(Function &F, ExpressionDAG &DAG, RunOnBasicBlock runOnBasicBlock) {
   bool Transformed = false;
 
+  // Operands count as immediates also when they are constant only through PHIs or branches
+  {
+    TimeTraceScope TimeScope("LocalOptsConstants", F.getName());
+    DAG.reset(computeSparseConstantPropagation(F));
+  }
+
+  // Each distinct subexpression is matched once, also when repeated by unrolling
+  TimeTraceScope TimeScope("LocalOptsRewrite", F.getName());
   for (auto Iter = F.begin(); Iter != F.end(); ++Iter) {
-    if (runOnBasicBlock(*Iter)) {
+    if (runOnBasicBlock(*Iter, DAG)) {
       Transformed = true;
     }
   }
 
+  NumExpressionNodes += DAG.size;
   return Transformed;
 }
 
 PreservedAnalyses MultiInstructionOptimization::run(Module &M, ModuleAnalysisManager &AM) {
+  // The arena of the DAG is reused by all the functions
+  ExpressionDAG DAG;
+  bool Transformed = false;
   for (auto Fiter = M.begin(); Fiter != M.end(); ++Fiter)
-    if (runOnFunction(*Fiter, runOnBasicBlockMultiInstructionOptimization))
-      return PreservedAnalyses::none();
-  
+    if (runOnFunction(*Fiter, DAG, runOnBasicBlockMultiInstructionOptimization))
+      Transformed = true;
+
+  if (Transformed)
+    return PreservedAnalyses::none();
   return PreservedAnalyses::all();
 }
 
 PreservedAnalyses StrengthReduction::run(Module &M, ModuleAnalysisManager &AM) {
+  // The arena of the DAG is reused by all the functions
+  ExpressionDAG DAG;
+  bool Transformed = false;
   for (auto Fiter = M.begin(); Fiter != M.end(); ++Fiter)
-    if (runOnFunction(*Fiter, runOnBasicBlockStrengthReduction))
-      return PreservedAnalyses::none();
-  
+    if (runOnFunction(*Fiter, DAG, runOnBasicBlockStrengthReduction))
+      Transformed = true;
+
+  if (Transformed)
+    return PreservedAnalyses::none();
   return PreservedAnalyses::all();
 }
 
 PreservedAnalyses AlgebraicIdentity::run(Module &M, ModuleAnalysisManager &AM) {
+  // The arena of the DAG is reused by all the functions
+  ExpressionDAG DAG;
+  bool Transformed = false;
   for (auto Fiter = M.begin(); Fiter != M.end(); ++Fiter)
-    if (runOnFunction(*Fiter, runOnBasicBlockAlgebraicIdentity))
-      return PreservedAnalyses::none();
-  
+    if (runOnFunction(*Fiter, DAG, runOnBasicBlockAlgebraicIdentity))
+      Transformed = true;
+
+  if (Transformed)
+    return PreservedAnalyses::none();
   return PreservedAnalyses::all();
 }
+
+// The three optimizations on one function, for the function pipelines of -O2/-O3
+PreservedAnalyses LocalOpts::run(Function &F, FunctionAnalysisManager &AM) {
+  ExpressionDAG DAG;
+  bool Transformed = runOnFunction(F, DAG, runOnBasicBlockAlgebraicIdentity);
+  Transformed |= runOnFunction(F, DAG, runOnBasicBlockStrengthReduction);
+  Transformed |= runOnFunction(F, DAG, runOnBasicBlockMultiInstructionOptimization);
+
+  if (!Transformed)
+    return PreservedAnalyses::all();
+
+  // Instructions are only replaced or erased, the CFG is untouched
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
@@ -2,7 +2,74 @@
 #define LLVM_TRANSFORMS_LOCALOPTS_H
 #include "llvm/IR/PassManager.h"
 #include <llvm/IR/Constants.h>
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Transforms/Utils/SparseConstantPropagation.h"
+#include <tuple>
 namespace llvm {
+/*Nodo del DAG delle espressioni di una funzione: una foglia (valore che non è
+un operatore binario o costante) o un operatore binario sui nodi degli
+operandi, in ordine canonico se commutativo. Istruzioni con lo stesso
+operatore e gli stessi flag (nsw, nuw, exact, fast-math) sugli stessi nodi
+condividono il nodo, quindi le proprietà delle costanti e i risultati delle
+regole si calcolano una volta sola*/
+struct ExpressionNode {
+  // Result of a rule, computed on first use: the node the rule matched, nullptr if it does not apply
+  struct Match {
+    bool computed = false;
+    const ExpressionNode * node = nullptr;
+  };
+
+  unsigned id = 0;
+  // 0 for leaves
+  unsigned opcode = 0;
+  ExpressionNode * operands[2] = {nullptr, nullptr};
+  // Leaf of the constant of the value (itself for constants), nullptr if not constant
+  const ExpressionNode * constant = nullptr;
+
+  // Integer constant leaves only: value + adjust == 2^shift, adjust in 0, 1, -1 in this order; shift -1 if none
+  ConstantInt * value = nullptr;
+  int shift = -1;
+  int adjust = 0;
+
+  // Floating point constant leaves only: 1 / fpValue if normal, exact or only with arcp
+  ConstantFP * fpValue = nullptr;
+  ConstantFP * reciprocal = nullptr;
+  bool exactReciprocal = false;
+
+  Match cancellation, reduction, identity;
+  // fmul with a reduction: the product of power times the reduction node, with multiplies fmul
+  unsigned power = 0;
+  unsigned multiplies = 0;
+};
+
+struct ExpressionDAG {
+  SparseConstantPropagationInfo constants;
+  SpecificBumpPtrAllocator<ExpressionNode> allocator;
+  DenseMap<const Value *, ExpressionNode *> nodes;
+  // Hash-consing: leaves by value (by constant for constants), operators by opcode, flags and operand nodes
+  DenseMap<const Value *, ExpressionNode *> leaves;
+  DenseMap<std::tuple<unsigned, unsigned, const ExpressionNode *, const ExpressionNode *>, ExpressionNode *> operators;
+  unsigned size = 0;
+
+  // Starts the DAG of another function, keeping the memory of the arena and of the maps
+  void reset(SparseConstantPropagationInfo && functionConstants);
+  // Built on first use, together with the nodes of the operands
+  ExpressionNode * getNode(Value * V);
+  // Drops an instruction about to be erased, also from the constants
+  void forget(const Instruction * I);
+
+private:
+  ExpressionNode * getLeaf(Value * V, ConstantInt * Constant);
+  ExpressionNode * getOperator(unsigned Opcode, unsigned Flags, ExpressionNode * Op0, ExpressionNode * Op1, ConstantInt * Constant);
+};
+
 class MultiInstructionOptimization : public PassInfoMixin<MultiInstructionOptimization> {
 public:
 PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
@@ -18,5 +85,10 @@ public:
 PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
 };
 
+class LocalOpts : public PassInfoMixin<LocalOpts> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
 } // namespace llvm
 #endif // LLVM_TRANSFORMS_LOCALOPTS_H
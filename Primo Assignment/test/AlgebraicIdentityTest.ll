@@ -22,3 +22,14 @@ define dso_local i32 @foo(i32 noundef %0, i32 noundef %1) #0 {
   ret i32 %18
 }
 
+
+define dso_local double @fast(double noundef %0) #0 {
+  %2 = fmul double %0, 1.000000e+00
+  %3 = fadd double %2, -0.000000e+00
+  %4 = fadd double %3, 0.000000e+00
+  %5 = fadd nsz double %4, 0.000000e+00
+  %6 = fsub double %5, 0.000000e+00
+  %7 = fsub double %6, -0.000000e+00
+  %8 = fdiv double %7, 1.000000e+00
+  ret double %8
+}
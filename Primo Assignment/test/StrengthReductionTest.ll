@@ -20,3 +20,27 @@ define dso_local i32 @foo(i32 noundef %0, i32 noundef %1) #0 {
   ret i32 %20
 }
 
+
+define dso_local i32 @flags(i32 noundef %0) #0 {
+  %2 = mul nuw nsw i32 %0, 8
+  %3 = mul nuw nsw i32 %2, 9
+  %4 = mul nuw nsw i32 %3, 7
+  %5 = mul nsw i32 %4, -2147483648
+  %6 = sdiv exact i32 %5, 4
+  %7 = sdiv i32 %6, -2147483648
+  ret i32 %7
+}
+
+
+define dso_local double @fast(double noundef %0) #0 {
+  %2 = fdiv double %0, 4.000000e+00
+  %3 = fdiv double %2, 3.000000e+00
+  %4 = fdiv arcp double %3, 3.000000e+00
+  %5 = fmul reassoc double %0, %0
+  %6 = fmul reassoc double %5, %0
+  %7 = fmul reassoc double %6, %0
+  %8 = fmul reassoc double %7, %0
+  %9 = fmul reassoc double %8, %0
+  %10 = fadd double %4, %9
+  ret double %10
+}
@@ -0,0 +1,274 @@
+// Benchmark driver of the test kernels, linked by Bench.sh with the object
+// of a kernel compiled with and without a pass:
+//   ./bench <kernel> <variant> <N> <warmup> <repetitions> <out.csv>
+// appends to out.csv one row with the median/min time of a call and the
+// hardware counters (per call, -1 if perf_event is not available).
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Signature of foo in the kernel, chosen by Bench.sh
+#define KERNEL_ARRAYS4 1
+#define KERNEL_ARRAYS3 2
+#define KERNEL_SCALAR 3
+#define KERNEL_ARRAYS2D 4
+#define KERNEL_GLOBAL2D 5
+#ifndef KERNEL_ARGS
+#define KERNEL_ARGS KERNEL_ARRAYS4
+#endif
+
+#if KERNEL_ARGS == KERNEL_ARRAYS4
+void foo(int a[], int b[], int c[], int d[], int N);
+#elif KERNEL_ARGS == KERNEL_ARRAYS3
+void foo(int a[], int b[], int c[], int n);
+#elif KERNEL_ARGS == KERNEL_SCALAR
+void foo(int c, int z);
+#elif KERNEL_ARGS == KERNEL_ARRAYS2D
+void foo(int **a, int **b, int **c, int **d, int N, ...);
+#elif KERNEL_ARGS == KERNEL_GLOBAL2D
+// The arrays of the kernel (compiled with N = KERNEL_DIM); its functions are
+// declared and listed in KERNEL_CALLS by the kernel.h of Bench.sh
+extern double A[KERNEL_DIM][KERNEL_DIM], B[KERNEL_DIM][KERNEL_DIM];
+#endif
+
+// Kernels read a few elements past N (a[i + 5])
+#define PADDING 64
+
+enum { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, COUNTERS };
+static const char *counterNames[COUNTERS] = {"cycles", "instructions", "l1d_misses", "llc_misses"};
+static int counterFds[COUNTERS];
+
+static void openCounters(void) {
+  for (int i = 0; i < COUNTERS; i++)
+    counterFds[i] = -1;
+#ifdef __linux__
+  struct { uint32_t type; uint64_t config; } events[COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  };
+  for (int i = 0; i < COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counterFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+}
+
+static void setCounters(int enable) {
+#ifdef __linux__
+  for (int i = 0; i < COUNTERS; i++) {
+    if (counterFds[i] < 0)
+      continue;
+    if (enable) {
+      ioctl(counterFds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+    } else {
+      ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+#endif
+}
+
+static long long readCounter(int i) {
+  long long value;
+  if (counterFds[i] < 0 || read(counterFds[i], &value, sizeof(value)) != sizeof(value))
+    return -1;
+  return value;
+}
+
+static uint64_t nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t nowTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return nowNs();
+#endif
+}
+
+static int compareU64(const void *x, const void *y) {
+  uint64_t a = *(const uint64_t *)x, b = *(const uint64_t *)y;
+  return (a > b) - (a < b);
+}
+
+#if KERNEL_ARGS == KERNEL_ARRAYS2D
+static int **a, **b, **c, **d;
+
+// size x size matrix as an array of rows, as the int** of Level2For.c
+static int **allocateRows(size_t size) {
+  int **rows = malloc(size * sizeof(int *));
+  for (size_t i = 0; rows && i < size; i++)
+    if (!(rows[i] = malloc(size * sizeof(int))))
+      return NULL;
+  return rows;
+}
+
+static void allocate(int N) {
+  size_t size = (size_t)N + PADDING;
+  a = allocateRows(size);
+  b = allocateRows(size);
+  c = allocateRows(size);
+  d = allocateRows(size);
+  if (!a || !b || !c || !d) {
+    fprintf(stderr, "N = %d: memoria insufficiente\n", N);
+    exit(1);
+  }
+  // b is a divisor (1 / b[i][j]): never zero
+  for (size_t i = 0; i < size; i++)
+    for (size_t j = 0; j < size; j++) {
+      a[i][j] = (int)((i + j) % 13);
+      b[i][j] = (int)((i * j) % 3) + 1;
+      c[i][j] = (int)((i + 2 * j) % 7) - 3;
+      d[i][j] = 0;
+    }
+}
+#elif KERNEL_ARGS == KERNEL_GLOBAL2D
+static void allocate(int N) {
+  if (N != KERNEL_DIM) {
+    fprintf(stderr, "N = %d: il kernel è compilato con N = %d\n", N, KERNEL_DIM);
+    exit(1);
+  }
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) {
+      A[i][j] = (double)((i + 3 * j) % 13);
+      B[i][j] = 0.0;
+    }
+}
+#else
+static int *a, *b, *c, *d;
+
+static void allocate(int N) {
+  size_t size = (size_t)N + PADDING;
+  a = malloc(size * sizeof(int));
+  b = malloc(size * sizeof(int));
+  c = malloc(size * sizeof(int));
+  d = malloc(size * sizeof(int));
+  if (!a || !b || !c || !d) {
+    fprintf(stderr, "N = %d: memoria insufficiente\n", N);
+    exit(1);
+  }
+  // b is a divisor (1 / b[i]): never zero
+  for (size_t i = 0; i < size; i++) {
+    a[i] = (int)(i % 13);
+    b[i] = (int)(i % 3) + 1;
+    c[i] = (int)(i % 7) - 3;
+    d[i] = 0;
+  }
+}
+#endif
+
+static void runKernel(int N) {
+#if KERNEL_ARGS == KERNEL_ARRAYS4
+  foo(a, b, c, d, N);
+#elif KERNEL_ARGS == KERNEL_ARRAYS3
+  foo(a, b, c, N);
+#elif KERNEL_ARGS == KERNEL_SCALAR
+  // The loop of LICM.c counts z up to 10
+  foo(0, 10 - N);
+#elif KERNEL_ARGS == KERNEL_ARRAYS2D
+  foo(a, b, c, d, N);
+#elif KERNEL_ARGS == KERNEL_GLOBAL2D
+  KERNEL_CALLS
+#endif
+}
+
+// Checksum of the outputs, to compare the two versions of the kernel: unsigned, wraps without overflow
+static uint64_t checksum(int N) {
+  uint64_t sum = 0;
+#if KERNEL_ARGS == KERNEL_ARRAYS2D
+  for (int i = 0; i < N + PADDING; i++)
+    for (int j = 0; j < N + PADDING; j++)
+      sum = sum * 31 + (uint64_t)a[i][j] + 7 * (uint64_t)c[i][j] + 13 * (uint64_t)d[i][j];
+#elif KERNEL_ARGS == KERNEL_GLOBAL2D
+  // The passes only reorder the iterations: the values are bit-identical
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      sum = sum * 31 + (uint64_t)(long long)(A[i][j] * 1024) + 7 * (uint64_t)(long long)(B[i][j] * 1024);
+#else
+  for (int i = 0; i < N + PADDING; i++)
+    sum = sum * 31 + (uint64_t)a[i] + 7 * (uint64_t)c[i] + 13 * (uint64_t)d[i];
+#endif
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 7) {
+    fprintf(stderr, "Uso: %s <kernel> <variant> <N> <warmup> <repetitions> <out.csv>\n", argv[0]);
+    return 1;
+  }
+  const char *kernel = argv[1], *variant = argv[2];
+  int N = atoi(argv[3]), warmup = atoi(argv[4]), repetitions = atoi(argv[5]);
+  if (N <= 0 || warmup < 0 || repetitions <= 0) {
+    fprintf(stderr, "N e repetitions devono essere positivi\n");
+    return 1;
+  }
+
+  allocate(N);
+  openCounters();
+  for (int r = 0; r < warmup; r++)
+    runKernel(N);
+
+  uint64_t *ns = malloc(repetitions * sizeof(uint64_t));
+  uint64_t *ticks = malloc(repetitions * sizeof(uint64_t));
+  setCounters(1);
+  for (int r = 0; r < repetitions; r++) {
+    uint64_t startNs = nowNs(), startTicks = nowTicks();
+    runKernel(N);
+    ticks[r] = nowTicks() - startTicks;
+    ns[r] = nowNs() - startNs;
+  }
+  setCounters(0);
+  qsort(ns, repetitions, sizeof(uint64_t), compareU64);
+  qsort(ticks, repetitions, sizeof(uint64_t), compareU64);
+
+  FILE *out = fopen(argv[6], "a");
+  if (!out) {
+    perror(argv[6]);
+    return 1;
+  }
+  fseek(out, 0, SEEK_END);
+  if (ftell(out) == 0) {
+    fprintf(out, "kernel,variant,N,repetitions,median_ns,min_ns,median_ticks");
+    for (int i = 0; i < COUNTERS; i++)
+      fprintf(out, ",%s", counterNames[i]);
+    fprintf(out, ",checksum\n");
+  }
+  fprintf(out, "%s,%s,%d,%d,%llu,%llu,%llu", kernel, variant, N, repetitions,
+          (unsigned long long)ns[repetitions / 2], (unsigned long long)ns[0],
+          (unsigned long long)ticks[repetitions / 2]);
+  for (int i = 0; i < COUNTERS; i++) {
+    long long value = readCounter(i);
+    fprintf(out, ",%lld", value < 0 ? -1 : value / repetitions);
+  }
+  uint64_t sum = checksum(N);
+  fprintf(out, ",%" PRIu64 "\n", sum);
+  fclose(out);
+  // Compared by Bench.sh between the two versions
+  printf("checksum %" PRIu64 "\n", sum);
+  return 0;
+}
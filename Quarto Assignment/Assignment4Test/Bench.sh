@@ -0,0 +1,124 @@
+#!/bin/bash
+# ./Bench.sh <kernel> [pass] [prePasses] [sizes]
+# e.g. ./Bench.sh Level1For loopfusionpass mem2reg "1000 100000 10000000"
+#      ./Bench.sh "../../Terzo Assignment/Assignment3Test/LICM" loopwalk
+#      ./Bench.sh Level2Tiling looptilingpass mem2reg "256 512 1024"
+#      ./Bench.sh Level2Jam loopjampass "mem2reg,loop-simplify,loop(loop-rotate)" "258 1026"
+# The kernel is compiled to IR, optimized with prePasses (base) and then with
+# pass; both versions go through the same backend (llc -O2) and are linked
+# with Bench.c. Results: $RESULTS.csv (one row per version and N) and
+# $RESULTS.json (speedup of pass over base for each N).
+kernel="$1";
+pass="${2:-loopfusionpass}";
+prePasses="${3:-mem2reg}";
+sizes="$4";
+warmup="${WARMUP:-3}";
+repetitions="${REPETITIONS:-15}";
+results="${RESULTS:-bench}";
+benchDir="$(cd "$(dirname "$0")" && pwd)";
+# PASS_PLUGIN=<build>/CompilatoriPasses.so uses the stock opt instead of ../../BUILD
+if [ -n "$PASS_PLUGIN" ]
+then
+    opt="opt -load-pass-plugin $PASS_PLUGIN";
+else
+    opt="$benchDir/../../BUILD/bin/opt";
+fi
+
+# Signature of foo, see KERNEL_ARGS in Bench.c
+if grep -qE "foo\(int a\[(restrict)?\], int b\[(restrict)?\], int c\[(restrict)?\], int d\[(restrict)?\], int N\)" "$kernel.c"
+then
+    kernelArgs="KERNEL_ARRAYS4";
+elif grep -qE "foo\(int a\[(restrict)?\], int b\[(restrict)?\], int c\[(restrict)?\], int n\)" "$kernel.c"
+then
+    kernelArgs="KERNEL_ARRAYS3";
+elif grep -q "foo(int c, int z)" "$kernel.c"
+then
+    kernelArgs="KERNEL_SCALAR";
+elif grep -qE "foo\(int \*\*a, int \*\*b, int \*\*c, int \*\*d, int N" "$kernel.c"
+then
+    kernelArgs="KERNEL_ARRAYS2D";
+elif grep -q "^double A\[N\]\[N\], B\[N\]\[N\];" "$kernel.c"
+then
+    # No foo: Bench.c runs in order the void functions of the kernel on its A and B
+    kernelArgs="KERNEL_GLOBAL2D";
+    kernelFunctions="$(sed -nE 's/^void ([A-Za-z_][A-Za-z0-9_]*)\(\)\{?$/\1/p' "$kernel.c")";
+else
+    echo "Error! $kernel.c: signature of foo not supported by Bench.c";
+    exit 1;
+fi
+
+# The 2-D kernels touch N * N elements
+if [ -z "$sizes" ]
+then
+    case "$kernelArgs" in
+        KERNEL_ARRAYS2D|KERNEL_GLOBAL2D) sizes="256 512 1024";;
+        *) sizes="1000 100000 10000000";;
+    esac
+fi
+
+workDir="$(mktemp -d)";
+trap 'rm -rf "$workDir"' EXIT;
+# build <dir> <kernel flags> <Bench.c flags>: base and pass versions of the kernel in <dir>
+build() {
+    mkdir -p "$1";
+    # optnone would make opt skip the functions; the main of the kernel is not the benchmark's
+    clang -O0 -Xclang -disable-O0-optnone -S -emit-llvm -Dmain=kernelMain $2 -c "$kernel.c" -o "$1/kernel.ll" || exit 1;
+    $opt -p "$prePasses" "$1/kernel.ll" -o "$1/base.bc" || exit 1;
+    $opt -p "$pass" "$1/base.bc" -o "$1/pass.bc" > "$1/pass.log" || exit 1;
+    for variant in base pass
+    do
+        llc -O2 -relocation-model=pic -filetype=obj "$1/$variant.bc" -o "$1/$variant.o" || exit 1;
+        clang -O2 -D KERNEL_ARGS=$kernelArgs $3 -include "$workDir/kernel.h" "$benchDir/Bench.c" "$1/$variant.o" -o "$1/$variant" || exit 1;
+    done
+}
+
+# Declarations and calls of the functions of a KERNEL_GLOBAL2D kernel
+: > "$workDir/kernel.h";
+if [ -n "$kernelFunctions" ]
+then
+    for function in $kernelFunctions
+    do
+        echo "void $function(void);" >> "$workDir/kernel.h";
+    done
+    echo "#define KERNEL_CALLS $(for function in $kernelFunctions; do printf '%s(); ' "$function"; done)" >> "$workDir/kernel.h";
+else
+    build "$workDir/all" "" "";
+fi
+
+name="$(basename "$kernel")";
+for N in $sizes
+do
+    # The arrays of a KERNEL_GLOBAL2D kernel are N x N: one build per N
+    binDir="$workDir/all";
+    if [ -n "$kernelFunctions" ]
+    then
+        binDir="$workDir/$N";
+        build "$binDir" "-DN=$N" "-DKERNEL_DIM=$N";
+    fi
+    for variant in base pass
+    do
+        # The output of the kernel (printf of LICM.c) and the checksum are compared, not timed on the terminal
+        "$binDir/$variant" "$name" "$variant" $N $warmup $repetitions "$results.csv" > "$workDir/$variant.$N.out" || exit 1;
+    done
+    if ! cmp -s "$workDir/base.$N.out" "$workDir/pass.$N.out"
+    then
+        echo "Error! $name, N = $N: the output of $pass differs";
+        exit 1;
+    fi
+done
+
+# Speedup = median time of base / median time of pass, for the rows just added
+awk -F, -v name="$name" -v pass="$pass" -v sizes="$sizes" '
+    $1 == name { time[$2, $3] = $5; sum[$2, $3] = $NF; cycles[$2, $3] = $8; misses[$2, $3] = $10 }
+    END {
+        n = split(sizes, N, " ");
+        printf "[\n";
+        for (i = 1; i <= n; i++) {
+            printf "  {\"kernel\": \"%s\", \"pass\": \"%s\", \"N\": %d, \"base_ns\": %d, \"pass_ns\": %d, \"speedup\": %.3f, \"base_cycles\": %d, \"pass_cycles\": %d, \"base_l1d_misses\": %d, \"pass_l1d_misses\": %d, \"same_checksum\": %s}%s\n",
+                name, pass, N[i], time["base", N[i]], time["pass", N[i]], time["pass", N[i]] ? time["base", N[i]] / time["pass", N[i]] : 0,
+                cycles["base", N[i]], cycles["pass", N[i]], misses["base", N[i]], misses["pass", N[i]],
+                sum["base", N[i]] == sum["pass", N[i]] ? "true" : "false", i < n ? "," : "";
+        }
+        printf "]\n";
+    }' "$results.csv" > "$results.json";
+cat "$results.json";
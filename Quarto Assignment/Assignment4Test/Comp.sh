@@ -3,11 +3,20 @@ cCode="$1.c";
 intermediateCode="$1.ll";
 intermediateCodeOptimized="$1.optimized.ll";
 binaryCode="$1.optimized.bc";
+pass="${2:-loopfusionpass}";
+prePasses="${3:-mem2reg}";
+# PASS_PLUGIN=<build>/CompilatoriPasses.so uses the stock opt instead of ../../BUILD
+if [ -n "$PASS_PLUGIN" ]
+then
+    opt="opt -load-pass-plugin $PASS_PLUGIN";
+else
+    opt="../../BUILD/bin/opt";
+fi
 clang -O0 -S -emit-llvm -c $cCode -o $intermediateCode;
 vim $intermediateCode;
-../../BUILD/bin/opt -p mem2reg $intermediateCode -o $binaryCode;
+$opt -p $prePasses $intermediateCode -o $binaryCode;
 llvm-dis $binaryCode -o $intermediateCode;
-../../BUILD/bin/opt -p loopfusionpass $intermediateCode -o $binaryCode;
+$opt -p $pass $intermediateCode -o $binaryCode;
 llvm-dis $binaryCode -o $intermediateCodeOptimized;
 if [ -e "$intermediateCodeOptimized" ]
 then
@@ -0,0 +1,16 @@
+// Pointer parameters may alias: restrict lets loopfissionpass distribute the loop
+void foo(int a[restrict], int b[restrict], int c[restrict], int d[restrict], int N){
+    for (int i = 1; i < N; i++){
+        a[i] = b[i] * c[i];
+        d[i] = d[i - 1] + a[i];
+    }
+}
+
+#if 0
+int main(){
+    const int N = 10;
+    int a[N], b[N], c[N], d[N];
+    foo(a, b, c, d, N);
+    return 0;
+}
+#endif
\ No newline at end of file
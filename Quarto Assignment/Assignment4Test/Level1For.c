@@ -1,4 +1,5 @@
-void foo(int a[], int b[], int c[], int d[], int N){
+// Pointer parameters may alias: restrict lets loopfusionpass fuse the loops
+void foo(int a[restrict], int b[restrict], int c[restrict], int d[restrict], int N){
     for (int i = 0; i < N; i++){
         a[i] = 1 / b[i] * c[i];
     }
@@ -0,0 +1,23 @@
+// Pointer parameters may alias: restrict lets loopfusionpass fuse the loops
+void foo(int a[restrict], int b[restrict], int c[restrict], int d[restrict]){
+
+    for (int i = 0; i < 10; i++){
+        a[i] = b[i] * 2;
+    }
+
+    for (int i = 0; i < 10; i++){
+        c[i] = a[i] + b[i];
+    }
+
+    for (int i = 0; i < 10; i++){
+        d[i] = c[i] - a[i];
+    }
+}
+
+#if 0
+int main(){
+    int a[N], b[N], c[N], d[N];
+    foo(a, b, c, d);
+    return 0;
+}
+#endif
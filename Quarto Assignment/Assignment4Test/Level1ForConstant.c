@@ -1,4 +1,5 @@
-void foo(int a[], int b[], int c[], int d[]){
+// Pointer parameters may alias: restrict lets loopfusionpass fuse the loops
+void foo(int a[restrict], int b[restrict], int c[restrict], int d[restrict]){
 
     for (int i = 0; i < 10; i++){
         a[i] = 1 / b[i] * c[i];
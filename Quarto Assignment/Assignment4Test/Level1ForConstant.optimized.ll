@@ -3,13 +3,13 @@ source_filename = "Level1ForConstant.c"
 target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
 target triple = "x86_64-unknown-linux-gnu"
 
-define dso_local void @foo(ptr noundef %0, ptr noundef %1, ptr noundef %2, ptr noundef %3) {
+define dso_local void @foo(ptr noalias noundef %0, ptr noalias noundef %1, ptr noalias noundef %2, ptr noalias noundef %3) {
   br label %5
 
-5:                                                ; preds = %18, %4
-  %.01 = phi i32 [ 0, %4 ], [ %19, %18 ]
+5:                                                ; preds = %31, %4
+  %.01 = phi i32 [ 0, %4 ], [ %19, %31 ]
   %6 = icmp slt i32 %.01, 10
-  br i1 %6, label %7, label %30
+  br i1 %6, label %7, label %33
 
 7:                                                ; preds = %5
   %8 = sext i32 %.01 to i64
@@ -23,26 +23,33 @@ define dso_local void @foo(ptr noundef %0, ptr noundef %1, ptr noundef %2, ptr n
   %16 = sext i32 %.01 to i64
   %17 = getelementptr inbounds i32, ptr %0, i64 %16
   store i32 %15, ptr %17, align 4
-  br label %20
+  br label %18
 
-18:                                               ; preds = %20
+18:                                               ; preds = %7
   %19 = add nsw i32 %.01, 1
-  br label %5, !llvm.loop !6
+  br label %20
 
-20:                                               ; preds = %7
-  %21 = sext i32 %.01 to i64
-  %22 = getelementptr inbounds i32, ptr %0, i64 %21
-  %23 = load i32, ptr %22, align 4
-  %24 = sext i32 %.01 to i64
-  %25 = getelementptr inbounds i32, ptr %2, i64 %24
-  %26 = load i32, ptr %25, align 4
-  %27 = add nsw i32 %23, %26
-  %28 = sext i32 %.01 to i64
-  %29 = getelementptr inbounds i32, ptr %3, i64 %28
-  store i32 %27, ptr %29, align 4
-  br label %18
+20:                                               ; preds = %18
+  br label %21
+
+21:                                               ; preds = %20
+  %22 = sext i32 %.01 to i64
+  %23 = getelementptr inbounds i32, ptr %0, i64 %22
+  %24 = load i32, ptr %23, align 4
+  %25 = sext i32 %.01 to i64
+  %26 = getelementptr inbounds i32, ptr %2, i64 %25
+  %27 = load i32, ptr %26, align 4
+  %28 = add nsw i32 %24, %27
+  %29 = sext i32 %.01 to i64
+  %30 = getelementptr inbounds i32, ptr %3, i64 %29
+  store i32 %28, ptr %30, align 4
+  br label %31
+
+31:                                               ; preds = %21
+  %32 = add nsw i32 %.01, 1
+  br label %5, !llvm.loop !6
 
-30:                                               ; preds = %5
+33:                                               ; preds = %5
   ret void
 }
 
@@ -0,0 +1,22 @@
+// Pointer parameters may alias: restrict lets loopfusionpass fuse the loops
+void foo(int a[restrict], int b[restrict], int c[restrict], int n){
+
+    for (int i = 0; i < n; i++){
+        if (b[i] > 0){
+            a[i] = b[i] * 2;
+        }
+    }
+
+    for (int i = 0; i < n; i++){
+        c[i] = a[i] + b[i];
+    }
+}
+
+#if 0
+//./Comp.sh Level1ForGuarded loopfusionpass "mem2reg,loop-simplify,loop(loop-rotate)"
+int main(){
+    int a[N], b[N], c[N];
+    foo(a, b, c, N);
+    return 0;
+}
+#endif
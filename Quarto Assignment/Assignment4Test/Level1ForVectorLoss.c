@@ -0,0 +1,22 @@
+// The second loop carries a dependence through d and does not vectorize:
+// fused with the first one it would make the whole loop scalar, so the
+// profitability model of loopfusionpass keeps them apart
+void foo(int a[restrict], int b[restrict], int d[restrict], int n){
+
+    for (int i = 0; i < n; i++){
+        a[i] = b[i] * 3;
+    }
+
+    for (int i = 0; i < n; i++){
+        d[i + 1] = d[i] + a[i];
+    }
+}
+
+#if 0
+//./Comp.sh Level1ForVectorLoss loopfusionpass "mem2reg,loop-simplify,loop(loop-rotate)"
+int main(){
+    int a[N], b[N], d[N + 1];
+    foo(a, b, d, N);
+    return 0;
+}
+#endif
@@ -0,0 +1,77 @@
+; ModuleID = 'Level1ForVectorLoss.optimized.bc'
+source_filename = "Level1ForVectorLoss.c"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @foo(ptr noalias noundef %0, ptr noalias noundef %1, ptr noalias noundef %2, i32 noundef %3) {
+  %5 = icmp slt i32 0, %3
+  br i1 %5, label %.lr.ph, label %16
+
+.lr.ph:                                           ; preds = %4
+  br label %6
+
+6:                                                ; preds = %.lr.ph, %13
+  %.011 = phi i32 [ 0, %.lr.ph ], [ %14, %13 ]
+  %7 = sext i32 %.011 to i64
+  %8 = getelementptr inbounds i32, ptr %1, i64 %7
+  %9 = load i32, ptr %8, align 4
+  %10 = mul nsw i32 %9, 3
+  %11 = sext i32 %.011 to i64
+  %12 = getelementptr inbounds i32, ptr %0, i64 %11
+  store i32 %10, ptr %12, align 4
+  br label %13
+
+13:                                               ; preds = %6
+  %14 = add nsw i32 %.011, 1
+  %15 = icmp slt i32 %14, %3
+  br i1 %15, label %6, label %._crit_edge, !llvm.loop !6
+
+._crit_edge:                                      ; preds = %13
+  br label %16
+
+16:                                               ; preds = %._crit_edge, %4
+  %17 = icmp slt i32 0, %3
+  br i1 %17, label %.lr.ph4, label %32
+
+.lr.ph4:                                          ; preds = %16
+  br label %18
+
+18:                                               ; preds = %.lr.ph4, %29
+  %.02 = phi i32 [ 0, %.lr.ph4 ], [ %30, %29 ]
+  %19 = sext i32 %.02 to i64
+  %20 = getelementptr inbounds i32, ptr %2, i64 %19
+  %21 = load i32, ptr %20, align 4
+  %22 = sext i32 %.02 to i64
+  %23 = getelementptr inbounds i32, ptr %0, i64 %22
+  %24 = load i32, ptr %23, align 4
+  %25 = add nsw i32 %21, %24
+  %26 = add nsw i32 %.02, 1
+  %27 = sext i32 %26 to i64
+  %28 = getelementptr inbounds i32, ptr %2, i64 %27
+  store i32 %25, ptr %28, align 4
+  br label %29
+
+29:                                               ; preds = %18
+  %30 = add nsw i32 %.02, 1
+  %31 = icmp slt i32 %30, %3
+  br i1 %31, label %18, label %._crit_edge5, !llvm.loop !8
+
+._crit_edge5:                                     ; preds = %29
+  br label %32
+
+32:                                               ; preds = %._crit_edge5, %16
+  ret void
+}
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 8, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 2}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"clang version 17.0.6"}
+!6 = distinct !{!6, !7}
+!7 = !{!"llvm.loop.mustprogress"}
+!8 = distinct !{!8, !7}
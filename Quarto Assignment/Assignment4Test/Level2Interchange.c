@@ -0,0 +1,41 @@
+#ifndef N
+#define N 256
+#endif
+
+double A[N][N], B[N][N];
+
+void columnMajor(){
+
+    for (int i = 0; i < N; i++){
+        for (int j = 0; j < N; j++){
+            B[j][i] = A[j][i] + j * 3;
+        }
+    }
+}
+
+void wavefront(){
+
+    for (int i = 1; i < N; i++){
+        for (int j = 1; j < N; j++){
+            A[j][i] = (A[j - 1][i] + A[j][i - 1]) * 0.5;
+        }
+    }
+}
+
+void skewed(){
+
+    for (int i = 0; i < N - 1; i++){
+        for (int j = 1; j < N; j++){
+            A[j][i] = A[j - 1][i + 1] * 0.5;
+        }
+    }
+}
+
+#if 0
+int main(){
+    columnMajor();
+    wavefront();
+    skewed();
+    return 0;
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef N
+#define N 258
+#endif
+
+double A[N][N], B[N][N];
+
+void reuse(){
+
+    for (int i = 1; i < N - 1; i++){
+        for (int j = 1; j < N - 1; j++){
+            B[i][j] = A[i + 1][j] + A[i][j];
+        }
+    }
+}
+
+void skewed(){
+
+    for (int i = 1; i < N - 1; i++){
+        for (int j = 1; j < N - 1; j++){
+            A[i][j] = A[i - 1][j + 1] * 0.5;
+        }
+    }
+}
+
+#if 0
+//./Comp.sh Level2Jam loopjampass "mem2reg,loop-simplify,loop(loop-rotate)"
+int main(){
+    reuse();
+    skewed();
+    return 0;
+}
+#endif
@@ -0,0 +1,108 @@
+; ModuleID = 'Level2Jam.optimized.bc'
+source_filename = "Level2Jam.c"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@A = dso_local global [258 x [258 x double]] zeroinitializer, align 16
+@B = dso_local global [258 x [258 x double]] zeroinitializer, align 16
+
+define dso_local void @reuse() {
+  br label %1
+
+1:                                                ; preds = %0, %23
+  %.03 = phi i32 [ 1, %0 ], [ %24, %23 ]
+  br label %2
+
+2:                                                ; preds = %1, %19
+  %.012 = phi i32 [ 1, %1 ], [ %20, %19 ]
+  %3 = add nsw i32 %.03, 1
+  %4 = sext i32 %3 to i64
+  %5 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %4
+  %6 = sext i32 %.012 to i64
+  %7 = getelementptr inbounds [258 x double], ptr %5, i64 0, i64 %6
+  %8 = load double, ptr %7, align 8
+  %9 = sext i32 %.03 to i64
+  %10 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %9
+  %11 = sext i32 %.012 to i64
+  %12 = getelementptr inbounds [258 x double], ptr %10, i64 0, i64 %11
+  %13 = load double, ptr %12, align 8
+  %14 = fadd double %8, %13
+  %15 = sext i32 %.03 to i64
+  %16 = getelementptr inbounds [258 x [258 x double]], ptr @B, i64 0, i64 %15
+  %17 = sext i32 %.012 to i64
+  %18 = getelementptr inbounds [258 x double], ptr %16, i64 0, i64 %17
+  store double %14, ptr %18, align 8
+  br label %19
+
+19:                                               ; preds = %2
+  %20 = add nsw i32 %.012, 1
+  %21 = icmp slt i32 %20, 257
+  br i1 %21, label %2, label %22, !llvm.loop !6
+
+22:                                               ; preds = %19
+  br label %23
+
+23:                                               ; preds = %22
+  %24 = add nsw i32 %.03, 1
+  %25 = icmp slt i32 %24, 257
+  br i1 %25, label %1, label %26, !llvm.loop !8
+
+26:                                               ; preds = %23
+  ret void
+}
+
+define dso_local void @skewed() {
+  br label %1
+
+1:                                                ; preds = %0, %19
+  %.03 = phi i32 [ 1, %0 ], [ %20, %19 ]
+  br label %2
+
+2:                                                ; preds = %1, %15
+  %.012 = phi i32 [ 1, %1 ], [ %16, %15 ]
+  %3 = sub nsw i32 %.03, 1
+  %4 = add nsw i32 %.012, 1
+  %5 = sext i32 %3 to i64
+  %6 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %5
+  %7 = sext i32 %4 to i64
+  %8 = getelementptr inbounds [258 x double], ptr %6, i64 0, i64 %7
+  %9 = load double, ptr %8, align 8
+  %10 = fmul double %9, 5.000000e-01
+  %11 = sext i32 %.03 to i64
+  %12 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %11
+  %13 = sext i32 %.012 to i64
+  %14 = getelementptr inbounds [258 x double], ptr %12, i64 0, i64 %13
+  store double %10, ptr %14, align 8
+  br label %15
+
+15:                                               ; preds = %2
+  %16 = add nsw i32 %.012, 1
+  %17 = icmp slt i32 %16, 257
+  br i1 %17, label %2, label %18, !llvm.loop !9
+
+18:                                               ; preds = %15
+  br label %19
+
+19:                                               ; preds = %18
+  %20 = add nsw i32 %.03, 1
+  %21 = icmp slt i32 %20, 257
+  br i1 %21, label %1, label %22, !llvm.loop !10
+
+22:                                               ; preds = %19
+  ret void
+}
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 8, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 2}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"clang version 17.0.6"}
+!6 = distinct !{!6, !7}
+!7 = !{!"llvm.loop.mustprogress"}
+!8 = distinct !{!8, !7}
+!9 = distinct !{!9, !7}
+!10 = distinct !{!10, !7}
@@ -0,0 +1,133 @@
+; ModuleID = 'Level2Jam.optimized.bc'
+source_filename = "Level2Jam.c"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@A = dso_local global [258 x [258 x double]] zeroinitializer, align 16
+@B = dso_local global [258 x [258 x double]] zeroinitializer, align 16
+
+define dso_local void @reuse() {
+  br label %1
+
+1:                                                ; preds = %43, %0
+  %.03 = phi i32 [ 1, %0 ], [ %44, %43 ]
+  %2 = add nuw nsw i32 %.03, 1
+  br label %3
+
+3:                                                ; preds = %39, %1
+  %.012 = phi i32 [ 1, %1 ], [ %21, %39 ]
+  %4 = add nuw nsw i32 %.03, 1
+  %5 = sext i32 %4 to i64
+  %6 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %5
+  %7 = sext i32 %.012 to i64
+  %8 = getelementptr inbounds [258 x double], ptr %6, i64 0, i64 %7
+  %9 = load double, ptr %8, align 8
+  %10 = sext i32 %.03 to i64
+  %11 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %10
+  %12 = sext i32 %.012 to i64
+  %13 = getelementptr inbounds [258 x double], ptr %11, i64 0, i64 %12
+  %14 = load double, ptr %13, align 8
+  %15 = fadd double %9, %14
+  %16 = sext i32 %.03 to i64
+  %17 = getelementptr inbounds [258 x [258 x double]], ptr @B, i64 0, i64 %16
+  %18 = sext i32 %.012 to i64
+  %19 = getelementptr inbounds [258 x double], ptr %17, i64 0, i64 %18
+  store double %15, ptr %19, align 8
+  br label %20
+
+20:                                               ; preds = %3
+  %21 = add nsw i32 %.012, 1
+  br label %22
+
+22:                                               ; preds = %20
+  %23 = add nuw nsw i32 %2, 1
+  %24 = sext i32 %23 to i64
+  %25 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %24
+  %26 = sext i32 %.012 to i64
+  %27 = getelementptr inbounds [258 x double], ptr %25, i64 0, i64 %26
+  %28 = load double, ptr %27, align 8
+  %29 = sext i32 %2 to i64
+  %30 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %29
+  %31 = sext i32 %.012 to i64
+  %32 = getelementptr inbounds [258 x double], ptr %30, i64 0, i64 %31
+  %33 = load double, ptr %32, align 8
+  %34 = fadd double %28, %33
+  %35 = sext i32 %2 to i64
+  %36 = getelementptr inbounds [258 x [258 x double]], ptr @B, i64 0, i64 %35
+  %37 = sext i32 %.012 to i64
+  %38 = getelementptr inbounds [258 x double], ptr %36, i64 0, i64 %37
+  store double %34, ptr %38, align 8
+  br label %39
+
+39:                                               ; preds = %22
+  %40 = add nsw i32 %.012, 1
+  %41 = icmp slt i32 %40, 257
+  br i1 %41, label %3, label %42, !llvm.loop !6
+
+42:                                               ; preds = %39
+  br label %43
+
+43:                                               ; preds = %42
+  %44 = add nuw nsw i32 %2, 1
+  %45 = icmp ult i32 %44, 257
+  br i1 %45, label %1, label %46, !llvm.loop !8
+
+46:                                               ; preds = %43
+  ret void
+}
+
+define dso_local void @skewed() {
+  br label %1
+
+1:                                                ; preds = %19, %0
+  %.03 = phi i32 [ 1, %0 ], [ %20, %19 ]
+  br label %2
+
+2:                                                ; preds = %15, %1
+  %.012 = phi i32 [ 1, %1 ], [ %16, %15 ]
+  %3 = sub nsw i32 %.03, 1
+  %4 = add nsw i32 %.012, 1
+  %5 = sext i32 %3 to i64
+  %6 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %5
+  %7 = sext i32 %4 to i64
+  %8 = getelementptr inbounds [258 x double], ptr %6, i64 0, i64 %7
+  %9 = load double, ptr %8, align 8
+  %10 = fmul double %9, 5.000000e-01
+  %11 = sext i32 %.03 to i64
+  %12 = getelementptr inbounds [258 x [258 x double]], ptr @A, i64 0, i64 %11
+  %13 = sext i32 %.012 to i64
+  %14 = getelementptr inbounds [258 x double], ptr %12, i64 0, i64 %13
+  store double %10, ptr %14, align 8
+  br label %15
+
+15:                                               ; preds = %2
+  %16 = add nsw i32 %.012, 1
+  %17 = icmp slt i32 %16, 257
+  br i1 %17, label %2, label %18, !llvm.loop !9
+
+18:                                               ; preds = %15
+  br label %19
+
+19:                                               ; preds = %18
+  %20 = add nsw i32 %.03, 1
+  %21 = icmp slt i32 %20, 257
+  br i1 %21, label %1, label %22, !llvm.loop !10
+
+22:                                               ; preds = %19
+  ret void
+}
+
+!llvm.module.flags = !{!0, !1, !2, !3, !4}
+!llvm.ident = !{!5}
+
+!0 = !{i32 1, !"wchar_size", i32 4}
+!1 = !{i32 8, !"PIC Level", i32 2}
+!2 = !{i32 7, !"PIE Level", i32 2}
+!3 = !{i32 7, !"uwtable", i32 2}
+!4 = !{i32 7, !"frame-pointer", i32 2}
+!5 = !{!"clang version 17.0.6"}
+!6 = distinct !{!6, !7}
+!7 = !{!"llvm.loop.mustprogress"}
+!8 = distinct !{!8, !7}
+!9 = distinct !{!9, !7}
+!10 = distinct !{!10, !7}
@@ -0,0 +1,41 @@
+#ifndef N
+#define N 512
+#endif
+
+double A[N][N], B[N][N];
+
+void transpose(){
+
+    for (int i = 0; i < N; i++){
+        for (int j = 0; j < N; j++){
+            B[i][j] = A[j][i] + 1.0;
+        }
+    }
+}
+
+void wavefront(){
+
+    for (int i = 1; i < N; i++){
+        for (int j = 1; j < N; j++){
+            A[i][j] = (A[i - 1][j] + A[i][j - 1]) * 0.5;
+        }
+    }
+}
+
+void skewed(){
+
+    for (int i = 1; i < N; i++){
+        for (int j = 0; j < N - 1; j++){
+            A[i][j] = A[i - 1][j + 1] * 0.5;
+        }
+    }
+}
+
+#if 0
+int main(){
+    transpose();
+    wavefront();
+    skewed();
+    return 0;
+}
+#endif
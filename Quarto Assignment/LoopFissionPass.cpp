@@ -0,0 +1,547 @@
+//===-- LoopFissionPass.cpp - Example Transformations --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/LoopFissionPass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loopfissionpass"
+
+static cl::opt<unsigned> FissionMaxArrays(
+    "loopfissionpass-max-arrays", cl::init(4), cl::Hidden,
+    cl::desc("Maximum number of distinct arrays a distributed loop may touch before it is split for the cache"));
+
+/*Partizione del corpo del loop: le istruzioni che verranno eseguite
+nello stesso loop dopo la fissione*/
+struct FissionPartition {
+  // Instructions that cannot be duplicated (memory, side effects, recurrences)
+  SmallVector<Instruction *> seeds;
+  // Seeds plus the duplicable instructions they need
+  SmallPtrSet<Instruction *, 16> used;
+  SmallPtrSet<const Value *, 8> bases;
+  bool recurrence = false;
+};
+
+/*Controlla che il loop abbia la forma che la fissione sa gestire:
+1. Loop più interno in forma LoopSimplify
+2. Un solo blocco di uscita
+3. Numero di iterazioni calcolabile*/
+bool checkFissionCandidate(Loop * loop, ScalarEvolution & SE){
+  if(!loop->isInnermost() || !loop->isLoopSimplifyForm()){
+    return false;
+  }
+
+  if(!loop->getExitBlock() || !loop->getExitingBlock()){
+    return false;
+  }
+
+  return !isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(loop));
+}
+
+/*Raccoglie le istruzioni di controllo del loop (variabile di induzione, confronto,
+salti), che vengono replicate in ogni loop generato. Fallisce se il controllo
+del loop accede alla memoria*/
+bool collectControlInstructions(Loop * loop, SmallPtrSetImpl<Instruction *> & control){
+  SmallVector<Instruction *> worklist;
+  for(BasicBlock * BB : loop->blocks()){
+    worklist.push_back(BB->getTerminator());
+  }
+
+  while(!worklist.empty()){
+    Instruction * I = worklist.pop_back_val();
+    if(!control.insert(I).second){
+      continue;
+    }
+
+    if(!I->isTerminator() && (I->mayReadOrWriteMemory() || I->mayHaveSideEffects())){
+      return false;
+    }
+
+    for(Value * operand : I->operands()){
+      Instruction * def = dyn_cast<Instruction>(operand);
+      if(def && loop->contains(def)){
+        worklist.push_back(def);
+      }
+    }
+  }
+
+  return true;
+}
+
+/*Grafo delle dipendenze del corpo del loop: un nodo per istruzione,
+archi def-use e archi di dipendenza in memoria*/
+struct FissionGraph {
+  SmallVector<Instruction *> nodes;
+  DenseMap<Instruction *, unsigned> index;
+  SmallVector<SmallVector<unsigned, 4>> edges;
+  SmallVector<bool> memoryDep;
+  SmallVector<bool> liveOut;
+};
+
+void addFissionEdge(FissionGraph & G, unsigned from, unsigned to){
+  G.edges[from].push_back(to);
+}
+
+/*Costruisce il grafo:
+1. Arco def-use da ogni operando del corpo all'istruzione che lo usa
+2. Per ogni coppia di accessi in memoria (almeno uno in scrittura) un arco in
+ordine di programma; se la distanza è negativa (anche per le dipendenze di
+output) la dipendenza torna indietro nelle iterazioni e si aggiunge anche
+l'arco opposto, creando un ciclo*/
+void buildFissionGraph(Loop * loop, LoopInfo & LI, SmallPtrSetImpl<Instruction *> & control, DependenceInfo & DI, ScalarEvolution & SE, FissionGraph & G){
+  LoopBlocksDFS DFS(loop);
+  DFS.perform(&LI);
+
+  for(auto BB = DFS.beginRPO(); BB != DFS.endRPO(); ++BB){
+    for(Instruction & I : **BB){
+      if(control.count(&I)){
+        continue;
+      }
+      G.index[&I] = G.nodes.size();
+      G.nodes.push_back(&I);
+    }
+  }
+
+  G.edges.resize(G.nodes.size());
+  G.memoryDep.resize(G.nodes.size(), false);
+  G.liveOut.resize(G.nodes.size(), false);
+
+  for(unsigned i = 0; i < G.nodes.size(); ++i){
+    Instruction * I = G.nodes[i];
+    for(Value * operand : I->operands()){
+      Instruction * def = dyn_cast<Instruction>(operand);
+      if(def && G.index.count(def)){
+        addFissionEdge(G, G.index[def], i);
+      }
+    }
+
+    for(User * U : I->users()){
+      Instruction * user = dyn_cast<Instruction>(U);
+      if(user && !loop->contains(user)){
+        G.liveOut[i] = true;
+      }
+    }
+  }
+
+  for(unsigned i = 0; i < G.nodes.size(); ++i){
+    Instruction * I0 = G.nodes[i];
+    if(!I0->mayReadOrWriteMemory()){
+      continue;
+    }
+
+    for(unsigned j = i + 1; j < G.nodes.size(); ++j){
+      Instruction * I1 = G.nodes[j];
+      if(!I1->mayReadOrWriteMemory()){
+        continue;
+      }
+
+      if(!I0->mayWriteToMemory() && !I1->mayWriteToMemory()){
+        continue;
+      }
+
+      // Calls and other opaque accesses are ordered both ways
+      bool backward = true;
+      if(isa<LoadInst>(I0) || isa<StoreInst>(I0)){
+        if(isa<LoadInst>(I1) || isa<StoreInst>(I1)){
+          // Confused dependences (arrays that may alias) are ordered both ways
+          std::unique_ptr<Dependence> dep = DI.depends(I0, I1, true);
+          if(!dep){
+            continue;
+          }
+
+          backward = dep->isConfused() || isDistanceNegative(dep, loop, loop, SE);
+        }
+      }
+
+      G.memoryDep[i] = true;
+      G.memoryDep[j] = true;
+      addFissionEdge(G, i, j);
+      if(backward){
+        LLVM_DEBUG(dbgs() << "\n -------- Dipendenza all'indietro -------- \n" << *I0 << "\n" << *I1 << "\n");
+        addFissionEdge(G, j, i);
+      }
+    }
+  }
+}
+
+/*Algoritmo di Tarjan per le componenti fortemente connesse*/
+void tarjanVisit(unsigned v, FissionGraph & G, SmallVectorImpl<int> & order, SmallVectorImpl<unsigned> & low, SmallVectorImpl<bool> & onStack, SmallVectorImpl<unsigned> & stack, SmallVectorImpl<int> & component, unsigned & counter, unsigned & numComponents){
+  order[v] = low[v] = counter++;
+  stack.push_back(v);
+  onStack[v] = true;
+
+  for(unsigned w : G.edges[v]){
+    if(order[w] < 0){
+      tarjanVisit(w, G, order, low, onStack, stack, component, counter, numComponents);
+      low[v] = std::min(low[v], low[w]);
+    }else if(onStack[w]){
+      low[v] = std::min(low[v], (unsigned) order[w]);
+    }
+  }
+
+  if(low[v] != (unsigned) order[v]){
+    return;
+  }
+
+  unsigned w;
+  do{
+    w = stack.pop_back_val();
+    onStack[w] = false;
+    component[w] = numComponents;
+  }while(w != v);
+  numComponents++;
+}
+
+unsigned computeSCCs(FissionGraph & G, SmallVectorImpl<int> & component){
+  unsigned n = G.nodes.size();
+  SmallVector<int> order(n, -1);
+  SmallVector<unsigned> low(n, 0);
+  SmallVector<bool> onStack(n, false);
+  SmallVector<unsigned> stack;
+  unsigned counter = 0;
+  unsigned numComponents = 0;
+
+  component.assign(n, -1);
+  for(unsigned v = 0; v < n; ++v){
+    if(order[v] < 0){
+      tarjanVisit(v, G, order, low, onStack, stack, component, counter, numComponents);
+    }
+  }
+  return numComponents;
+}
+
+/*Ordina topologicamente le componenti; a parità si sceglie quella che compare
+prima nel programma, così le partizioni seguono l'ordine originale*/
+void sortComponents(FissionGraph & G, SmallVectorImpl<int> & component, unsigned numComponents, SmallVectorImpl<unsigned> & sorted){
+  SmallVector<unsigned> inDegree(numComponents, 0);
+  SmallVector<unsigned> firstNode(numComponents, G.nodes.size());
+  for(unsigned v = 0; v < G.nodes.size(); ++v){
+    firstNode[component[v]] = std::min(firstNode[component[v]], v);
+    for(unsigned w : G.edges[v]){
+      if(component[v] != component[w]){
+        inDegree[component[w]]++;
+      }
+    }
+  }
+
+  SmallVector<bool> done(numComponents, false);
+  for(unsigned k = 0; k < numComponents; ++k){
+    unsigned best = numComponents;
+    for(unsigned c = 0; c < numComponents; ++c){
+      if(!done[c] && inDegree[c] == 0 && (best == numComponents || firstNode[c] < firstNode[best])){
+        best = c;
+      }
+    }
+
+    done[best] = true;
+    sorted.push_back(best);
+    for(unsigned v = 0; v < G.nodes.size(); ++v){
+      if((unsigned) component[v] != best){
+        continue;
+      }
+      for(unsigned w : G.edges[v]){
+        if((unsigned) component[w] != best){
+          inDegree[component[w]]--;
+        }
+      }
+    }
+  }
+}
+
+/*Un'istruzione può essere replicata in più loop se non ha effetti collaterali,
+non è una PHI e non partecipa a dipendenze in memoria*/
+bool isDuplicable(FissionGraph & G, unsigned v){
+  Instruction * I = G.nodes[v];
+  if(isa<PHINode>(I) || I->mayHaveSideEffects() || G.liveOut[v]){
+    return false;
+  }
+  if(I->mayReadFromMemory()){
+    return isa<LoadInst>(I) && !G.memoryDep[v];
+  }
+  return true;
+}
+
+/*Calcola le istruzioni usate da ogni partizione, risalendo gli operandi dei seed
+attraverso le istruzioni replicabili. Se una partizione ha bisogno di un seed di
+un'altra partizione restituisce la coppia da unire*/
+bool computePartitionUses(FissionGraph & G, SmallVectorImpl<FissionPartition> & partitions, DenseMap<Instruction *, unsigned> & owner, unsigned & first, unsigned & last){
+  for(unsigned p = 0; p < partitions.size(); ++p){
+    FissionPartition & P = partitions[p];
+    P.used.clear();
+    P.bases.clear();
+
+    SmallVector<Instruction *> worklist(P.seeds.begin(), P.seeds.end());
+    while(!worklist.empty()){
+      Instruction * I = worklist.pop_back_val();
+      if(!P.used.insert(I).second){
+        continue;
+      }
+
+      if(const Value * ptr = getLoadStorePointerOperand(I)){
+        P.bases.insert(getAccessBase(ptr));
+      }
+
+      for(Value * operand : I->operands()){
+        Instruction * def = dyn_cast<Instruction>(operand);
+        if(!def || !G.index.count(def)){
+          continue;
+        }
+
+        auto seed = owner.find(def);
+        if(seed != owner.end() && seed->second != p){
+          first = std::min(p, seed->second);
+          last = std::max(p, seed->second);
+          return false;
+        }
+        worklist.push_back(def);
+      }
+    }
+  }
+  return true;
+}
+
+void mergePartitions(SmallVectorImpl<FissionPartition> & partitions, DenseMap<Instruction *, unsigned> & owner, unsigned first, unsigned last){
+  FissionPartition & P = partitions[first];
+  for(unsigned q = first + 1; q <= last; ++q){
+    P.seeds.append(partitions[q].seeds.begin(), partitions[q].seeds.end());
+    P.recurrence |= partitions[q].recurrence;
+  }
+  partitions.erase(partitions.begin() + first + 1, partitions.begin() + last + 1);
+
+  owner.clear();
+  for(unsigned p = 0; p < partitions.size(); ++p){
+    for(Instruction * I : partitions[p].seeds){
+      owner[I] = p;
+    }
+  }
+}
+
+/*Costruisce le partizioni legali: una per ogni componente non replicabile,
+in ordine topologico, unendo gli intervalli di partizioni che si scambiano
+valori (non esiste ancora l'espansione scalare) e portando nell'ultima
+partizione i valori usati fuori dal loop*/
+void buildPartitions(FissionGraph & G, SmallVectorImpl<FissionPartition> & partitions){
+  SmallVector<int> component;
+  unsigned numComponents = computeSCCs(G, component);
+  SmallVector<unsigned> sorted;
+  sortComponents(G, component, numComponents, sorted);
+
+  SmallVector<SmallVector<unsigned>> members(numComponents);
+  for(unsigned v = 0; v < G.nodes.size(); ++v){
+    members[component[v]].push_back(v);
+  }
+
+  DenseMap<Instruction *, unsigned> owner;
+  bool hasLiveOut = false;
+  for(unsigned c : sorted){
+    if(members[c].size() == 1 && isDuplicable(G, members[c][0])){
+      continue;
+    }
+
+    FissionPartition P;
+    P.recurrence = members[c].size() > 1;
+    for(unsigned v : members[c]){
+      P.seeds.push_back(G.nodes[v]);
+      owner[G.nodes[v]] = partitions.size();
+      hasLiveOut |= G.liveOut[v];
+      // Calls are left to the scalar loop
+      if(isa<CallBase>(G.nodes[v]) && !isa<IntrinsicInst>(G.nodes[v])){
+        P.recurrence = true;
+      }
+    }
+    partitions.push_back(P);
+  }
+
+  // The original loop runs last and keeps the values used after it
+  if(hasLiveOut){
+    for(unsigned p = 0; p < partitions.size(); ++p){
+      bool liveOut = false;
+      for(Instruction * I : partitions[p].seeds){
+        liveOut |= G.liveOut[G.index[I]];
+      }
+      if(liveOut){
+        mergePartitions(partitions, owner, p, partitions.size() - 1);
+        break;
+      }
+    }
+  }
+
+  unsigned first;
+  unsigned last;
+  while(!computePartitionUses(G, partitions, owner, first, last)){
+    mergePartitions(partitions, owner, first, last);
+  }
+}
+
+/*Modello di costo: partizioni adiacenti vengono unite a meno che separarle
+aiuti il vettorizzatore (una ricorrenza accanto a una parte vettorizzabile)
+oppure la cache (troppi array diversi nello stesso loop)*/
+void mergeUnprofitablePartitions(SmallVectorImpl<FissionPartition> & partitions, bool vectorizable){
+  SmallVector<FissionPartition, 4> merged;
+  for(FissionPartition & P : partitions){
+    if(!merged.empty()){
+      FissionPartition & prev = merged.back();
+      bool sameKind = vectorizable || prev.recurrence == P.recurrence;
+
+      SmallPtrSet<const Value *, 8> bases(prev.bases.begin(), prev.bases.end());
+      bases.insert(P.bases.begin(), P.bases.end());
+
+      if(sameKind && bases.size() <= FissionMaxArrays){
+        prev.seeds.append(P.seeds.begin(), P.seeds.end());
+        prev.used.insert(P.used.begin(), P.used.end());
+        prev.bases.insert(P.bases.begin(), P.bases.end());
+        prev.recurrence |= P.recurrence;
+        continue;
+      }
+    }
+    merged.push_back(P);
+  }
+  partitions.swap(merged);
+}
+
+/*Elimina dalla copia del loop le istruzioni del corpo che non appartengono alla partizione*/
+void removeUnusedInstructions(FissionGraph & G, FissionPartition & P, ValueToValueMapTy * VMap){
+  SmallVector<Instruction *> toErase;
+  for(Instruction * I : G.nodes){
+    if(P.used.count(I)){
+      continue;
+    }
+    toErase.push_back(VMap ? cast<Instruction>((*VMap)[I]) : I);
+  }
+
+  for(Instruction * I : toErase){
+    I->replaceAllUsesWith(PoisonValue::get(I->getType()));
+  }
+  for(Instruction * I : toErase){
+    I->eraseFromParent();
+  }
+}
+
+/*Genera un loop per partizione: le prime vengono clonate prima del loop
+originale, che esegue l'ultima partizione*/
+void distributeLoop(Loop * loop, SmallVectorImpl<FissionPartition> & partitions, FissionGraph & G, LoopInfo & LI, DominatorTree & DT){
+  BasicBlock * preHeader = loop->getLoopPreheader();
+  if(!preHeader->getSinglePredecessor() || preHeader->size() > 1){
+    SplitBlock(preHeader, preHeader->getTerminator(), &DT, &LI);
+  }
+  preHeader = loop->getLoopPreheader();
+
+  BasicBlock * pred = preHeader->getSinglePredecessor();
+  BasicBlock * exitBlock = loop->getExitBlock();
+  BasicBlock * topPreHeader = preHeader;
+  SmallVector<Loop *> newLoops;
+
+  for(int p = partitions.size() - 2; p >= 0; --p){
+    ValueToValueMapTy VMap;
+    SmallVector<BasicBlock *, 8> blocks;
+    Loop * newLoop = cloneLoopWithPreheader(topPreHeader, pred, loop, VMap, Twine(".fission") + Twine(p), &LI, &DT, blocks);
+
+    // The cloned loop exits into the preheader of the next one
+    VMap[exitBlock] = topPreHeader;
+    remapInstructionsInBlocks(blocks, VMap);
+    removeUnusedInstructions(G, partitions[p], &VMap);
+
+    if(MDNode * loopID = loop->getLoopID()){
+      SmallVector<Metadata *, 4> MDs;
+      MDs.push_back(nullptr);
+      for(unsigned i = 1; i < loopID->getNumOperands(); ++i){
+        MDs.push_back(loopID->getOperand(i));
+      }
+      MDNode * newLoopID = MDNode::getDistinct(loopID->getContext(), MDs);
+      newLoopID->replaceOperandWith(0, newLoopID);
+      newLoop->setLoopID(newLoopID);
+    }
+
+    newLoops.insert(newLoops.begin(), newLoop);
+    topPreHeader = newLoop->getLoopPreheader();
+  }
+
+  pred->getTerminator()->replaceUsesOfWith(preHeader, topPreHeader);
+  newLoops.push_back(loop);
+
+  // Each preheader is now reached from the exit of the previous loop
+  for(unsigned i = 1; i < newLoops.size(); ++i){
+    DT.changeImmediateDominator(newLoops[i]->getLoopPreheader(), newLoops[i - 1]->getExitingBlock());
+  }
+
+  removeUnusedInstructions(G, partitions.back(), nullptr);
+}
+
+PreservedAnalyses LoopFissionPass::run(Function &F, FunctionAnalysisManager &AM) {
+
+  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+  DominatorTree &DT = AM.getResult<DominatorTreeAnalysis>(F);
+  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+  OptimizationRemarkEmitter &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+  bool Transformed = false;
+  int cont = 0;
+
+  /*La vettorizzabilità si valuta prima di modificare il codice*/
+  SmallVector<Loop *> innerLoops;
+  SmallVector<bool> vectorizable;
+  DiscardedRemarks discarded;
+  for(Loop * loop : LI.getLoopsInPreorder()){
+    if(loop->isInnermost()){
+      innerLoops.push_back(loop);
+      vectorizable.push_back(isLoopNestVectorizable(loop, F, AM, discarded));
+    }
+  }
+
+  for(unsigned l = 0; l < innerLoops.size(); ++l, cont++){
+    Loop * loop = innerLoops[l];
+    LLVM_DEBUG(dbgs() << "\n ------------------------ Loop L" << cont << " ------------------------ \n");
+
+    if(!checkFissionCandidate(loop, SE)){
+      LLVM_DEBUG(dbgs() << "\n -------- L" << cont << " NON è un candidato per la fissione -------- \n");
+      continue;
+    }
+
+    SmallPtrSet<Instruction *, 16> control;
+    if(!collectControlInstructions(loop, control)){
+      LLVM_DEBUG(dbgs() << "\n -------- Il controllo di L" << cont << " accede alla memoria -------- \n");
+      continue;
+    }
+
+    FissionGraph G;
+    buildFissionGraph(loop, LI, control, DI, SE, G);
+
+    SmallVector<FissionPartition, 4> partitions;
+    buildPartitions(G, partitions);
+    LLVM_DEBUG(dbgs() << "\n -------- L" << cont << ": " << partitions.size() << " partizioni legali -------- \n");
+
+    mergeUnprofitablePartitions(partitions, vectorizable[l]);
+    LLVM_DEBUG(dbgs() << "\n -------- L" << cont << ": " << partitions.size() << " partizioni profittevoli -------- \n");
+
+    if(partitions.size() < 2){
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotDistributed", loop->getStartLoc(), loop->getHeader())
+               << "loop is not profitable to distribute";
+      });
+      continue;
+    }
+
+    unsigned numPartitions = partitions.size();
+    distributeLoop(loop, partitions, G, LI, DT);
+    SE.forgetLoop(loop);
+    Transformed = true;
+
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Distributed", loop->getStartLoc(), loop->getHeader())
+             << "loop distributed into " << ore::NV("NumLoops", numPartitions) << " loops";
+    });
+  }
+
+  LLVM_DEBUG(dbgs() << "\n -------------------------------- END -------------------------------- \n");
+
+  if(Transformed){
+    return PreservedAnalyses::none();
+  }
+  return PreservedAnalyses::all();
+}
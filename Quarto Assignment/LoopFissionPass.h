@@ -0,0 +1,17 @@
+#ifndef LLVM_TRANSFORMS_LOOPFISSION_H
+#define LLVM_TRANSFORMS_LOOPFISSION_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/LoopFusionPass.h"
+#include "llvm/Analysis/LoopIterator.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+namespace llvm {
+
+class LoopFissionPass : public PassInfoMixin<LoopFissionPass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager  &AM);
+};
+
+} // namespace llvm
+#endif // LLVM_TRANSFORMS_LOOPFISSION_H
@@ -15,6 +15,42 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "loopfusionpass"
+
+static cl::opt<int> FusionProfitThreshold(
+    "loopfusionpass-profit-threshold", cl::init(0), cl::Hidden,
+    cl::desc("Minimum profitability score (in LoopCacheCost units) required to fuse two loops"));
+
+static cl::opt<bool> FusionKeepVectorizable(
+    "loopfusionpass-keep-vectorizable", cl::init(false), cl::Hidden,
+    cl::desc("Only fuse loops when the fused loop is predicted to vectorize with the widest VF of the two"));
+
+static cl::opt<unsigned> FusionVectorLossWeight(
+    "loopfusionpass-vector-loss-weight", cl::init(1), cl::Hidden,
+    cl::desc("Weight of the cost of a loop that loses vectorization because of fusion"));
+
+static cl::opt<unsigned> FusionMaxLoopInstructions(
+    "loopfusionpass-max-loop-instructions", cl::init(2000), cl::Hidden,
+    cl::desc("Skip candidate loops with more instructions than this (0 = no limit)"));
+
+static cl::opt<unsigned> FusionMaxDependenceQueries(
+    "loopfusionpass-max-dependence-queries", cl::init(10000), cl::Hidden,
+    cl::desc("Maximum number of dependence queries for a pair of loops, then a dependence is assumed (0 = no limit)"));
+
+static cl::opt<unsigned> FusionMaxFusions(
+    "loopfusionpass-max-fusions", cl::init(64), cl::Hidden,
+    cl::desc("Maximum number of fusions in a function (0 = no limit)"));
+
+STATISTIC(NumCandidatePairs, "Number of pairs of loops with the same trip count and control flow equivalent");
+STATISTIC(NumNotAdjacent, "Number of candidate pairs rejected because not adjacent");
+STATISTIC(NumNotFusibleShape, "Number of candidate pairs rejected because of their shape");
+STATISTIC(NumNegativeDependences, "Number of candidate pairs rejected because of a negative distance dependence");
+STATISTIC(NumNotProfitable, "Number of candidate pairs rejected as not profitable");
+STATISTIC(NumLosingVectorization, "Number of candidate pairs rejected because the fused loop vectorizes less");
+STATISTIC(NumDependenceQueries, "Number of queries to DependenceInfo");
+STATISTIC(NumFused, "Number of loops fused");
+STATISTIC(NumOverBudget, "Number of candidate pairs skipped because over a compile-time budget");
+
 /*Stampa:
 1. Il numero di Loop
 2. Il PreHeader
@@ -22,21 +58,24 @@ using namespace llvm;
 4. Successore del Loop(Exit Block)*/
 
 void myPrintLoop(Loop * loop, int cont){
-  outs() << "\n ------------------------ Loop L" << cont << " ------------------------ \n";
-  outs() << "\n" << *loop << "\n -------- PreHeader -------- \n";
+  LLVM_DEBUG(dbgs() << "\n ------------------------ Loop L" << cont << " ------------------------ \n");
+  LLVM_DEBUG(dbgs() << "\n" << *loop << "\n -------- PreHeader -------- \n");
   
   //outs() << loop << "\n";
   //outs() << *(**L).getLoopPreheader() << "\n ---------------- \n";
   
   if(loop->getLoopPreheader()){
-    outs() << *loop->getLoopPreheader() << "\n -------- Blocchi del Loop -------- \n";
+    LLVM_DEBUG(dbgs() << *loop->getLoopPreheader() << "\n -------- Blocchi del Loop -------- \n");
   }
 
   for(auto B = loop->block_begin(); B != loop->block_end(); ++B){
-    outs() << **B;
+    LLVM_DEBUG(dbgs() << **B);
   }
 
-  outs() << "\n -------- Successore(Exit Block) -------- \n" << *loop->getExitBlock();
+  // Loops with more exits have no single exit block
+  if(loop->getExitBlock()){
+    LLVM_DEBUG(dbgs() << "\n -------- Successore(Exit Block) -------- \n" << *loop->getExitBlock());
+  }
 
 }
 
@@ -44,7 +83,7 @@ void myPrintLoop(Loop * loop, int cont){
 1. Confronta il successore del L0 con il PreHeader/Guardia di L1*/
 
 bool checkLoopAdiacenti(BasicBlock * loopSuccessor0, BasicBlock * BBTopL1){
-  if(loopSuccessor0 == BBTopL1){
+  if(loopSuccessor0 && loopSuccessor0 == BBTopL1){
     return true;
   }
   return false;
@@ -54,11 +93,11 @@ bool checkLoopAdiacenti(BasicBlock * loopSuccessor0, BasicBlock * BBTopL1){
 
 BasicBlock * topLoopBB(Loop * loop/*, BasicBlock * exitBlock*/){
   if(loop->isGuarded()){
-    outs() << "\n -------- Loop è Guarded --------- \n";
+    LLVM_DEBUG(dbgs() << "\n -------- Loop è Guarded --------- \n");
     return loop->getLoopGuardBranch()->getParent();
   }
   
-  outs() << "\n -------- Loop Unguarded -------- \n";
+  LLVM_DEBUG(dbgs() << "\n -------- Loop Unguarded -------- \n");
   return loop->getLoopPreheader();
 }
 
@@ -86,8 +125,8 @@ bool checkLoopControlFlowEquivalent(DominatorTree & DT, PostDominatorTree & PDT,
       isPostDominated = true;
     }
 
-    outs() << "\n --------- L0 Domina L1? " << (isDominated? "True --------- \n" : "False --------- \n");
-    outs() << "\n --------- L1 PostDomina L0? " << (isPostDominated? "True --------- \n" : "False --------- \n");
+    LLVM_DEBUG(dbgs() << "\n --------- L0 Domina L1? " << (isDominated? "True --------- \n" : "False --------- \n"));
+    LLVM_DEBUG(dbgs() << "\n --------- L1 PostDomina L0? " << (isPostDominated? "True --------- \n" : "False --------- \n"));
   }
 
   return isDominated & isPostDominated;
@@ -110,43 +149,227 @@ bool checkLoopTripCount(ScalarEvolution & SE, Loop * L0, Loop * L1){
   
 }
 
-const SCEVAddRecExpr* convertSCEVToAddRecExpr(const SCEV* mySCEV, const Loop *L, ScalarEvolution &SE){
-  SmallPtrSet<const SCEVPredicate *, 4> Predicates;
-  return SE.convertSCEVToAddRecWithPredicates(mySCEV, L, Predicates);
+/*Estremi di un pedice sulle iterazioni dei loop in cui varia: una ricorrenza
+affine va da start a start + step * BTC (o al contrario con step negativo),
+ogni altra espressione è il proprio estremo*/
+bool getSubscriptRange(const SCEV * subscript, ScalarEvolution & SE, const SCEV *& lower, const SCEV *& upper){
+  const SCEVAddRecExpr * addRec = dyn_cast<SCEVAddRecExpr>(subscript);
+  if(!addRec){
+    lower = subscript;
+    upper = subscript;
+    return true;
+  }
+
+  const SCEV * BTC = SE.getBackedgeTakenCount(addRec->getLoop());
+  if(!addRec->isAffine() || isa<SCEVCouldNotCompute>(BTC)){
+    return false;
+  }
+
+  const SCEV * startLower;
+  const SCEV * startUpper;
+  if(!getSubscriptRange(addRec->getStart(), SE, startLower, startUpper)){
+    return false;
+  }
+
+  const SCEV * step = addRec->getStepRecurrence(SE);
+  const SCEV * span = SE.getMulExpr(step, SE.getTruncateOrZeroExtend(BTC, step->getType()));
+  if(SE.isKnownNonNegative(step)){
+    lower = startLower;
+    upper = SE.getAddExpr(startUpper, span);
+    return true;
+  }
+  if(SE.isKnownNonPositive(step)){
+    lower = SE.getAddExpr(startLower, span);
+    upper = startUpper;
+    return true;
+  }
+  return false;
 }
 
-const SCEV* getBaseSCEV(const SCEVAddRecExpr *addRecExpr){
-  if(!addRecExpr){
-    return nullptr;
+/*Come nella delinearizzazione di DependenceInfo, ogni dimensione dopo la
+prima deve restare in [0, size): un pedice che esce dalla riga (j + 1 in
+a[i * M + j + 1]) tocca la riga successiva e una dimensione da sola non
+basta più a separare gli accessi. Gli estremi del pedice bastano nei loop
+ruotati; nei loop che escono dall'header vale la condizione che domina I*/
+bool checkSubscriptRanges(AccessFunction & AF, Instruction * I, ScalarEvolution & SE){
+  for(unsigned k = 1; k < AF.subscripts.size(); ++k){
+    if(!AF.sizes[k]){
+      return false;
+    }
+
+    const SCEV * subscript = AF.subscripts[k];
+    const SCEV * lower = subscript;
+    const SCEV * upper = subscript;
+    if(!getSubscriptRange(subscript, SE, lower, upper)){
+      lower = subscript;
+      upper = subscript;
+    }
+
+    Type * Ty = SE.getWiderType(subscript->getType(), AF.sizes[k]->getType());
+    subscript = SE.getNoopOrSignExtend(subscript, Ty);
+    lower = SE.getNoopOrSignExtend(lower, Ty);
+    upper = SE.getNoopOrSignExtend(upper, Ty);
+    const SCEV * size = SE.getNoopOrZeroExtend(AF.sizes[k], Ty);
+    if(!SE.isKnownNonNegative(lower) && !SE.isKnownPredicateAt(ICmpInst::ICMP_SGE, subscript, SE.getZero(Ty), I)){
+      return false;
+    }
+    if(!SE.isKnownNegative(SE.getMinusSCEV(upper, size)) && !SE.isKnownPredicateAt(ICmpInst::ICMP_SLT, subscript, size, I)){
+      return false;
+    }
+  }
+  return true;
+}
+
+/*Calcola la funzione di accesso, provando in ordine:
+1. GEP su array a dimensione fissa (int a[N][M])
+2. Delinearizzazione di array linearizzati con dimensioni parametriche
+3. Una sola dimensione con l'offset in byte dalla base
+Le dimensioni dei primi due casi valgono solo se i pedici restano nei limiti.
+Gli array di puntatori a righe (int **a) restano a una dimensione: righe
+diverse possono essere la stessa memoria*/
+bool getAccessFunction(Instruction * I, ScalarEvolution & SE, bool delinearizeAccess, AccessFunction & AF){
+  Value * ptr = getLoadStorePointerOperand(I);
+  if(!ptr){
+    return false;
+  }
+
+  const SCEV * ptrSCEV = SE.getSCEV(ptr);
+  const SCEV * base = SE.getPointerBase(ptrSCEV);
+  const SCEV * offset = SE.getMinusSCEV(ptrSCEV, base);
+  const SCEV * accessSize = SE.getElementSize(I);
+  if(isa<SCEVCouldNotCompute>(offset)){
+    return false;
+  }
+
+  AF.base = base;
+  if(delinearizeAccess){
+    GetElementPtrInst * GEP = dyn_cast<GetElementPtrInst>(ptr);
+    if(GEP && SE.getSCEV(GEP->getPointerOperand()) == base){
+      SmallVector<int, 4> dimensions;
+      if(getIndexExpressionsFromGEP(SE, GEP, AF.subscripts, dimensions)){
+        AF.shape = GEP->getSourceElementType();
+        AF.sizes.append(AF.subscripts.size() - dimensions.size(), nullptr);
+        for(int dimension : dimensions){
+          AF.sizes.push_back(SE.getConstant(offset->getType(), dimension));
+        }
+        AF.extents.append(AF.subscripts.size(), SE.getOne(offset->getType()));
+        if(checkSubscriptRanges(AF, I, SE)){
+          return true;
+        }
+      }
+      AF.shape = nullptr;
+      AF.subscripts.clear();
+      AF.sizes.clear();
+      AF.extents.clear();
+    }
+
+    // delinearize gives the sizes from the second dimension, then the element size
+    delinearize(SE, offset, AF.subscripts, AF.sizes, accessSize);
+    if(AF.subscripts.size() > 1){
+      AF.sizes.insert(AF.sizes.begin(), nullptr);
+      AF.extents.append(AF.subscripts.size(), SE.getOne(offset->getType()));
+      if(checkSubscriptRanges(AF, I, SE)){
+        return true;
+      }
+    }
+    AF.subscripts.clear();
+    AF.sizes.clear();
+    AF.extents.clear();
+  }
+
+  AF.subscripts.push_back(offset);
+  AF.sizes.push_back(nullptr);
+  AF.extents.push_back(SE.getTruncateOrZeroExtend(accessSize, offset->getType()));
+  return true;
+}
+
+bool isSameAccessShape(AccessFunction & AF0, AccessFunction & AF1){
+  return AF0.base == AF1.base && AF0.shape == AF1.shape && AF0.sizes == AF1.sizes;
+}
+
+/*Scompone il pedice come start + step * iterazione del loop; fallisce se il
+pedice dipende da loop interni*/
+bool getSubscriptRecurrence(const SCEV * subscript, const Loop * L, ScalarEvolution & SE, const SCEV *& start, const SCEV *& step){
+  if(SE.isLoopInvariant(subscript, L)){
+    start = subscript;
+    step = SE.getZero(subscript->getType());
+    return true;
   }
 
-  const SCEVAddExpr *addExpr = dyn_cast<SCEVAddExpr>(addRecExpr->getOperand(0));
-  if(!addExpr){
-    return addRecExpr->getOperand(0);
+  const SCEVAddRecExpr * addRec = dyn_cast<SCEVAddRecExpr>(subscript);
+  if(!addRec || addRec->getLoop() != L || !addRec->isAffine()){
+    return false;
   }
-  return addExpr->getOperand(1);
+
+  start = addRec->getStart();
+  step = addRec->getStepRecurrence(SE);
+  return SE.isLoopInvariant(start, L) && SE.isLoopInvariant(step, L);
 }
 
-const SCEVConstant* getOffsetSCEV(const SCEVAddRecExpr *addRecExpr, const Instruction *I, ScalarEvolution &SE){
-  if(!addRecExpr){
-    return nullptr;
+/*Controlla su una dimensione che ogni locazione toccata da L1 all'iterazione j
+sia toccata da L0 solo nelle iterazioni i <= j, che nel loop fuso vengono
+eseguite prima. Con D = start1 - start0 e step positivo la condizione è
+D + step1 * j + extent1 <= step0 * (j + 1) agli estremi j = 0 e j = BTC
+(simmetrica per step negativo); se il pedice non varia con il loop basta che
+le due locazioni siano disgiunte*/
+bool isDimensionSafe(const SCEV * subscript0, const SCEV * subscript1, const SCEV * extent0, const SCEV * extent1, const Loop * L0, const Loop * L1, ScalarEvolution & SE){
+  const SCEV * start0;
+  const SCEV * step0;
+  const SCEV * start1;
+  const SCEV * step1;
+  if(!getSubscriptRecurrence(subscript0, L0, SE, start0, step0) || !getSubscriptRecurrence(subscript1, L1, SE, start1, step1)){
+    return false;
+  }
+
+  Type * Ty = SE.getWiderType(start0->getType(), start1->getType());
+  start0 = SE.getNoopOrSignExtend(start0, Ty);
+  start1 = SE.getNoopOrSignExtend(start1, Ty);
+  step0 = SE.getNoopOrSignExtend(step0, Ty);
+  step1 = SE.getNoopOrSignExtend(step1, Ty);
+  extent0 = SE.getNoopOrZeroExtend(extent0, Ty);
+  extent1 = SE.getNoopOrZeroExtend(extent1, Ty);
+
+  const SCEV * distance = SE.getMinusSCEV(start1, start0);
+  LLVM_DEBUG(dbgs() << "\n Distance: " << *distance << "\t Step0: " << *step0 << "\t Step1: " << *step1 << "\n");
+
+  if(step0->isZero() && step1->isZero()){
+    return SE.isKnownPredicate(ICmpInst::ICMP_SGE, distance, extent0) ||
+           SE.isKnownPredicate(ICmpInst::ICMP_SLE, distance, SE.getNegativeSCEV(extent1));
+  }
+
+  bool positive = SE.isKnownPositive(step0);
+  if(!positive && !SE.isKnownNegative(step0)){
+    return false;
+  }
+
+  SmallVector<const SCEV *, 2> iterations;
+  iterations.push_back(SE.getZero(Ty));
+  if(step0 != step1){
+    const SCEV * BTC = SE.getBackedgeTakenCount(L0);
+    if(isa<SCEVCouldNotCompute>(BTC)){
+      return false;
+    }
+    iterations.push_back(SE.getNoopOrZeroExtend(BTC, Ty));
   }
 
-  const SCEVAddExpr *addExpr = dyn_cast<SCEVAddExpr>(addRecExpr->getOperand(0));
-  if(!addExpr){
-    int32_t N = 0;
-    LLVMContext &context = I->getContext();
-    IntegerType *Int32Type = IntegerType::get(context, 32);
-    ConstantInt *Val = ConstantInt::get(Int32Type, N);
-    const SCEV *constSCEV = SE.getConstant(Val);
-    return dyn_cast<SCEVConstant>(constSCEV);
+  for(const SCEV * j : iterations){
+    const SCEV * next0 = SE.getMulExpr(step0, SE.getAddExpr(j, SE.getOne(Ty)));
+    const SCEV * access1 = SE.getAddExpr(distance, SE.getMulExpr(step1, j));
+    const SCEV * gap = positive ? SE.getMinusSCEV(SE.getAddExpr(access1, extent1), next0)
+                                : SE.getMinusSCEV(SE.getAddExpr(next0, extent0), access1);
+    if(!SE.isKnownNonPositive(gap)){
+      return false;
+    }
   }
-  return dyn_cast<SCEVConstant>(addExpr->getOperand(0));
+  return true;
 }
 
+/*Distanza di dipendenza tra I0 (in L0) e I1 (in L1) calcolata con SCEV sulle
+funzioni di accesso: la dipendenza è negativa se L1 può toccare una locazione
+che L0 tocca in un'iterazione successiva. Basta una dimensione che lo escluda*/
 bool isDistanceNegative(std::unique_ptr<Dependence> &dep, const Loop *L0, const Loop *L1, ScalarEvolution &SE){
-  outs() << "\n -------- Negative distance dependency analysis -------- \n";
-  if(!dep->isFlow() && !dep->isAnti()){
+  LLVM_DEBUG(dbgs() << "\n -------- Negative distance dependency analysis -------- \n");
+  if(dep->isInput()){
     return false;
   }
 
@@ -156,408 +379,1164 @@ bool isDistanceNegative(std::unique_ptr<Dependence> &dep, const Loop *L0, const
     return true;
   }
 
-  // Get SCEV of getelementptr
-  const SCEV *I0SCEV = SE.getSCEVAtScope(I0->getOperand(dep->isFlow()), L0);
-  const SCEV *I1SCEV = SE.getSCEVAtScope(I1->getOperand(dep->isAnti()), L1);
+  AccessFunction AF0;
+  AccessFunction AF1;
+  bool delinearizeAccess = getAccessFunction(I0, SE, true, AF0) && getAccessFunction(I1, SE, true, AF1) && isSameAccessShape(AF0, AF1);
+  if(!delinearizeAccess){
+    AF0 = AccessFunction();
+    AF1 = AccessFunction();
+    if(!getAccessFunction(I0, SE, false, AF0) || !getAccessFunction(I1, SE, false, AF1)){
+      return true;
+    }
+  }
 
-  // Check if SCEV can compute and represent them
-  if(isa<SCEVCouldNotCompute>(I0SCEV) || isa<SCEVCouldNotCompute>(I1SCEV)){
+  // Different arrays or shapes cannot be compared, nor bases that change in the loops (rows of int **a)
+  if(!isSameAccessShape(AF0, AF1) || !SE.isLoopInvariant(AF0.base, L0) || !SE.isLoopInvariant(AF1.base, L1)){
     return true;
   }
 
-  // SCEVTypes 5 == AddExpr, SCEVTypes 8 == AddRecExpr
-  outs() << "\n I0SCEV: " << *I0SCEV << "\t" << I0SCEV->getSCEVType() << "\n";
-  outs() << "\n I1SCEV: " << *I1SCEV << "\t" << I1SCEV->getSCEVType() << "\n";
-
-  // Check if they are AddRecExpr
-  const SCEVAddRecExpr *I0AddRecExpr = convertSCEVToAddRecExpr(I0SCEV, L0, SE);
-  const SCEVAddRecExpr *I1AddRecExpr = convertSCEVToAddRecExpr(I1SCEV, L1, SE);
-
-  if(!I0AddRecExpr || !I1AddRecExpr){
-    return true;
+  for(unsigned k = 0; k < AF0.subscripts.size(); ++k){
+    LLVM_DEBUG(dbgs() << "\n Dimensione " << k << ": I0 " << *AF0.subscripts[k] << "\t I1 " << *AF1.subscripts[k] << "\n");
+    if(isDimensionSafe(AF0.subscripts[k], AF1.subscripts[k], AF0.extents[k], AF1.extents[k], L0, L1, SE)){
+      return false;
+    }
   }
-  
-  outs() << "\n I0AddRecExpr: " << *I0AddRecExpr << "\n";
-  outs() << "\n I1AddRecExpr: " << *I1AddRecExpr << "\n";
 
-  // Check if they share same step (if two SCEV expressions are equivalent, they are pointer equal)
-  const SCEV *I0Step = I0AddRecExpr->getOperand(1);
-  const SCEV *I1Step = I1AddRecExpr->getOperand(1);
+  return true;
+}
 
-  if(I0Step != I1Step){
-    return true;
+/*Numero di puntatori di riga caricati per arrivare all'accesso (0 per int *a, 1 per int **a)*/
+unsigned getAccessDepth(const Value * ptr){
+  unsigned depth = 0;
+  const Value * base = getUnderlyingObject(ptr);
+  while(const LoadInst * load = dyn_cast<LoadInst>(base)){
+    base = getUnderlyingObject(load->getPointerOperand());
+    depth++;
   }
+  return depth;
+}
 
-  // Compute starting values: base and offset
-  const SCEV *I0Base = getBaseSCEV(I0AddRecExpr);
-  const SCEV *I1Base = getBaseSCEV(I1AddRecExpr);
-  const SCEVConstant *I0Offset = getOffsetSCEV(I0AddRecExpr, I0, SE);
-  const SCEVConstant *I1Offset = getOffsetSCEV(I1AddRecExpr, I1, SE);
-  outs() << "\n I0Base: " << *I0Base << "\n";
-  outs() << "\n I1Base: " << *I1Base << "\n";
-  outs() << "\n I0Offset: " << *I0Offset << "\n";
-  outs() << "\n I1Offset: " << *I1Offset << "\n";
-  if(!(I0Base && I1Base && I0Offset && I1Offset)){
-    return true;
+/*Accessi allo stesso array e allo stesso livello di puntatori (anche se
+DependenceInfo non li sa analizzare)*/
+bool isSameArray(Instruction * I0, Instruction * I1){
+  Value * ptr0 = getLoadStorePointerOperand(I0);
+  Value * ptr1 = getLoadStorePointerOperand(I1);
+  return ptr0 && ptr1 && getAccessBase(ptr0) == getAccessBase(ptr1) && getAccessDepth(ptr0) == getAccessDepth(ptr1);
+}
+
+ArrayRef<Instruction *> getCachedAccesses(DependenceCache & cache, const Loop * loop){
+  auto found = cache.accesses.find(loop);
+  if(found != cache.accesses.end()){
+    return found->second;
   }
 
-  // Don't share same base
-  if(I0Base != I1Base){
-    return true;
+  SmallVector<Instruction *, 16> & accesses = cache.accesses[loop];
+  for(BasicBlock * BB : loop->blocks()){
+    for(Instruction & I : *BB){
+      // Calls too: DependenceInfo cannot analyze them and answers with a confused dependence
+      if(I.mayReadOrWriteMemory()){
+        accesses.push_back(&I);
+      }
+    }
   }
+  return accesses;
+}
 
-  // Check if distance is negative
-  return SE.isKnownPredicate(ICmpInst::ICMP_SLT, I0Offset, I1Offset);
+void invalidateDependenceCache(DependenceCache & cache, const Loop * loop){
+  cache.accesses.erase(loop);
 }
 
 /*Controlla se ci sono istruzioni di L1 che dipendono da L0*/
-bool checkDependence(const Loop *L0, const Loop *L1, DependenceInfo &DI, ScalarEvolution &SE){
+bool checkDependence(const Loop *L0, const Loop *L1, DependenceInfo &DI, ScalarEvolution &SE, DependenceCache &cache){
+  TimeTraceScope TimeScope("LoopFusionDependences");
   int cont = 0;
+  unsigned queries = 0;
   bool check = false;
+  cache.exhausted = false;
 
   if(L0){
-    for(auto BB0 = L0->block_begin(); BB0 != L0->block_end(); ++BB0){
-      for(auto I0 = (*BB0)->begin(); I0 != (*BB0)->end(); ++I0){
-        outs() << "\n -------------------------------- \n Istruzione L0: " << *I0 << "\n -------------------------------- \n";
-        for(auto BB1 = L1->block_begin(); BB1 != L1->block_end(); ++BB1){
-          for(auto I1 = (*BB1)->begin(); I1 != (*BB1)->end(); ++I1){
-            //outs() << "\n Istruzione L1: " << *I1 << "\n";
-            std::unique_ptr<Dependence> dep = DI.depends(&*I0, &*I1, true);
-
-            if(!dep || dep->isConfused()){
-              continue;
-            }
-
-            if(isDistanceNegative(dep, L0, L1, SE)){
-              outs() << "\n -------- Negative Dipendence -------- \n\n ";
-              dep->dump(outs());
-              outs() << "\n Instruction L0: " << *I0 << "\n";
-              outs() << "\n Intruction L1: " << *I1 << "\n";
-              outs() << "\n -------------------------------- \n";
-              cont++;
-              check = true;
-            }
-          }
+    // Filling the accesses of L1 may grow the map: the ones of L0 are looked up again
+    (void)getCachedAccesses(cache, L0);
+    ArrayRef<Instruction *> accesses1 = getCachedAccesses(cache, L1);
+    ArrayRef<Instruction *> accesses0 = getCachedAccesses(cache, L0);
+
+    for(Instruction * I0 : accesses0){
+      LLVM_DEBUG(dbgs() << "\n -------------------------------- \n Istruzione L0: " << *I0 << "\n -------------------------------- \n");
+      for(Instruction * I1 : accesses1){
+        // Two loads never depend on each other
+        if(!I0->mayWriteToMemory() && !I1->mayWriteToMemory()){
+          continue;
+        }
+
+        /*Budget esaurito: senza risposta la dipendenza si assume, e le
+        coppie rimaste non vengono interrogate*/
+        if(cache.maxQueries && queries == cache.maxQueries){
+          LLVM_DEBUG(dbgs() << "\n -------- Budget di " << cache.maxQueries << " interrogazioni esaurito -------- \n");
+          cache.exhausted = true;
+          return true;
+        }
+
+        std::unique_ptr<Dependence> dep = DI.depends(I0, I1, true);
+        cache.queries++;
+        queries++;
+
+        // Accesses DependenceInfo cannot order (arrays that may alias, calls) are assumed dependent, unless they touch the same array
+        bool negative = dep && ((dep->isConfused() && !isSameArray(I0, I1)) || isDistanceNegative(dep, L0, L1, SE));
+
+        if(negative){
+          LLVM_DEBUG(dbgs() << "\n -------- Negative Dipendence -------- \n\n ");
+          LLVM_DEBUG(dep->dump(dbgs()));
+          LLVM_DEBUG(dbgs() << "\n Instruction L0: " << *I0 << "\n");
+          LLVM_DEBUG(dbgs() << "\n Intruction L1: " << *I1 << "\n");
+          LLVM_DEBUG(dbgs() << "\n -------------------------------- \n");
+          cont++;
+          check = true;
         }
       }
     }
   }
 
-  outs() << "\n -------- Number of Negative Distance:" << cont << " -------- \n";
+  LLVM_DEBUG(dbgs() << "\n -------- Number of Negative Distance:" << cont << " -------- \n");
   return check;
 }
 
-bool fuseLoops(Loop * L0, Loop * L1){
+/*Restituisce l'array di base di un accesso in memoria: per gli array
+multidimensionali (int **a) si risale oltre il caricamento del puntatore di riga*/
+const Value * getAccessBase(const Value * ptr){
+  const Value * base = getUnderlyingObject(ptr);
+  while(const LoadInst * load = dyn_cast<LoadInst>(base)){
+    base = getUnderlyingObject(load->getPointerOperand());
+  }
+  return base;
+}
 
-  if(!L0 || !L1){
-    return false;
+/*Raccoglie gli array di base toccati dal loop e restituisce il numero di accessi*/
+unsigned collectAccessBases(Loop * loop, SmallPtrSetImpl<const Value *> & bases){
+  unsigned refs = 0;
+  for(BasicBlock * BB : loop->blocks()){
+    for(Instruction & I : *BB){
+      const Value * ptr = getLoadStorePointerOperand(&I);
+      if(!ptr){
+        continue;
+      }
+      bases.insert(getAccessBase(ptr));
+      refs++;
+    }
+  }
+  return refs;
+}
+
+/*Conta gli accessi del loop ad array presenti in bases*/
+unsigned countSharedAccesses(Loop * loop, SmallPtrSetImpl<const Value *> & bases){
+  unsigned shared = 0;
+  for(BasicBlock * BB : loop->blocks()){
+    for(Instruction & I : *BB){
+      const Value * ptr = getLoadStorePointerOperand(&I);
+      if(ptr && bases.count(getAccessBase(ptr))){
+        shared++;
+      }
+    }
   }
+  return shared;
+}
 
-  BasicBlock * latch0 = L0->getLoopLatch();
-  BasicBlock * latch1 = L1->getLoopLatch();
-  //BasicBlock * exitingBlock0 = L0->getExitingBlock();
-  //BasicBlock * exitingBlock1 = L1->getExitingBlock();
-  BasicBlock * header0 = L0->getHeader();
-  BasicBlock * header1 = L1->getHeader();
-  
-  //BasicBlock * exitBlock0 = L0->getExitBlock();
-  BasicBlock * exitBlock1 = L1->getExitBlock();
-
-  BasicBlock * preHeader1 = L1->getLoopPreheader();
-
-  //1: Header0 --> Exit1
-  //outs() << "\n -------- L0 Latch -------- \n" << *latch0;
-  //outs() << "\n -------- L1 Latch -------- \n" << *latch1;
-
-  Instruction & lastHeader0 = *header0->rbegin();
-  outs() << "\n -------- Last Instruction Header0 (before) -------- \n" << lastHeader0 << "\n";
-  lastHeader0.setOperand(1, exitBlock1);
-  outs() << "\n -------- Last Instruction Header0 (after) -------- \n" << lastHeader0 << "\n";
-
-  //2: Body0 --> Body1 --> Latch0
-  Instruction & lastBody0 = *(latch0->getSinglePredecessor()->rbegin());
-  outs() << "\n -------- Last Instruction Body0 (before) -------- \n" << lastBody0 << "\n";
-  Instruction & lastHeader1 = *header1->rbegin();
-  //outs() << "\n -------- Operand Header1 -------- \n" << *lastHeader1.getOperand(2) << "\n";
-  lastBody0.setOperand(0, lastHeader1.getOperand(2));
-  Instruction & firstHeader0 = *header0->begin();
-  Instruction & firstHeader1 = *header1->begin();
-  firstHeader1.replaceAllUsesWith(&firstHeader0);
-  outs() << "\n -------- Last Instruction Body0 (after) -------- \n" << lastBody0 << "\n";
-  
-  Instruction & lastBody1 = *(latch1->getSinglePredecessor()->rbegin());
-  lastBody1.setOperand(0, latch0);
+/*Costo LoopCacheCost del nido: si prende il costo del loop più interno,
+ovvero quello dell'ordine attuale dei loop. Se l'analisi non riesce si
+conta un accesso alla cache per riferimento*/
+CacheCostTy getNestCacheCost(Loop * loop, unsigned refs, LoopStandardAnalysisResults & AR, DependenceInfo & DI){
+  std::unique_ptr<CacheCost> CC = CacheCost::getCacheCost(*loop, AR, DI);
+  if(!CC){
+    return refs;
+  }
 
-  //3: Header1 --> Latch1
-  outs() << "\n -------- Last Instruction Header1 (before) -------- \n" << lastHeader1 << "\n";
-  lastHeader1.setOperand(1, latch1);
-  outs() << "\n -------- Last Instruction Header1 (after) -------- \n" << lastHeader1 << "\n";
+  Loop * inner = loop;
+  while(!inner->isInnermost()){
+    inner = *inner->begin();
+  }
 
-  //Eliminazione dei basicblock non legati al resto
-  outs() << "\n -------- Last Instruction PreHeader1 -------- \n" << *preHeader1->rbegin() << "\n";
+  CacheCostTy cost = CC->getLoopCost(*inner);
+  if(cost < 0){
+    return refs;
+  }
+  return cost;
+}
 
-  outs() << "\n -------- Last Instruction Header1 -------- \n" << *header1->rbegin() << "\n";
+/*Stima la pressione sui registri del corpo del loop:
+1. I valori definiti fuori dal loop e usati al suo interno vengono aggiunti a invariants
+2. Si restituisce il massimo numero di temporanei vivi contemporaneamente
+(le PHI dell'header sono contate a parte)*/
+unsigned estimateBodyPressure(Loop * loop, SmallPtrSetImpl<const Value *> & invariants){
+  DenseMap<const Instruction *, unsigned> position;
+  SmallVector<Instruction *> body;
+  for(BasicBlock * BB : loop->blocks()){
+    for(Instruction & I : *BB){
+      position[&I] = body.size();
+      body.push_back(&I);
+    }
+  }
 
-  outs() << "\n -------- Last Instruction Latch1 -------- \n" << *latch1->rbegin() << "\n";
-  
-  /*
-  SmallVector <BasicBlock *> needToEraseBB;
-  needToEraseBB.push_back(preHeader1);
-  needToEraseBB.push_back(header1);
-  needToEraseBB.push_back(latch1);
-  SmallVector <Instruction *> needToEraseI;
+  // delta[p] is the change in the number of live values at position p
+  SmallVector<int> delta(body.size() + 1, 0);
+  for(Instruction * I : body){
+    for(Value * operand : I->operands()){
+      Instruction * def = dyn_cast<Instruction>(operand);
+      if((def && !loop->contains(def)) || isa<Argument>(operand)){
+        invariants.insert(operand);
+      }
+    }
+
+    if(I->getType()->isVoidTy() || (isa<PHINode>(I) && I->getParent() == loop->getHeader())){
+      continue;
+    }
+
+    unsigned def = position[I];
+    unsigned last = def;
+    for(User * U : I->users()){
+      Instruction * user = dyn_cast<Instruction>(U);
+      if(!user || !loop->contains(user)){
+        continue;
+      }
+      // A use that comes before the definition is carried around the backedge
+      unsigned use = position[user];
+      last = std::max(last, use > def ? use : (unsigned) body.size() - 1);
+    }
 
-  for(auto B = needToEraseBB.begin(); B != needToEraseBB.end(); ++B){
-    BasicBlock & BB = **B;
-    for(auto I = BB.begin(); I != BB.end(); ++I){
-      //Instruction * Instr = **I;
-      needToEraseI.push_back(&*I);
+    if(last > def){
+      delta[def + 1]++;
+      delta[last + 1]--;
     }
   }
 
-  for(auto I = needToEraseI.begin(); I != needToEraseI.end(); ++I){
-    (*I)->eraseFromParent();
+  int live = 0;
+  int maxLive = 0;
+  for(int d : delta){
+    live += d;
+    maxLive = std::max(maxLive, live);
   }
-  */
+  return maxLive;
+}
 
-  preHeader1->rbegin()->eraseFromParent();
-  header1->rbegin()->eraseFromParent();
-  latch1->rbegin()->eraseFromParent();
+unsigned countHeaderPHIs(Loop * loop){
+  unsigned phis = 0;
+  for(PHINode & PN : loop->getHeader()->phis()){
+    (void) PN;
+    phis++;
+  }
+  return phis;
+}
+
+/*Larghezza in bit del tipo più largo letto o scritto dal loop*/
+unsigned getWidestTypeBits(Loop * loop, const DataLayout & DL){
+  unsigned widest = 0;
+  for(BasicBlock * BB : loop->blocks()){
+    for(Instruction & I : *BB){
+      if(isa<LoadInst>(I) || isa<StoreInst>(I)){
+        widest = std::max<unsigned>(widest, DL.getTypeSizeInBits(getLoadStoreType(&I)).getFixedValue());
+      }
+    }
+  }
+  return widest ? widest : 8;
+}
 
-  preHeader1->eraseFromParent();
-  header1->eraseFromParent();
-  latch1->eraseFromParent();
+/*Massima potenza di 2 non superiore a maxElements*/
+unsigned getPowerOf2VF(uint64_t maxElements){
+  unsigned VF = 1;
+  while(VF * 2 <= maxElements){
+    VF *= 2;
+  }
+  return VF;
+}
 
-  /*
-  DeleteDeadBlock(preHeader1, nullptr, false);
-  DeleteDeadBlock(header1, nullptr, false);
-  DeleteDeadBlock(latch1, nullptr, false);
-  */
+/*Gestore dei diagnostici che scarta tutti i remark*/
+struct DiscardDiagnostics : public DiagnosticHandler {
+  bool handleDiagnostics(const DiagnosticInfo & DI) override { return true; }
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override { return false; }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override { return false; }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override { return false; }
+  bool isAnyRemarkEnabled() const override { return false; }
+};
+
+DiscardedRemarks::DiscardedRemarks() : M("discarded-remarks", Ctx),
+    F(Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false), GlobalValue::ExternalLinkage, "", M)), ORE(F) {
+  Ctx.setDiagnosticHandler(std::make_unique<DiscardDiagnostics>());
+}
+
+/*VF previsto per un loop nest: per ogni loop più interno, la larghezza dei
+registri vettoriali limitata dalla distanza di dipendenza sicura di
+LoopAccessInfo, divisa per il tipo più largo. VF è 0 se un loop più interno
+non è vettorizzabile secondo LoopVectorizationLegality.
+Restituisce false se il VF non si può prevedere: LoopVectorizationLegality
+riconosce solo i loop ruotati in forma LCSSA, quindi sull'IR di mem2reg
+serve loop-rotate prima del passo. I suoi remark di loop-vectorize vanno
+su discarded: qui non si vettorizza niente*/
+bool predictLoopNestVF(Loop * loop, Function & F, FunctionAnalysisManager & AM, DiscardedRemarks & discarded, unsigned & nestVF){
+  LoopInfo & LI = AM.getResult<LoopAnalysis>(F);
+  DominatorTree & DT = AM.getResult<DominatorTreeAnalysis>(F);
+  ScalarEvolution & SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  TargetTransformInfo & TTI = AM.getResult<TargetIRAnalysis>(F);
+  TargetLibraryInfo & TLI = AM.getResult<TargetLibraryAnalysis>(F);
+  AssumptionCache & AC = AM.getResult<AssumptionAnalysis>(F);
+  DemandedBits & DB = AM.getResult<DemandedBitsAnalysis>(F);
+  BlockFrequencyInfo & BFI = AM.getResult<BlockFrequencyAnalysis>(F);
+  LoopAccessInfoManager & LAIs = AM.getResult<LoopAccessAnalysis>(F);
+  const DataLayout & DL = F.getParent()->getDataLayout();
+
+  uint64_t registerBits = TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedValue();
+  nestVF = 0;
+
+  SmallVector<Loop *, 4> innerLoops;
+  for(Loop * inner : loop->getLoopsInPreorder()){
+    if(inner->isInnermost()){
+      if(!inner->isRotatedForm() || !inner->isLCSSAForm(DT)){
+        return false;
+      }
+      innerLoops.push_back(inner);
+    }
+  }
+
+  for(Loop * inner : innerLoops){
+    PredicatedScalarEvolution PSE(SE, *inner);
+    LoopVectorizationRequirements Requirements;
+    LoopVectorizeHints Hints(inner, true, discarded.ORE, &TTI);
+    LoopVectorizationLegality LVL(inner, PSE, &DT, &TTI, &TLI, &F, LAIs, &LI, &discarded.ORE, &Requirements, &Hints, &DB, &AC, &BFI, nullptr);
+
+    if(!LVL.canVectorize(false)){
+      nestVF = 0;
+      return true;
+    }
+
+    uint64_t safeBits = std::min<uint64_t>(registerBits, LVL.getMaxSafeVectorWidthInBits());
+    unsigned VF = getPowerOf2VF(safeBits / getWidestTypeBits(inner, DL));
+    nestVF = nestVF ? std::min(nestVF, VF) : VF;
+  }
 
   return true;
 }
 
+/*Controlla con LoopVectorizationLegality che tutti i loop più interni del nido
+siano vettorizzabili; i loop di cui non si può prevedere il VF non lo sono*/
+bool isLoopNestVectorizable(Loop * loop, Function & F, FunctionAnalysisManager & AM, DiscardedRemarks & discarded){
+  unsigned VF = 0;
+  return predictLoopNestVF(loop, F, AM, discarded, VF) && VF;
+}
 
-PreservedAnalyses LoopFusionPass::run(Function &F, FunctionAnalysisManager &AM) {
+/*Limite in byte al VF di una dipendenza in avanti store --> load a distanza
+distance: come in LoopAccessInfo, il VF non deve impedire lo store-to-load
+forwarding*/
+uint64_t getStoreLoadForwardMaxBytes(uint64_t distance, uint64_t typeBytes, uint64_t maxBytes){
+  const uint64_t itersThroughMemory = 8 * typeBytes;
+  for(uint64_t VF = 2 * typeBytes; VF <= maxBytes; VF *= 2){
+    if(distance % VF && distance / VF < itersThroughMemory){
+      return VF >> 1;
+    }
+  }
+  return maxBytes;
+}
 
-  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
-  DominatorTree &DT = AM.getResult<DominatorTreeAnalysis>(F);
-  PostDominatorTree &PDT = AM.getResult<PostDominatorTreeAnalysis>(F);
-  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
-  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+/*VF massimo del corpo fuso dovuto alle dipendenze tra gli accessi di L0 e
+quelli di L1, classificate come farebbe LoopAccessInfo: nel corpo fuso gli
+accessi di L0 precedono quelli di L1 e le due variabili di induzione sono la
+stessa. Sono le sole dipendenze che la fusione aggiunge: quelle interne a un
+loop sono già nel VF previsto per quel loop. Restituisce 1 se una coppia di
+accessi rende il corpo fuso scalare*/
+unsigned getCrossLoopMaxVF(Loop * L0, Loop * L1, ScalarEvolution & SE, const DataLayout & DL, unsigned maxVF){
+  SmallVector<Instruction *, 16> accesses0;
+  SmallVector<Instruction *, 16> accesses1;
+  for(BasicBlock * BB : L0->blocks()){
+    for(Instruction & I : *BB){
+      if(isa<LoadInst>(I) || isa<StoreInst>(I)){
+        accesses0.push_back(&I);
+      }
+    }
+  }
+  for(BasicBlock * BB : L1->blocks()){
+    for(Instruction & I : *BB){
+      if(isa<LoadInst>(I) || isa<StoreInst>(I)){
+        accesses1.push_back(&I);
+      }
+    }
+  }
 
-  int cont = 0; //Numera i loop
-  int contNPasses = 0;
-  
-  BasicBlock * BBTopL0 = NULL;
-  BasicBlock * BBTopL1;
-  BasicBlock * exitBlock = NULL;
-  Loop * L0 = NULL;
-  Loop * loop;
-
-  bool Transformed = true;
-  std::vector <Loop *> innerLoops;
-
-  //int levelLoop = 1;
-  //const int maxLevel = 2;
-
-  while(Transformed != false){
-
-    BBTopL0 = NULL;
-    BBTopL1 = NULL;
-    exitBlock = NULL;
-    L0 = NULL;
-    loop = NULL;
-    
-    outs() << "\n -------------------------------- Passo N°" << contNPasses << " -------------------------------- \n";
-    Transformed = false;
-    for(auto L = LI.rbegin(); L != LI.rend(); L0 = loop, BBTopL0 = BBTopL1, exitBlock = loop->getExitBlock(), cont++, ++L){
-          
-      loop = *L;
-      
-      /*Stampa informazioni inerenti al Loop*/
-
-      myPrintLoop(loop, cont);
-      
-      /*Punto 1: si assume che ci sia solo un successore, ovvero un solo
-      exitBlock*/
-
-      BBTopL1 = topLoopBB(loop/*, exitBlock*/);
-
-      if(!checkLoopAdiacenti(exitBlock, BBTopL1)){
-        outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " NON sono Adiacenti -------- \n";
-        //outs() << *BBTopL1;
+  unsigned VF = maxVF;
+  for(Instruction * A : accesses0){
+    for(Instruction * B : accesses1){
+      bool AIsWrite = A->mayWriteToMemory();
+      bool BIsWrite = B->mayWriteToMemory();
+      if(!AIsWrite && !BIsWrite){
         continue;
       }
 
-      outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " sono Adiacenti -------- \n";
-
-      /*Punto 3: si assume che ci sia solo un successore, ovvero un solo
-      exitBlock*/
-      
-      if(!checkLoopControlFlowEquivalent(DT, PDT, BBTopL1, BBTopL0/*, exitBlock, cont*/)){
-        outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " NON sono Control Flow Equivalenti -------- \n";
+      /*Gli array che possono sovrapporsi danno una dipendenza confusa e
+      bloccano la fusione in checkDependence: qui array diversi sono disgiunti*/
+      if(getAccessBase(getLoadStorePointerOperand(A)) != getAccessBase(getLoadStorePointerOperand(B))){
         continue;
       }
-      
-      outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " sono Control Flow Equivalenti -------- \n";
 
+      uint64_t typeBytes = DL.getTypeStoreSize(getLoadStoreType(A)).getFixedValue();
+      const SCEVAddRecExpr * ptrA = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(getLoadStorePointerOperand(A)));
+      const SCEVAddRecExpr * ptrB = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(getLoadStorePointerOperand(B)));
+      if(typeBytes != DL.getTypeStoreSize(getLoadStoreType(B)).getFixedValue() || !ptrA || !ptrB || ptrA->getLoop() != L0 || ptrB->getLoop() != L1){
+        return 1;
+      }
 
-      /*Punto 2: si assume che i cicli FOR abbiano un numero costante di cicli e non N*/
-      //exitingBlock = loop.getExitingBlock();
+      const SCEVConstant * stride = dyn_cast<SCEVConstant>(ptrA->getStepRecurrence(SE));
+      const SCEVConstant * distance = dyn_cast<SCEVConstant>(SE.getMinusSCEV(ptrB->getStart(), ptrA->getStart()));
+      if(!stride || !distance || stride != ptrB->getStepRecurrence(SE) || stride->getValue()->isZero()){
+        return 1;
+      }
 
-      //outs() << "\n -------- Loop Trip Count: " << TC1 << " --------- \n";
-      if(!checkLoopTripCount(SE, L0, loop)){
-        outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " NON hanno lo stesso Trip Count  -------- \n";
+      int64_t dist = distance->getAPInt().getSExtValue();
+      // With a negative stride the later iterations access lower addresses
+      if(stride->getAPInt().isNegative()){
+        dist = -dist;
+        std::swap(AIsWrite, BIsWrite);
+      }
+
+      uint64_t maxBytes = (uint64_t) VF * typeBytes;
+      if(dist == 0){
         continue;
       }
+      if(dist > 0){
+        // Backward dependence: VF limited by the distance
+        maxBytes = std::min<uint64_t>(maxBytes, dist);
+      }
+      if(AIsWrite && !BIsWrite){
+        maxBytes = getStoreLoadForwardMaxBytes(dist > 0 ? dist : -dist, typeBytes, maxBytes);
+      }
 
-      outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " hanno lo stesso Trip Count  -------- \n";
+      if(maxBytes < 2 * typeBytes){
+        return 1;
+      }
+      VF = std::min<unsigned>(VF, getPowerOf2VF(maxBytes / typeBytes));
+    }
+  }
+
+  return VF;
+}
+
+/*Modalità fusione-poi-vettorizzazione: a partire dal VF previsto di L0 e di
+L1 stima quello del loop fuso e accetta la fusione solo se il loop fuso resta
+vettorizzabile con un VF non inferiore al più largo dei due. I VF previsti
+vengono riportati come optimization remark; senza previsione (loop non
+ruotati) la fusione non viene bloccata.
+La previsione del loop fuso è approssimata: il corpo fuso non esiste ancora e
+LoopVectorizationLegality non lo vede. Si assume che sia vettorizzabile
+quando lo sono entrambi i loop, con il VF del tipo più largo dei due (il
+minimo tra VF0 e VF1), limitato dalle dipendenze tra L0 e L1 stimate da
+getCrossLoopMaxVF. Non si considerano il numero di controlli a runtime tra
+i puntatori dei due loop né il costo della vettorizzazione: la fusione può
+ancora far perdere il VF previsto in quei casi*/
+bool checkFusionKeepsVectorization(Loop * L0, Loop * L1, Function & F, FunctionAnalysisManager & AM, PredictedVF & predicted){
+  TimeTraceScope TimeScope("LoopFusionVectorization");
+  ScalarEvolution & SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  OptimizationRemarkEmitter & ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  const DataLayout & DL = F.getParent()->getDataLayout();
+
+  if(!predicted.known){
+    LLVM_DEBUG(dbgs() << "\n -------- VF non prevedibile: i loop non sono ruotati in forma LCSSA -------- \n");
+    ORE.emit([&]() {
+      return OptimizationRemarkAnalysis(DEBUG_TYPE, "VFNotPredicted", L0->getStartLoc(), L0->getHeader())
+             << "VF not predicted: the loops are not rotated (run loop-rotate before the pass)";
+    });
+    return true;
+  }
 
+  unsigned VF0 = predicted.VF0;
+  unsigned VF1 = predicted.VF1;
 
-      /*Punto 4*/
-      if(checkDependence(L0, loop, DI, SE)){
-        outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " hanno delle istruzioni che dipendono tra di loro -------- \n";
+  // The fused body is scalar as soon as one of the two loops is
+  unsigned fusedVF = 0;
+  if(VF0 && VF1){
+    fusedVF = std::min(VF0, VF1);
+    if(L0->isInnermost() && L1->isInnermost()){
+      fusedVF = getCrossLoopMaxVF(L0, L1, SE, DL, fusedVF);
+    }
+  }
+
+  // A loop that does not vectorize runs with VF 1
+  unsigned before = std::max({VF0, VF1, 1u});
+  unsigned after = std::max(fusedVF, 1u);
+  bool keeps = after >= before;
+
+  LLVM_DEBUG(dbgs() << "\n -------- VF previsto: L0 " << VF0 << ", L1 " << VF1 << ", fuso " << fusedVF << " -------- \n");
+
+  ORE.emit([&]() {
+    return OptimizationRemarkAnalysis(DEBUG_TYPE, "PredictedVF", L0->getStartLoc(), L0->getHeader())
+           << "predicted VF before fusion " << ore::NV("VF0", VF0) << " and " << ore::NV("VF1", VF1)
+           << ", after fusion (estimated) " << ore::NV("FusedVF", fusedVF);
+  });
+
+  if(!keeps){
+    ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "FusionLosesVectorization", L0->getStartLoc(), L0->getHeader())
+             << "loops not fused: the fused loop would vectorize with VF " << ore::NV("FusedVF", after)
+             << " instead of " << ore::NV("VF", before);
+    });
+  }
+
+  return keeps;
+}
+
+/*Modello di profittabilità della fusione, con punteggio nelle unità di LoopCacheCost:
+1. + costo degli accessi di L1 ad array già toccati da L0 (riuso in cache)
+2. - costo degli spill (store + load) dei registri in eccesso nel corpo fuso
+3. - costo del loop che perde la vettorizzazione, se solo uno dei due è vettorizzabile
+(solo se il VF è prevedibile, vedi predictLoopNestVF)
+La decisione e il punteggio vengono riportati come optimization remark*/
+bool checkFusionProfitable(Loop * L0, Loop * L1, Function & F, FunctionAnalysisManager & AM, DependenceInfo & DI, PredictedVF & predicted){
+  TimeTraceScope TimeScope("LoopFusionProfitability");
+  LoopInfo & LI = AM.getResult<LoopAnalysis>(F);
+  DominatorTree & DT = AM.getResult<DominatorTreeAnalysis>(F);
+  ScalarEvolution & SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  AAResults & AA = AM.getResult<AAManager>(F);
+  AssumptionCache & AC = AM.getResult<AssumptionAnalysis>(F);
+  TargetLibraryInfo & TLI = AM.getResult<TargetLibraryAnalysis>(F);
+  TargetTransformInfo & TTI = AM.getResult<TargetIRAnalysis>(F);
+  OptimizationRemarkEmitter & ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  LoopStandardAnalysisResults AR = {AA, AC, DT, LI, SE, TLI, TTI, nullptr, nullptr, nullptr};
+
+  // 1: Cache reuse on the arrays shared by the two loops
+  SmallPtrSet<const Value *, 8> bases0;
+  SmallPtrSet<const Value *, 8> bases1;
+  unsigned refs0 = collectAccessBases(L0, bases0);
+  unsigned refs1 = collectAccessBases(L1, bases1);
+  unsigned shared1 = countSharedAccesses(L1, bases0);
+
+  CacheCostTy cost0 = getNestCacheCost(L0, refs0, AR, DI);
+  CacheCostTy cost1 = getNestCacheCost(L1, refs1, AR, DI);
+  CacheCostTy reuse = refs1 ? cost1 * shared1 / refs1 : 0;
+
+  // 2: Register pressure of the fused body against the scalar register file
+  SmallPtrSet<const Value *, 16> invariants0;
+  SmallPtrSet<const Value *, 16> invariants1;
+  unsigned body0 = estimateBodyPressure(L0, invariants0);
+  unsigned body1 = estimateBodyPressure(L1, invariants1);
+  unsigned phis0 = countHeaderPHIs(L0);
+  unsigned phis1 = countHeaderPHIs(L1);
+  unsigned pressure0 = invariants0.size() + phis0 + body0;
+  unsigned pressure1 = invariants1.size() + phis1 + body1;
+
+  SmallPtrSet<const Value *, 16> invariantsFused(invariants0.begin(), invariants0.end());
+  invariantsFused.insert(invariants1.begin(), invariants1.end());
+  // The induction variables of the two loops are merged into one
+  unsigned pressureFused = invariantsFused.size() + phis0 + (phis1 ? phis1 - 1 : 0) + std::max(body0, body1);
+
+  unsigned numRegs = TTI.getNumberOfRegisters(TTI.getRegisterClassForType(false));
+  auto excess = [numRegs](unsigned pressure) -> unsigned {
+    return pressure > numRegs ? pressure - numRegs : 0;
+  };
+  unsigned extraSpills = excess(pressureFused) - std::min(excess(pressureFused), std::max(excess(pressure0), excess(pressure1)));
+  CacheCostTy spill = (refs0 + refs1) ? 2 * extraSpills * (cost0 + cost1) / (refs0 + refs1) : 0;
+
+  // 3: Vectorization lost when a vectorizable loop is fused with a scalar one
+  bool vectorizable0 = predicted.VF0 != 0;
+  bool vectorizable1 = predicted.VF1 != 0;
+  CacheCostTy vectorLoss = 0;
+  if(predicted.known && vectorizable0 != vectorizable1){
+    vectorLoss = (vectorizable0 ? cost0 : cost1) * FusionVectorLossWeight;
+  }
+
+  CacheCostTy score = reuse - spill - vectorLoss;
+
+  LLVM_DEBUG(dbgs() << "\n -------- Profittabilità: riuso " << reuse << ", spill " << spill << ", vettorizzazione " << vectorLoss << " --> punteggio " << score << " -------- \n");
+  LLVM_DEBUG(dbgs() << "\n -------- Registri: L0 " << pressure0 << ", L1 " << pressure1 << ", fuso " << pressureFused << " su " << numRegs << " -------- \n");
+
+  bool profitable = score > FusionProfitThreshold;
+  if(profitable){
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "FusionProfitable", L0->getStartLoc(), L0->getHeader())
+             << "loops are profitable to fuse: score " << ore::NV("Score", score)
+             << " (reuse " << ore::NV("Reuse", reuse) << ", spill " << ore::NV("Spill", spill)
+             << ", vectorization loss " << ore::NV("VectorLoss", vectorLoss) << ")";
+    });
+  }else{
+    ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "FusionNotProfitable", L0->getStartLoc(), L0->getHeader())
+             << "loops are not profitable to fuse: score " << ore::NV("Score", score)
+             << " (reuse " << ore::NV("Reuse", reuse) << ", spill " << ore::NV("Spill", spill)
+             << ", vectorization loss " << ore::NV("VectorLoss", vectorLoss) << ")";
+    });
+  }
+
+  return profitable;
+}
+
+/*Forma di un loop in Loop Simplify Form: i blocchi che la fusione deve
+ricollegare. Un loop è ruotato se esce dal latch, non ruotato se esce
+dall'header; solo i loop ruotati possono avere una guardia*/
+struct LoopShape {
+  BasicBlock * preHeader = nullptr;
+  BasicBlock * header = nullptr;
+  BasicBlock * latch = nullptr;
+  BasicBlock * exitBlock = nullptr;
+  BranchInst * guard = nullptr;
+  bool rotated = false;
+};
+
+bool getLoopShape(Loop * loop, LoopShape & shape){
+  if(!loop->isLoopSimplifyForm()){
+    return false;
+  }
+
+  BasicBlock * exitingBlock = loop->getExitingBlock();
+  shape.exitBlock = loop->getExitBlock();
+  if(!exitingBlock || !shape.exitBlock){
+    return false;
+  }
+
+  shape.preHeader = loop->getLoopPreheader();
+  shape.header = loop->getHeader();
+  shape.latch = loop->getLoopLatch();
+
+  BranchInst * exitBranch = dyn_cast<BranchInst>(exitingBlock->getTerminator());
+  BranchInst * latchBranch = dyn_cast<BranchInst>(shape.latch->getTerminator());
+  if(!exitBranch || !exitBranch->isConditional() || !latchBranch){
+    return false;
+  }
+
+  if(exitingBlock == shape.latch){
+    shape.rotated = true;
+  }
+  else if(exitingBlock == shape.header && latchBranch->isUnconditional()){
+    shape.rotated = false;
+  }
+  else{
+    return false;
+  }
+
+  shape.guard = loop->getLoopGuardBranch();
+  return true;
+}
+
+/*Successore della guardia che salta il loop*/
+BasicBlock * getGuardOtherSuccessor(BranchInst * guard, BasicBlock * preHeader){
+  return guard->getSuccessor(0) == preHeader ? guard->getSuccessor(1) : guard->getSuccessor(0);
+}
+
+/*Si ottiene il BasicBlock che segue il Loop: il successore della Guardia
+che salta il loop oppure l'Exit Block*/
+BasicBlock * bottomLoopBB(Loop * loop){
+  if(BranchInst * guard = loop->getLoopGuardBranch()){
+    return getGuardOtherSuccessor(guard, loop->getLoopPreheader());
+  }
+
+  return loop->getExitBlock();
+}
+
+/*Le guardie sono identiche se hanno la stessa condizione e portano al loop
+dallo stesso lato del branch*/
+bool haveIdenticalGuards(LoopShape & S0, LoopShape & S1){
+  Value * cond0 = S0.guard->getCondition();
+  Value * cond1 = S1.guard->getCondition();
+
+  bool sameCondition = cond0 == cond1;
+  if(!sameCondition && isa<Instruction>(cond0) && isa<Instruction>(cond1)){
+    sameCondition = cast<Instruction>(cond0)->isIdenticalTo(cast<Instruction>(cond1));
+  }
+
+  return sameCondition && (S0.guard->getSuccessor(0) == S0.preHeader) == (S1.guard->getSuccessor(0) == S1.preHeader);
+}
+
+/*Blocchi tra la fine di L0 e l'header di L1, che spariscono con la fusione:
+1. Senza guardie è l'Exit Block di L0, che è anche il PreHeader di L1
+2. Con guardie identiche sono l'Exit Block di L0 (con i blocchi vuoti che lo
+seguono), la Guardia e il PreHeader di L1*/
+bool collectBetweenBlocks(LoopShape & S0, LoopShape & S1, SmallVectorImpl<BasicBlock *> & between){
+  if(!S0.guard && !S1.guard){
+    if(S0.exitBlock != S1.preHeader){
+      return false;
+    }
+    between.push_back(S0.exitBlock);
+    return true;
+  }
+
+  if(!S0.guard || !S1.guard || !haveIdenticalGuards(S0, S1)){
+    return false;
+  }
+
+  BasicBlock * guardBlock1 = S1.guard->getParent();
+  if(getGuardOtherSuccessor(S0.guard, S0.preHeader) != guardBlock1 || pred_size(guardBlock1) != 2){
+    return false;
+  }
+
+  BasicBlock * BB = S0.exitBlock;
+  while(BB != guardBlock1){
+    if(!BB || is_contained(between, BB)){
+      return false;
+    }
+    between.push_back(BB);
+    BB = BB->getUniqueSuccessor();
+  }
+
+  between.push_back(guardBlock1);
+  between.push_back(S1.preHeader);
+  return true;
+}
+
+/*Controlla che la forma di L0 e L1 permetta di fonderli:
+1. Entrambi ruotati o entrambi non ruotati
+2. Entrambi senza guardia o con guardie identiche
+3. Le istruzioni tra i due loop si possono spostare prima di L0
+4. L1 non usa valori scalari calcolati da L0
+5. Se non ruotati, l'header di L1 (che non verrà più eseguito all'uscita) non
+ha effetti collaterali né valori usati fuori da L1*/
+bool checkLoopFusible(Loop * L0, Loop * L1){
+  TimeTraceScope TimeScope("LoopFusionLegality");
+  LoopShape S0, S1;
+  if(!getLoopShape(L0, S0) || !getLoopShape(L1, S1)){
+    LLVM_DEBUG(dbgs() << "\n -------- Uno dei due loop NON è in Loop Simplify Form con un solo Exit Block -------- \n");
+    return false;
+  }
+
+  if(S0.rotated != S1.rotated){
+    LLVM_DEBUG(dbgs() << "\n -------- Uno solo dei due loop è ruotato -------- \n");
+    return false;
+  }
+
+  SmallVector<BasicBlock *, 4> between;
+  if(!collectBetweenBlocks(S0, S1, between)){
+    LLVM_DEBUG(dbgs() << "\n -------- Le guardie dei due loop NON sono identiche -------- \n");
+    return false;
+  }
+
+  // LCSSA phis in the exit block of L0 carry its final values
+  auto isDefinedByL0 = [&](Value * V){
+    Instruction * def = dyn_cast<Instruction>(V);
+    return def && (L0->contains(def) || (isa<PHINode>(def) && def->getParent() == S0.exitBlock));
+  };
+
+  for(BasicBlock * BB : between){
+    for(Instruction & I : *BB){
+      if(PHINode * phi = dyn_cast<PHINode>(&I)){
+        if(phi->getNumIncomingValues() != 1){
+          LLVM_DEBUG(dbgs() << "\n -------- Tra i due loop ci sono dei PHI non rimovibili -------- \n");
+          return false;
+        }
         continue;
       }
 
-      outs() << "\n -------- L" << (cont - 1) << " e L" << cont << " NON hanno delle istruzioni che dipendono tra di loro -------- \n";
+      if(I.isTerminator()){
+        continue;
+      }
 
-      //LoopNest loopNestL0 = LoopNest(*L0, SE);
-      //LoopNest loopNestL1 = LoopNest(*loop, SE);
+      if(!isa<DbgInfoIntrinsic>(I) && (I.mayReadOrWriteMemory() || I.mayHaveSideEffects())){
+        LLVM_DEBUG(dbgs() << "\n -------- Tra i due loop c'è un'istruzione non spostabile: " << I << " -------- \n");
+        return false;
+      }
 
-      if(fuseLoops(L0, loop)){
-        Transformed = true;
-        /*
-        Loop * innerL0 = loopNestL0.getInnermostLoop();
-        Loop * innerL1 = loopNestL1.getInnermostLoop();
+      if(any_of(I.operands(), isDefinedByL0)){
+        LLVM_DEBUG(dbgs() << "\n -------- Tra i due loop c'è un'istruzione che usa valori di L0: " << I << " -------- \n");
+        return false;
+      }
+    }
+  }
 
-        if(!innerL0 || !innerL1){
-          continue;
+  for(BasicBlock * BB : L1->blocks()){
+    for(Instruction & I : *BB){
+      if(any_of(I.operands(), isDefinedByL0)){
+        LLVM_DEBUG(dbgs() << "\n -------- L1 usa valori scalari calcolati da L0: " << I << " -------- \n");
+        return false;
+      }
+    }
+  }
+
+  if(!S1.rotated){
+    for(Instruction & I : *S1.header){
+      if(isa<PHINode>(I) || I.isTerminator()){
+        continue;
+      }
+
+      if(I.mayWriteToMemory() || I.mayHaveSideEffects()){
+        LLVM_DEBUG(dbgs() << "\n -------- L'header di L1 ha effetti collaterali: " << I << " -------- \n");
+        return false;
+      }
+
+      for(User * U : I.users()){
+        if(!L1->contains(cast<Instruction>(U))){
+          LLVM_DEBUG(dbgs() << "\n -------- L'header di L1 calcola un valore usato fuori dal loop: " << I << " -------- \n");
+          return false;
         }
+      }
+    }
+  }
 
-        cont = 1;
+  return true;
+}
+
+/*Due PHI degli header sono la stessa variabile di induzione se hanno lo
+stesso valore iniziale e lo stesso passo*/
+bool isSameInductionVariable(PHINode * P0, Loop * L0, PHINode * P1, Loop * L1, ScalarEvolution & SE){
+  if(P0->getType() != P1->getType() || !SE.isSCEVable(P0->getType())){
+    return false;
+  }
 
-        outs() << "\n -------- Inner L0's Loops -------- \n" << *innerL0 << "\n";
-        outs() << "\n -------- Inner L1's Loops -------- \n" << *innerL1 << "\n";
+  const SCEVAddRecExpr * AR0 = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(P0));
+  const SCEVAddRecExpr * AR1 = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(P1));
+  if(!AR0 || !AR1 || AR0->getLoop() != L0 || AR1->getLoop() != L1 || !AR0->isAffine() || !AR1->isAffine()){
+    return false;
+  }
 
-        outs() << "\n -------- Inner L0's Exit Block -------- \n" << *innerL0->getExitBlock() << "\n";
-        outs() << "\n -------- Inner L1's Exit Block -------- \n" << *innerL1->getLoopPreheader()<< "\n";
+  return AR0->getStart() == AR1->getStart() && AR0->getStepRecurrence(SE) == AR1->getStepRecurrence(SE);
+}
 
-        Instruction & lastInnerL0Header = *(innerL0->getHeader()->rbegin());
-        outs() << "\n -------- Inner L0's Header Last Instruction (before) -------- \n" << lastInnerL0Header << "\n";
-        lastInnerL0Header.setOperand(1, innerL1->getLoopPreheader());
-        outs() << "\n -------- Inner L0's Header Last Instruction (after) -------- \n" << lastInnerL0Header << "\n";
+/*Fonde L1 in L0 aggiornando LoopInfo e ScalarEvolution, così che L0 resti
+valido per le fusioni successive della stessa catena. Il corpo di L1 viene
+eseguito dopo quello di L0 in ogni iterazione:
+1. Latch0 --> Header1 e Latch1 --> Header0
+2. Si esce dal loop fuso verso l'Exit Block di L1 (dal Latch1 se ruotati,
+dall'Header0 se non ruotati)
+3. I PHI dell'header di L1 vengono unificati con le variabili di induzione
+equivalenti di L0 o spostati nell'header di L0
+4. Con le guardie, la guardia di L0 salta direttamente dopo L1*/
+bool fuseLoops(Loop * L0, Loop * L1, LoopInfo & LI, ScalarEvolution & SE){
+  TimeTraceScope TimeScope("LoopFusionRewire");
 
-        BasicBlock * BBTopInnerL0 = topLoopBB(innerL0);
-        BasicBlock * BBTopInnerL1 = topLoopBB(innerL1);
-        BasicBlock * BBinnerL0Exit = innerL0->getExitBlock();
+  if(!L0 || !L1){
+    return false;
+  }
 
-        if(!checkLoopAdiacenti(BBinnerL0Exit, BBTopInnerL1)){
-          outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " NON sono Adiacenti -------- \n";
-          continue;
+  LoopShape S0, S1;
+  SmallVector<BasicBlock *, 4> between;
+  if(!getLoopShape(L0, S0) || !getLoopShape(L1, S1) || S0.rotated != S1.rotated || !collectBetweenBlocks(S0, S1, between)){
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "\n -------- Fusione di loop " << (S0.rotated ? "ruotati" : "non ruotati") << (S0.guard ? " con guardia" : "") << " -------- \n");
+
+  //Le variabili di induzione equivalenti si cercano prima di invalidare SCEV
+  DenseMap<PHINode *, PHINode *> equivalentIV;
+  for(PHINode & P1 : S1.header->phis()){
+    for(PHINode & P0 : S0.header->phis()){
+      if(isSameInductionVariable(&P0, L0, &P1, L1, SE)){
+        equivalentIV[&P1] = &P0;
+        break;
+      }
+    }
+  }
+
+  MDNode * loopID = L0->getLoopID();
+  BasicBlock * guardBlock0 = S0.guard ? S0.guard->getParent() : nullptr;
+  BasicBlock * guardBlock1 = S1.guard ? S1.guard->getParent() : nullptr;
+  BasicBlock * nonLoopBlock1 = S1.guard ? getGuardOtherSuccessor(S1.guard, S1.preHeader) : nullptr;
+
+  SE.forgetLoop(L0);
+  SE.forgetLoop(L1);
+
+  //1: Le istruzioni tra i due loop passano nel PreHeader (o nella Guardia) di L0
+  for(BasicBlock * BB : between){
+    while(PHINode * phi = dyn_cast<PHINode>(&BB->front())){
+      phi->replaceAllUsesWith(phi->getIncomingValue(0));
+      phi->eraseFromParent();
+    }
+
+    BasicBlock * destination = BB == guardBlock1 ? guardBlock0 : S0.preHeader;
+    for(Instruction & I : make_early_inc_range(*BB)){
+      if(I.isTerminator()){
+        break;
+      }
+      I.moveBefore(destination->getTerminator());
+    }
+  }
+
+  //2: I PHI di Header0 ricevono il valore della prossima iterazione da Latch1
+  for(PHINode & P0 : S0.header->phis()){
+    P0.setIncomingBlock(P0.getBasicBlockIndex(S0.latch), S1.latch);
+  }
+
+  for(PHINode & P1 : make_early_inc_range(S1.header->phis())){
+    Value * replacement = equivalentIV.lookup(&P1);
+    if(!replacement){
+      PHINode * phi = PHINode::Create(P1.getType(), 2, P1.getName(), S0.header->getFirstNonPHI());
+      phi->addIncoming(P1.getIncomingValueForBlock(S1.preHeader), S0.preHeader);
+      phi->addIncoming(P1.getIncomingValueForBlock(S1.latch), S1.latch);
+      replacement = phi;
+    }
+    LLVM_DEBUG(dbgs() << "\n -------- PHI " << P1.getName() << " di L1 sostituito da " << replacement->getName() << " -------- \n");
+    P1.replaceAllUsesWith(replacement);
+    P1.eraseFromParent();
+  }
+
+  //3: Latch0 --> Header1, Latch1 --> Header0
+  Instruction * latchBranch0 = S0.latch->getTerminator();
+  Value * exitCondition0 = S0.rotated ? cast<BranchInst>(latchBranch0)->getCondition() : nullptr;
+  BranchInst::Create(S1.header, latchBranch0);
+  latchBranch0->eraseFromParent();
+
+  S1.latch->getTerminator()->replaceUsesOfWith(S1.header, S0.header);
+  S1.latch->getTerminator()->setMetadata(LLVMContext::MD_loop, loopID);
+
+  //4: Se non ruotati si esce dall'Header0 verso l'Exit Block di L1
+  Value * exitCondition1 = nullptr;
+  if(!S0.rotated){
+    S0.header->getTerminator()->replaceUsesOfWith(S0.exitBlock, S1.exitBlock);
+
+    BranchInst * headerBranch1 = cast<BranchInst>(S1.header->getTerminator());
+    BasicBlock * body1 = getGuardOtherSuccessor(headerBranch1, S1.exitBlock);
+    exitCondition1 = headerBranch1->getCondition();
+    BranchInst::Create(body1, headerBranch1);
+    headerBranch1->eraseFromParent();
+
+    for(PHINode & phi : S1.exitBlock->phis()){
+      phi.setIncomingBlock(phi.getBasicBlockIndex(S1.header), S0.header);
+    }
+  }
+
+  //5: La guardia di L0 salta anche L1
+  Value * guardCondition1 = nullptr;
+  if(S0.guard){
+    guardCondition1 = S1.guard->getCondition();
+    S0.guard->replaceUsesOfWith(guardBlock1, nonLoopBlock1);
+    for(PHINode & phi : nonLoopBlock1->phis()){
+      phi.setIncomingBlock(phi.getBasicBlockIndex(guardBlock1), guardBlock0);
+    }
+  }
+
+  //Eliminazione dei basicblock non legati al resto
+  for(BasicBlock * BB : between){
+    LI.removeBlock(BB);
+    BB->dropAllReferences();
+  }
+  for(BasicBlock * BB : between){
+    BB->eraseFromParent();
+  }
+
+  RecursivelyDeleteTriviallyDeadInstructions(exitCondition0);
+  RecursivelyDeleteTriviallyDeadInstructions(exitCondition1);
+  RecursivelyDeleteTriviallyDeadInstructions(guardCondition1);
+
+  //I blocchi di L1 e i suoi loop interni passano a L0
+  SmallVector<BasicBlock *> blocks1(L1->blocks());
+  for(BasicBlock * BB : blocks1){
+    L0->addBlockEntry(BB);
+    L1->removeBlockFromLoop(BB);
+    if(LI.getLoopFor(BB) == L1){
+      LI.changeLoopFor(BB, L0);
+    }
+  }
+
+  while(!L1->isInnermost()){
+    Loop * child = *L1->begin();
+    L1->removeChildLoop(L1->begin());
+    L0->addChildLoop(child);
+  }
+
+  LI.erase(L1);
+
+  return true;
+}
+
+
+/*Insiemi di candidati alla fusione: loop fratelli, in ordine di programma,
+Control Flow Equivalenti e con lo stesso Trip Count. Vengono calcolati una
+sola volta prima di ogni trasformazione*/
+void buildFusionCandidateSets(SmallVectorImpl<Loop *> & siblings, DominatorTree & DT, PostDominatorTree & PDT, ScalarEvolution & SE, SmallVectorImpl<SmallVector<Loop *, 8>> & candidateSets){
+  TimeTraceScope TimeScope("LoopFusionCandidates");
+  for(Loop * loop : siblings){
+    // Loops without a preheader cannot be fused
+    BasicBlock * BBTopL1 = topLoopBB(loop);
+    if(!BBTopL1){
+      continue;
+    }
+    bool inserted = false;
+
+    for(SmallVector<Loop *, 8> & candidateSet : candidateSets){
+      Loop * L0 = candidateSet.front();
+      if(!checkLoopTripCount(SE, L0, loop)){
+        continue;
+      }
+      if(!checkLoopControlFlowEquivalent(DT, PDT, BBTopL1, topLoopBB(L0))){
+        continue;
+      }
+      candidateSet.push_back(loop);
+      inserted = true;
+      break;
+    }
+
+    if(!inserted){
+      candidateSets.emplace_back();
+      candidateSets.back().push_back(loop);
+    }
+  }
+}
+
+/*Conta le istruzioni del loop, per il budget sulle dimensioni*/
+unsigned countLoopInstructions(Loop * loop){
+  unsigned size = 0;
+  for(BasicBlock * BB : loop->blocks()){
+    size += BB->size();
+  }
+  return size;
+}
+
+/*Budget di compile time: la coppia viene scartata con un missed remark. L'ORE
+si chiede ogni volta perché le fusioni invalidano BlockFrequencyInfo*/
+void emitBudgetRemark(Loop * loop, StringRef name, StringRef message, unsigned budget, Function & F, FunctionAnalysisManager & AM){
+  LLVM_DEBUG(dbgs() << "\n -------- " << message << " (" << budget << ") -------- \n");
+  ++NumOverBudget;
+  OptimizationRemarkEmitter & ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  ORE.emit([&]() {
+    return OptimizationRemarkMissed(DEBUG_TYPE, name, loop->getStartLoc(), loop->getHeader())
+           << message << ", budget " << ore::NV("Budget", budget);
+  });
+}
+
+PreservedAnalyses LoopFusionPass::run(Function &F, FunctionAnalysisManager &AM) {
+
+  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+  DominatorTree &DT = AM.getResult<DominatorTreeAnalysis>(F);
+  PostDominatorTree &PDT = AM.getResult<PostDominatorTreeAnalysis>(F);
+  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+
+  int contNPasses = 0;
+  unsigned contFusions = 0;
+  bool budgetReached = false;
+  bool Transformed = false;
+  DependenceCache dependences;
+  dependences.maxQueries = FusionMaxDependenceQueries;
+  DiscardedRemarks discarded;
+
+  /*Si parte dai loop più esterni (LoopInfo li tiene in ordine inverso);
+  i figli di ogni loop vengono visitati dopo le fusioni del loro livello*/
+  SmallVector<SmallVector<Loop *, 8>> levels;
+  levels.emplace_back(LI.rbegin(), LI.rend());
+
+  // Scratch of each level, cleared and reused
+  DenseMap<Loop *, int> cont; //Numera i loop
+  SmallVector<SmallVector<Loop *, 8>> candidateSets;
+  SmallPtrSet<Loop *, 8> fused;
+
+  while(!levels.empty() && !budgetReached){
+    SmallVector<Loop *, 8> siblings = levels.pop_back_val();
+
+    cont.clear();
+    for(Loop * loop : siblings){
+      cont[loop] = cont.size();
+      myPrintLoop(loop, cont[loop]);
+    }
+
+    candidateSets.clear();
+    buildFusionCandidateSets(siblings, DT, PDT, SE, candidateSets);
+
+    fused.clear();
+    for(SmallVector<Loop *, 8> & candidateSet : candidateSets){
+      LLVM_DEBUG(dbgs() << "\n -------------------------------- Insieme N°" << contNPasses++ << ": " << candidateSet.size() << " loop -------------------------------- \n");
+
+      /*L0 è l'ultimo loop della catena: ogni fusione riusa il loop già fuso*/
+      Loop * L0 = candidateSet.front();
+      for(unsigned i = 1; i < candidateSet.size() && !budgetReached; ++i){
+        Loop * loop = candidateSet[i];
+        ++NumCandidatePairs;
+
+        if(FusionMaxFusions && contFusions == FusionMaxFusions){
+          emitBudgetRemark(loop, "FusionBudget", "loops not fused: the function reached the maximum number of fusions", FusionMaxFusions, F, AM);
+          budgetReached = true;
+          break;
         }
 
-        outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " sono Adiacenti -------- \n";
-        
-        if(!checkLoopControlFlowEquivalent(DT, PDT, BBTopInnerL0, BBTopInnerL1)){
-          outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " NON sono Control Flow Equivalenti -------- \n";
+        /*Punto 1: si assume che ci sia solo un successore, ovvero un solo
+        exitBlock*/
+        if(!checkLoopAdiacenti(bottomLoopBB(L0), topLoopBB(loop))){
+          LLVM_DEBUG(dbgs() << "\n -------- L" << cont[L0] << " e L" << cont[loop] << " NON sono Adiacenti -------- \n");
+          ++NumNotAdjacent;
+          L0 = loop;
           continue;
         }
-      
-        outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " sono Control Flow Equivalenti -------- \n";
 
-        //outs() << "\n -------- Loop Trip Count: " << TC1 << " --------- \n";
-        if(!checkLoopTripCount(SE, innerL0, innerL1)){
-          outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " NON hanno lo stesso Trip Count  -------- \n";
+        if(!checkLoopFusible(L0, loop)){
+          LLVM_DEBUG(dbgs() << "\n -------- L" << cont[L0] << " e L" << cont[loop] << " NON hanno una forma che permette la fusione -------- \n");
+          ++NumNotFusibleShape;
+          L0 = loop;
           continue;
         }
 
-        outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " hanno lo stesso Trip Count  -------- \n";
+        LLVM_DEBUG(dbgs() << "\n -------- L" << cont[L0] << " e L" << cont[loop] << " sono Adiacenti, Control Flow Equivalenti e hanno lo stesso Trip Count -------- \n");
 
-        if(checkDependence(innerL0, innerL1, DI, SE)){
-          outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " hanno delle istruzioni che dipendono tra di loro -------- \n";
+        /*Budget: le interrogazioni di dipendenza crescono col prodotto degli
+        accessi dei due loop*/
+        if(FusionMaxLoopInstructions && std::max(countLoopInstructions(L0), countLoopInstructions(loop)) > FusionMaxLoopInstructions){
+          emitBudgetRemark(L0, "LoopTooLarge", "loops not fused: too many instructions to analyze", FusionMaxLoopInstructions, F, AM);
+          L0 = loop;
           continue;
         }
 
-        outs() << "\n -------- Inner L" << (cont - 1) << " ed Inner L" << cont << " NON hanno delle istruzioni che dipendono tra di loro -------- \n";
+        /*Punto 4*/
+        if(checkDependence(L0, loop, DI, SE, dependences)){
+          if(dependences.exhausted){
+            emitBudgetRemark(L0, "DependenceBudget", "loops not fused: too many dependence queries, a dependence is assumed", FusionMaxDependenceQueries, F, AM);
+            L0 = loop;
+            continue;
+          }
+          LLVM_DEBUG(dbgs() << "\n -------- L" << cont[L0] << " e L" << cont[loop] << " hanno delle istruzioni che dipendono tra di loro -------- \n");
+          ++NumNegativeDependences;
+          L0 = loop;
+          continue;
+        }
 
-        fuseLoops(innerL0, innerL1);*/
-        //break;
-      }
-      
-    
-      /*Variabili si aggiornano solo al termine di una iterazione, 
-      in modo tale da contenere le informazioni della iterazione precedente*/
-    }
+        LLVM_DEBUG(dbgs() << "\n -------- L" << cont[L0] << " e L" << cont[loop] << " NON hanno delle istruzioni che dipendono tra di loro -------- \n");
 
-    
-    if(Transformed){
-      //outs() << "\n -------- STO PULENDO -------- \n";
-      AM.clear();
-     
-    /*  
-      if(AM.empty()){
-        outs() << "\n -------- VUOTO -------- \n";
-      }
-      
-      outs() << "\n -------- OTTENGO I RISULTATI --------\n";
-    */
+        /*VF previsti una volta per coppia, per il modello di profittabilità
+        e per la modalità fusione-poi-vettorizzazione*/
+        PredictedVF predicted;
+        predicted.known = predictLoopNestVF(L0, F, AM, discarded, predicted.VF0) && predictLoopNestVF(loop, F, AM, discarded, predicted.VF1);
 
-      /*"Aggiorna le analisi"*/
-      AM.getResult<LoopAnalysis>(F);
-      //AM.getResult<DominatorTreeAnalysis>(F);
-      //AM.getResult<PostDominatorTreeAnalysis>(F);
-      //AM.getResult<ScalarEvolutionAnalysis>(F);
-      //AM.getResult<DependenceAnalysis>(F);
+        if(!checkFusionProfitable(L0, loop, F, AM, DI, predicted)){
+          LLVM_DEBUG(dbgs() << "\n -------- La fusione di L" << cont[L0] << " e L" << cont[loop] << " NON è profittevole -------- \n");
+          ++NumNotProfitable;
+          L0 = loop;
+          continue;
+        }
 
-      cont = 0;
-      contNPasses++;
-      //levelLoop++;  
-    }
-    
-  }
+        LLVM_DEBUG(dbgs() << "\n -------- La fusione di L" << cont[L0] << " e L" << cont[loop] << " è profittevole -------- \n");
 
-  outs() << "\n -------------------------------- END -------------------------------- \n";
-  
-  /*
-  outs() << "\n---------- PROGRAM CFG ----------\n";
-  for (auto &BB : F) {
-    outs() << BB;
-  }
-  */
+        if(FusionKeepVectorizable && !checkFusionKeepsVectorization(L0, loop, F, AM, predicted)){
+          LLVM_DEBUG(dbgs() << "\n -------- La fusione di L" << cont[L0] << " e L" << cont[loop] << " renderebbe il loop meno vettorizzabile -------- \n");
+          ++NumLosingVectorization;
+          L0 = loop;
+          continue;
+        }
 
-  //LoopInfo & LI = LoopAnalysis::run(F, AM);
-  //AM.clear();
-/*
-  cont = 0;
-  myPrintLoop(L0, cont);
-*/
-  /*AM.getResult<LoopAnalysis>(F);
-  
-  cont = 0;
+        if(!fuseLoops(L0, loop, LI, SE)){
+          L0 = loop;
+          continue;
+        }
 
-  for(auto L = LI.rbegin(); L != LI.rend(); ++L){
-    Loop * loop = *L;
-    
-    //Stampa informazioni inerenti al Loop
+        Transformed = true;
+        ++NumFused;
+        contFusions++;
+        fused.insert(loop);
+        invalidateDependenceCache(dependences, L0);
+        invalidateDependenceCache(dependences, loop);
+
+        /*"Aggiorna le analisi": LoopInfo e ScalarEvolution sono aggiornati da
+        fuseLoops, i dominatori si ricalcolano e le analisi che dipendono dal
+        corpo dei loop vengono invalidate*/
+        TimeTraceScope TimeScope("LoopFusionUpdateAnalyses");
+        DT.recalculate(F);
+        PDT.recalculate(F);
+        PreservedAnalyses PA = PreservedAnalyses::all();
+        PA.abandon<LoopAccessAnalysis>();
+        PA.abandon<DemandedBitsAnalysis>();
+        PA.abandon<BlockFrequencyAnalysis>();
+        PA.abandon<BranchProbabilityAnalysis>();
+        AM.invalidate(F, PA);
+      }
+    }
 
-    myPrintLoop(loop, cont);
-    cont++;
+    /*I loop interni dei loop rimasti (anche di quelli fusi) formano il livello successivo*/
+    for(Loop * loop : siblings){
+      if(!fused.count(loop) && loop->getSubLoops().size() > 1){
+        levels.emplace_back(loop->begin(), loop->end());
+      }
+    }
   }
-  */
 
+  LLVM_DEBUG(dbgs() << "\n -------------------------------- END -------------------------------- \n");
+  NumDependenceQueries += dependences.queries;
 
   if(Transformed){
     return PreservedAnalyses::none();
   }
-  
 
-  /*for (auto Fiter = M.begin(); Fiter != M.end(); ++Fiter)
-    if (runOnFunction(*Fiter))
-      return PreservedAnalyses::none();
-  
-  return PreservedAnalyses::all();*/
   return PreservedAnalyses::all();
 }
-
@@ -12,8 +12,28 @@
 #include "llvm/IR/Dominators.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Analysis/LoopNestAnalysis.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/Delinearization.h"
+#include "llvm/Analysis/LoopCacheAnalysis.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/DemandedBits.h"
+#include "llvm/Analysis/LoopAccessAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Transforms/Vectorize/LoopVectorizationLegality.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/TimeProfiler.h"
 
 namespace llvm {
 
@@ -23,4 +43,81 @@ PreservedAnalyses run(Function &F, FunctionAnalysisManager  &AM);
 };
 
 } // namespace llvm
+
+/*Funzione di accesso di un'istruzione in memoria: array di base e pedici
+di ogni dimensione, dalla più esterna alla più interna*/
+struct AccessFunction {
+  const llvm::SCEV * base = nullptr;
+  llvm::Type * shape = nullptr;
+  llvm::SmallVector<const llvm::SCEV *, 4> subscripts;
+  // Number of elements of each dimension (nullptr if unknown), then the element size if delinearized
+  llvm::SmallVector<const llvm::SCEV *, 4> sizes;
+  // Size in the units of the subscript of the location touched in each dimension
+  llvm::SmallVector<const llvm::SCEV *, 4> extents;
+};
+
+/*Cache delle interrogazioni a DependenceInfo per una esecuzione del passo:
+per ogni loop, i suoi accessi in memoria (load, store e chiamate), raccolti
+una volta e riusati in tutte le coppie in cui il loop compare. Quando un loop
+viene fuso si invalidano solo le voci che lo riguardano.
+Oltre maxQueries interrogazioni per coppia di loop la dipendenza si assume.
+
+I risultati delle interrogazioni non si salvano: nella catena dei candidati
+ogni coppia (accesso di L0, accesso di L1) viene interrogata al più una volta
+per esecuzione. Dopo una fusione il loop fuso si confronta solo con loop che
+non ha ancora incontrato, dopo un rifiuto L1 diventa il nuovo L0: una mappa
+(src, dst, coppia di loop) non verrebbe mai letta.
+Le interrogazioni non vanno su un pool di thread: DependenceInfo,
+ScalarEvolution e AliasAnalysis riempiono le proprie cache mentre rispondono
+e non sono thread safe. Il costo resta limitato da maxQueries e dai limiti
+di LoopFusionPass sulle dimensioni dei loop*/
+struct DependenceCache {
+  llvm::DenseMap<const llvm::Loop *, llvm::SmallVector<llvm::Instruction *, 16>> accesses;
+  // Queries to DependenceInfo allowed in one checkDependence (0 = no limit)
+  unsigned maxQueries = 0;
+  // The last checkDependence ran out of queries and assumed a dependence
+  bool exhausted = false;
+  // Queries to DependenceInfo, counted by the pass that owns the cache
+  unsigned queries = 0;
+};
+
+/*OptimizationRemarkEmitter che scarta i remark: lavora su una funzione vuota
+in un contesto a parte, il cui gestore dei diagnostici ignora tutto*/
+struct DiscardedRemarks {
+  llvm::LLVMContext Ctx;
+  llvm::Module M;
+  llvm::Function * F;
+  llvm::OptimizationRemarkEmitter ORE;
+  DiscardedRemarks();
+};
+
+/*VF previsti per una coppia di candidati (0 = non vettorizzabile); known è
+falso se un loop più interno non è ruotato in forma LCSSA*/
+struct PredictedVF {
+  bool known = false;
+  unsigned VF0 = 0;
+  unsigned VF1 = 0;
+};
+
+/*Analisi condivise con LoopFissionPass, LoopTilingPass, LoopStrideInterchangePass e LoopJamPass*/
+void myPrintLoop(llvm::Loop * loop, int cont);
+llvm::BasicBlock * topLoopBB(llvm::Loop * loop);
+llvm::BasicBlock * bottomLoopBB(llvm::Loop * loop);
+bool getAccessFunction(llvm::Instruction * I, llvm::ScalarEvolution & SE, bool delinearizeAccess, AccessFunction & AF);
+bool isSameAccessShape(AccessFunction & AF0, AccessFunction & AF1);
+bool getSubscriptRecurrence(const llvm::SCEV * subscript, const llvm::Loop * L, llvm::ScalarEvolution & SE, const llvm::SCEV *& start, const llvm::SCEV *& step);
+const llvm::Value * getAccessBase(const llvm::Value * ptr);
+unsigned countHeaderPHIs(llvm::Loop * loop);
+bool isDistanceNegative(std::unique_ptr<llvm::Dependence> &dep, const llvm::Loop *L0, const llvm::Loop *L1, llvm::ScalarEvolution &SE);
+bool isSameArray(llvm::Instruction * I0, llvm::Instruction * I1);
+bool predictLoopNestVF(llvm::Loop * loop, llvm::Function & F, llvm::FunctionAnalysisManager & AM, DiscardedRemarks & discarded, unsigned & nestVF);
+bool isLoopNestVectorizable(llvm::Loop * loop, llvm::Function & F, llvm::FunctionAnalysisManager & AM, DiscardedRemarks & discarded);
+bool checkLoopAdiacenti(llvm::BasicBlock * loopSuccessor0, llvm::BasicBlock * BBTopL1);
+bool checkLoopTripCount(llvm::ScalarEvolution & SE, llvm::Loop * L0, llvm::Loop * L1);
+bool checkLoopFusible(llvm::Loop * L0, llvm::Loop * L1);
+bool checkDependence(const llvm::Loop *L0, const llvm::Loop *L1, llvm::DependenceInfo &DI, llvm::ScalarEvolution &SE, DependenceCache &cache);
+void invalidateDependenceCache(DependenceCache & cache, const llvm::Loop * loop);
+unsigned estimateBodyPressure(llvm::Loop * loop, llvm::SmallPtrSetImpl<const llvm::Value *> & invariants);
+bool fuseLoops(llvm::Loop * L0, llvm::Loop * L1, llvm::LoopInfo & LI, llvm::ScalarEvolution & SE);
+
 #endif // LLVM_TRANSFORMS_TESTPASS _H
@@ -0,0 +1,195 @@
+//===-- LoopJamPass.cpp - Example Transformations --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/LoopJamPass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loopjampass"
+
+static cl::opt<unsigned> JamMaxFactor(
+    "loopjampass-max-factor", cl::init(8), cl::Hidden,
+    cl::desc("Maximum unroll factor of the outer loop"));
+
+/*Sceglie il fattore di unroll del loop esterno: la più grande potenza di 2
+per cui il corpo del loop interno, replicato, sta ancora nei registri.
+Dopo il jam le copie condividono la IV e i valori definiti fuori dal nido,
+mentre si moltiplicano i temporanei, le altre PHI e i valori del loop esterno*/
+unsigned chooseJamFactor(Loop * outer, Loop * inner, ScalarEvolution & SE, TargetTransformInfo & TTI){
+  unsigned tripCount = SE.getSmallConstantTripCount(outer);
+
+  SmallPtrSet<const Value *, 16> invariants;
+  unsigned body = estimateBodyPressure(inner, invariants);
+  unsigned phis = countHeaderPHIs(inner);
+  unsigned outerValues = 0;
+  for(const Value * V : invariants){
+    const Instruction * I = dyn_cast<Instruction>(V);
+    if(I && outer->contains(I)){
+      outerValues++;
+    }
+  }
+  unsigned shared = invariants.size() - outerValues + 1;
+  unsigned numRegs = TTI.getNumberOfRegisters(TTI.getRegisterClassForType(false));
+
+  unsigned factor = 1;
+  for(unsigned U = 2; U <= JamMaxFactor; U *= 2){
+    // Unrolling by the whole trip count would leave no outer loop
+    if(tripCount && U >= tripCount){
+      break;
+    }
+
+    unsigned pressure = shared + U * (outerValues + phis - 1 + body);
+    LLVM_DEBUG(dbgs() << "\n -------- Fattore " << U << ": pressione " << pressure << " su " << numRegs << " registri -------- \n");
+    if(pressure > numRegs){
+      break;
+    }
+    factor = U;
+  }
+  return factor;
+}
+
+/*Fonde le copie del loop interno prodotte dall'unroll, in ordine di
+programma, con i controlli e la fusione di LoopFusionPass: ogni copia viene
+fusa nel loop ottenuto dalla fusione precedente. Restituisce il numero di
+copie fuse*/
+unsigned jamInnerLoops(Loop * outer, LoopInfo & LI, DominatorTree & DT, ScalarEvolution & SE, DependenceInfo & DI){
+  SmallVector<Loop *, 8> copies(outer->begin(), outer->end());
+  std::sort(copies.begin(), copies.end(), [&](Loop * A, Loop * B) {
+    return A != B && DT.dominates(A->getHeader(), B->getHeader());
+  });
+
+  // The unrolled latch stays between the exit of a copy and the preheader of the next
+  for(unsigned i = 1; i < copies.size(); ++i){
+    while(BasicBlock * preHeader = copies[i]->getLoopPreheader()){
+      if(preHeader == copies[i - 1]->getExitBlock() || !MergeBlockIntoPredecessor(preHeader, nullptr, &LI)){
+        break;
+      }
+    }
+  }
+  DT.recalculate(*outer->getHeader()->getParent());
+
+  DependenceCache dependences;
+  unsigned jammed = 0;
+  Loop * L0 = copies.front();
+  for(unsigned i = 1; i < copies.size(); ++i){
+    Loop * loop = copies[i];
+    if(!checkLoopAdiacenti(bottomLoopBB(L0), topLoopBB(loop))){
+      LLVM_DEBUG(dbgs() << "\n -------- Le copie " << i - 1 << " e " << i << " NON sono Adiacenti -------- \n");
+      break;
+    }
+    if(!checkLoopTripCount(SE, L0, loop) || !checkLoopFusible(L0, loop)){
+      LLVM_DEBUG(dbgs() << "\n -------- Le copie " << i - 1 << " e " << i << " NON hanno una forma che permette la fusione -------- \n");
+      break;
+    }
+    if(checkDependence(L0, loop, DI, SE, dependences)){
+      LLVM_DEBUG(dbgs() << "\n -------- Le copie " << i - 1 << " e " << i << " hanno delle istruzioni che dipendono tra di loro -------- \n");
+      break;
+    }
+    if(!fuseLoops(L0, loop, LI, SE)){
+      break;
+    }
+
+    jammed++;
+    invalidateDependenceCache(dependences, L0);
+    invalidateDependenceCache(dependences, loop);
+    DT.recalculate(*outer->getHeader()->getParent());
+  }
+  return jammed;
+}
+
+PreservedAnalyses LoopJamPass::run(Function &F, FunctionAnalysisManager &AM) {
+
+  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+  DominatorTree &DT = AM.getResult<DominatorTreeAnalysis>(F);
+  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+  AssumptionCache &AC = AM.getResult<AssumptionAnalysis>(F);
+  TargetTransformInfo &TTI = AM.getResult<TargetIRAnalysis>(F);
+  OptimizationRemarkEmitter &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+  bool Transformed = false;
+  int cont = 0;
+
+  /*Candidati: loop con un solo figlio, più interno e perfettamente annidato.
+  Vengono raccolti prima dell'unroll, che modifica LoopInfo*/
+  SmallVector<Loop *, 4> candidates;
+  for(Loop * loop : LI.getLoopsInPreorder()){
+    if(loop->getSubLoops().size() == 1 && loop->getSubLoops().front()->isInnermost() && LoopNest::arePerfectlyNested(*loop, *loop->getSubLoops().front(), SE)){
+      candidates.push_back(loop);
+    }
+  }
+
+  for(Loop * outer : candidates){
+    Loop * inner = outer->getSubLoops().front();
+    LLVM_DEBUG(dbgs() << "\n ------------------------ Nido N" << cont << " ------------------------ \n");
+    myPrintLoop(outer, cont++);
+
+    if(!outer->isLoopSimplifyForm() || !outer->isRotatedForm()){
+      LLVM_DEBUG(dbgs() << "\n -------- Il loop esterno NON è ruotato in Loop Simplify Form -------- \n");
+      continue;
+    }
+
+    /*Il jam esegue le iterazioni i, i + 1, ... del loop esterno all'interno
+    della stessa iterazione del loop interno: è legale quando lo è lo scambio
+    dei due loop*/
+    SmallVector<CanonicalLoop, 2> nest(2);
+    if(!getCanonicalLoop(outer, SE, nest[0]) || !getCanonicalLoop(inner, SE, nest[1])){
+      LLVM_DEBUG(dbgs() << "\n -------- Un loop del nido NON è in forma canonica -------- \n");
+      continue;
+    }
+    unsigned interchanged[] = {1, 0};
+    if(!checkInterchangeLegal(nest, interchanged, DI)){
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotJammed", outer->getStartLoc(), outer->getHeader())
+               << "a dependence prevents jamming the inner loop copies";
+      });
+      continue;
+    }
+
+    unsigned factor = chooseJamFactor(outer, inner, SE, TTI);
+    if(factor < 2){
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotJammed", outer->getStartLoc(), outer->getHeader())
+               << "not enough registers to unroll the outer loop";
+      });
+      continue;
+    }
+
+    // A trip count that is not a multiple of the factor needs a remainder loop
+    UnrollLoopOptions ULO;
+    ULO.Count = factor;
+    ULO.Force = false;
+    ULO.Runtime = SE.getSmallConstantTripMultiple(outer) % factor != 0;
+    ULO.AllowExpensiveTripCount = false;
+    ULO.UnrollRemainder = false;
+    ULO.ForgetAllSCEV = false;
+
+    LLVM_DEBUG(dbgs() << "\n -------- Unroll del loop esterno di un fattore " << factor << (ULO.Runtime ? " con loop di resto" : "") << " -------- \n");
+    bool preserveLCSSA = outer->isRecursivelyLCSSAForm(DT, LI);
+    if(UnrollLoop(outer, ULO, &LI, &SE, &DT, &AC, &TTI, &ORE, preserveLCSSA) != LoopUnrollResult::PartiallyUnrolled){
+      LLVM_DEBUG(dbgs() << "\n -------- Unroll NON riuscito -------- \n");
+      continue;
+    }
+    Transformed = true;
+
+    unsigned jammed = jamInnerLoops(outer, LI, DT, SE, DI);
+    LLVM_DEBUG(dbgs() << "\n -------- Copie del loop interno fuse: " << jammed + 1 << " su " << factor << " -------- \n");
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Jammed", outer->getStartLoc(), outer->getHeader())
+             << "unrolled outer loop by " << ore::NV("UnrollCount", factor) << " and jammed "
+             << ore::NV("JammedCopies", jammed + 1) << " inner loop copies";
+    });
+  }
+
+  LLVM_DEBUG(dbgs() << "\n -------------------------------- END -------------------------------- \n");
+
+  if(Transformed){
+    return PreservedAnalyses::none();
+  }
+  return PreservedAnalyses::all();
+}
@@ -0,0 +1,15 @@
+#ifndef LLVM_TRANSFORMS_LOOPJAM_H
+#define LLVM_TRANSFORMS_LOOPJAM_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/LoopStrideInterchangePass.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
+
+namespace llvm {
+
+class LoopJamPass : public PassInfoMixin<LoopJamPass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager  &AM);
+};
+
+} // namespace llvm
+#endif // LLVM_TRANSFORMS_LOOPJAM_H
@@ -0,0 +1,421 @@
+//===-- LoopStrideInterchangePass.cpp - Example Transformations --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/LoopStrideInterchangePass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loopstrideinterchangepass"
+
+static cl::opt<unsigned> InterchangeMaxDepth(
+    "loopstrideinterchangepass-max-depth", cl::init(4), cl::Hidden,
+    cl::desc("Maximum depth of the loop nests whose orders are all evaluated"));
+
+/*Nido perfetto da riordinare: i loop dal più esterno al più interno, il costo
+di ciascun loop se messo in posizione più interna e l'ordine scelto
+(order[p] = indice del loop originale che va in posizione p)*/
+struct InterchangeCandidate {
+  SmallVector<CanonicalLoop, 4> loops;
+  SmallVector<uint64_t, 4> costs;
+  SmallVector<unsigned, 4> order;
+};
+
+/*Controlla se il valore dipende dalla IV del loop L: le espressioni SCEV
+dipendono da L se contengono una ricorrenza su L, i valori caricati se
+l'indirizzo da cui si legge dipende da L*/
+bool dependsOnLoop(const SCEV * S, const Loop * L, ScalarEvolution & SE){
+  return SCEVExprContains(S, [&](const SCEV * expr) {
+    if(const SCEVAddRecExpr * addRec = dyn_cast<SCEVAddRecExpr>(expr)){
+      return addRec->getLoop() == L;
+    }
+    if(const SCEVUnknown * unknown = dyn_cast<SCEVUnknown>(expr)){
+      Instruction * I = dyn_cast<Instruction>(unknown->getValue());
+      if(!I || !L->contains(I)){
+        return false;
+      }
+      LoadInst * load = dyn_cast<LoadInst>(I);
+      return !load || dependsOnLoop(SE.getSCEV(load->getPointerOperand()), L, SE);
+    }
+    return false;
+  });
+}
+
+/*Passo in byte con cui l'indirizzo avanza a ogni iterazione del loop L,
+tenendo ferme le IV degli altri loop. Restituisce nullptr se il passo non
+è esprimibile (ad esempio righe di un int** lette in memoria)*/
+const SCEV * getLoopStride(const SCEV * S, const Loop * L, ScalarEvolution & SE){
+  Type * Ty = SE.getEffectiveSCEVType(S->getType());
+  if(!dependsOnLoop(S, L, SE)){
+    return SE.getZero(Ty);
+  }
+
+  if(const SCEVAddRecExpr * addRec = dyn_cast<SCEVAddRecExpr>(S)){
+    if(!addRec->isAffine() || dependsOnLoop(addRec->getStepRecurrence(SE), L, SE)){
+      return nullptr;
+    }
+    if(addRec->getLoop() == L){
+      return dependsOnLoop(addRec->getStart(), L, SE) ? nullptr : addRec->getStepRecurrence(SE);
+    }
+    return getLoopStride(addRec->getStart(), L, SE);
+  }
+
+  if(const SCEVAddExpr * add = dyn_cast<SCEVAddExpr>(S)){
+    const SCEV * stride = SE.getZero(Ty);
+    for(const SCEV * op : add->operands()){
+      const SCEV * opStride = getLoopStride(op, L, SE);
+      if(!opStride){
+        return nullptr;
+      }
+      stride = SE.getAddExpr(stride, SE.getTruncateOrSignExtend(opStride, Ty));
+    }
+    return stride;
+  }
+
+  if(const SCEVMulExpr * mul = dyn_cast<SCEVMulExpr>(S)){
+    // Only a single factor may vary with the loop
+    const SCEV * stride = nullptr;
+    SmallVector<const SCEV *, 4> factors;
+    for(const SCEV * op : mul->operands()){
+      if(!dependsOnLoop(op, L, SE)){
+        factors.push_back(op);
+        continue;
+      }
+      if(stride){
+        return nullptr;
+      }
+      stride = getLoopStride(op, L, SE);
+      if(!stride){
+        return nullptr;
+      }
+      factors.push_back(stride);
+    }
+    return SE.getMulExpr(factors);
+  }
+
+  return nullptr;
+}
+
+/*Costo di un loop messo in posizione più interna: per ogni accesso in
+memoria i byte della linea di cache consumati a ogni iterazione, cioè il passo
+limitato alla dimensione della linea. Gli accessi con passo unitario costano
+la dimensione dell'elemento, quelli invarianti nulla, quelli con passo
+sconosciuto un'intera linea*/
+uint64_t getLoopStrideCost(Loop * outer, const Loop * L, ScalarEvolution & SE, uint64_t lineSize){
+  uint64_t cost = 0;
+  for(BasicBlock * BB : outer->blocks()){
+    for(Instruction & I : *BB){
+      if(!isa<LoadInst>(I) && !isa<StoreInst>(I)){
+        continue;
+      }
+
+      const SCEV * stride = getLoopStride(SE.getSCEV(getLoadStorePointerOperand(&I)), L, SE);
+      const SCEVConstant * constantStride = dyn_cast_or_null<SCEVConstant>(stride);
+      if(!constantStride){
+        cost += lineSize;
+        continue;
+      }
+      cost += std::min<uint64_t>(constantStride->getAPInt().abs().getLimitedValue(), lineSize);
+    }
+  }
+  return cost;
+}
+
+/*Controlla che il nido rispetti le condizioni per scambiare i ruoli delle IV:
+1. Nido rettangolare: start e limiti invarianti nel loop più esterno, stesso tipo
+2. Una sola PHI per header (nessuna riduzione attraverso i loop)
+3. I loop ruotati o con uscita su != eseguono almeno un'iterazione
+4. Le IV e i loro incrementi sono usati fuori dal controllo dei loop solo nel
+   corpo del loop più interno*/
+bool checkInterchangeable(ArrayRef<CanonicalLoop> loops, ScalarEvolution & SE){
+  Loop * outer = loops.front().loop;
+  Loop * inner = loops.back().loop;
+  for(const CanonicalLoop & CL : loops){
+    Value * bound = CL.exitCmp->getOperand(CL.boundIdx);
+    if(!outer->isLoopInvariant(CL.start) || !outer->isLoopInvariant(bound) || CL.IV->getType() != loops.front().IV->getType() || CL.isSigned != loops.front().isSigned){
+      LLVM_DEBUG(dbgs() << "\n -------- Il nido NON è rettangolare -------- \n");
+      return false;
+    }
+
+    if(countHeaderPHIs(CL.loop) != 1){
+      LLVM_DEBUG(dbgs() << "\n -------- L'header contiene PHI oltre alla IV -------- \n");
+      return false;
+    }
+
+    if(CL.exitCmp->getParent() != CL.loop->getHeader() || CL.exitCmp->isEquality()){
+      ICmpInst::Predicate pred = CL.isSigned ? ICmpInst::ICMP_SLT : ICmpInst::ICMP_ULT;
+      if(!SE.isKnownPredicate(pred, SE.getSCEV(CL.start), SE.getSCEV(bound))){
+        LLVM_DEBUG(dbgs() << "\n -------- Non è garantito che il loop esegua almeno un'iterazione -------- \n");
+        return false;
+      }
+    }
+
+    Value * inc = CL.IV->getIncomingValueForBlock(CL.loop->getLoopLatch());
+    for(Value * V : {(Value *)CL.IV, inc}){
+      for(User * U : V->users()){
+        if(U == CL.IV || U == inc || U == CL.exitCmp){
+          continue;
+        }
+        Instruction * I = cast<Instruction>(U);
+        if(!inner->contains(I) || isa<PHINode>(I)){
+          LLVM_DEBUG(dbgs() << "\n -------- IV usata fuori dal corpo del loop più interno: " << *I << " -------- \n");
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/*Direzioni di una dipendenza sui livelli dei loop, normalizzate in modo che
+la prima direzione diversa da = sia < (sorgente eseguita prima)*/
+void getNormalizedDirections(Dependence & dep, SmallVectorImpl<unsigned> & directions){
+  directions.clear();
+  for(unsigned level = 1; level <= dep.getLevels(); ++level){
+    directions.push_back(dep.getDirection(level));
+  }
+
+  for(unsigned dir : directions){
+    if(dir == Dependence::DVEntry::EQ){
+      continue;
+    }
+    if(dir == Dependence::DVEntry::GT){
+      for(unsigned & d : directions){
+        d = (d & Dependence::DVEntry::EQ) | ((d & Dependence::DVEntry::LT) ? Dependence::DVEntry::GT : 0) | ((d & Dependence::DVEntry::GT) ? Dependence::DVEntry::LT : 0);
+      }
+    }
+    break;
+  }
+}
+
+/*Il nuovo ordine è legale se ogni vettore di direzione, permutato, resta
+lessicograficamente positivo: la prima direzione diversa da = (o <=) deve
+essere <, mai > o *. Gli accessi in memoria sono confrontati con
+DependenceInfo, coppia per coppia con almeno una scrittura*/
+bool checkInterchangeLegal(ArrayRef<CanonicalLoop> loops, ArrayRef<unsigned> order, DependenceInfo & DI){
+  SmallVector<Instruction *, 16> accesses;
+  for(BasicBlock * BB : loops.front().loop->blocks()){
+    for(Instruction & I : *BB){
+      if(isa<LoadInst>(I) || isa<StoreInst>(I)){
+        accesses.push_back(&I);
+      }
+      else if(I.mayReadOrWriteMemory()){
+        LLVM_DEBUG(dbgs() << "\n -------- Istruzione con accessi in memoria sconosciuti: " << I << " -------- \n");
+        return false;
+      }
+    }
+  }
+
+  unsigned firstLevel = loops.front().loop->getLoopDepth();
+  for(unsigned a = 0; a < accesses.size(); ++a){
+    for(unsigned b = a; b < accesses.size(); ++b){
+      if(!accesses[a]->mayWriteToMemory() && !accesses[b]->mayWriteToMemory()){
+        continue;
+      }
+
+      std::unique_ptr<Dependence> dep = DI.depends(accesses[a], accesses[b], true);
+      if(!dep || dep->isInput()){
+        continue;
+      }
+      if(dep->isConfused() || dep->getLevels() < firstLevel + loops.size() - 1){
+        LLVM_DEBUG(dbgs() << "\n -------- Dipendenza sconosciuta tra: " << *accesses[a] << " e " << *accesses[b] << " -------- \n");
+        return false;
+      }
+
+      SmallVector<unsigned, 8> directions;
+      getNormalizedDirections(*dep, directions);
+
+      // Loops enclosing the nest keep their position
+      SmallVector<unsigned, 8> permuted(directions.begin(), directions.end());
+      for(unsigned p = 0; p < order.size(); ++p){
+        permuted[firstLevel - 1 + p] = directions[firstLevel - 1 + order[p]];
+      }
+
+      for(unsigned dir : permuted){
+        if(dir == Dependence::DVEntry::EQ || dir == Dependence::DVEntry::LE){
+          continue;
+        }
+        if(dir & Dependence::DVEntry::GT){
+          LLVM_DEBUG(dbgs() << "\n -------- Dipendenza che impedisce lo scambio tra: " << *accesses[a] << " e " << *accesses[b] << " -------- \n");
+          return false;
+        }
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+/*Sceglie l'ordine legale migliore tra tutte le permutazioni del nido: si
+confrontano i costi dal loop più interno verso l'esterno, così il loop con
+più accessi a passo unitario finisce in posizione più interna. Se nessun
+ordine migliore è legale resta l'ordine originale*/
+void chooseLoopOrder(InterchangeCandidate & IC, DependenceInfo & DI){
+  unsigned depth = IC.loops.size();
+  auto key = [&](ArrayRef<unsigned> order) {
+    SmallVector<uint64_t, 4> costs;
+    for(int p = depth - 1; p >= 0; --p){
+      costs.push_back(IC.costs[order[p]]);
+    }
+    return costs;
+  };
+
+  SmallVector<SmallVector<unsigned, 4>, 24> orders;
+  SmallVector<unsigned, 4> order;
+  for(unsigned k = 0; k < depth; ++k){
+    order.push_back(k);
+  }
+  do{
+    orders.push_back(order);
+  } while(std::next_permutation(order.begin(), order.end()));
+
+  // The original order comes first among orders with the same cost
+  std::stable_sort(orders.begin(), orders.end(), [&](const SmallVector<unsigned, 4> & A, const SmallVector<unsigned, 4> & B) {
+    return key(A) < key(B);
+  });
+
+  IC.order.clear();
+  for(unsigned k = 0; k < depth; ++k){
+    IC.order.push_back(k);
+  }
+  for(SmallVector<unsigned, 4> & candidate : orders){
+    if(candidate == IC.order || key(candidate) == key(IC.order)){
+      return;
+    }
+    if(checkInterchangeLegal(IC.loops, candidate, DI)){
+      IC.order = candidate;
+      return;
+    }
+  }
+}
+
+/*Scambio dei loop senza toccare il CFG: il loop in posizione p percorre
+l'intervallo [start, bound) del loop order[p] e nel corpo del loop più interno
+gli usi della IV (e dell'incremento) di order[p] diventano usi della IV di p*/
+void interchangeLoops(InterchangeCandidate & IC){
+  unsigned depth = IC.loops.size();
+  SmallVector<Value *, 4> starts;
+  SmallVector<Value *, 4> bounds;
+  SmallVector<std::pair<Use *, Value *>, 16> uses;
+  for(unsigned p = 0; p < depth; ++p){
+    CanonicalLoop & from = IC.loops[IC.order[p]];
+    CanonicalLoop & to = IC.loops[p];
+    starts.push_back(from.start);
+    bounds.push_back(from.exitCmp->getOperand(from.boundIdx));
+
+    Value * fromInc = from.IV->getIncomingValueForBlock(from.loop->getLoopLatch());
+    Value * toInc = to.IV->getIncomingValueForBlock(to.loop->getLoopLatch());
+    for(std::pair<Value *, Value *> replacement : {std::make_pair((Value *)from.IV, (Value *)to.IV), std::make_pair(fromInc, toInc)}){
+      for(Use & U : replacement.first->uses()){
+        if(IC.loops.back().loop->contains(cast<Instruction>(U.getUser())) && U.getUser() != from.IV && U.getUser() != fromInc && U.getUser() != from.exitCmp){
+          uses.push_back(std::make_pair(&U, replacement.second));
+        }
+      }
+    }
+  }
+
+  for(std::pair<Use *, Value *> & use : uses){
+    use.first->set(use.second);
+  }
+
+  for(unsigned p = 0; p < depth; ++p){
+    CanonicalLoop & CL = IC.loops[p];
+    CL.IV->setIncomingValueForBlock(CL.loop->getLoopPreheader(), starts[p]);
+    CL.exitCmp->setOperand(CL.boundIdx, bounds[p]);
+  }
+}
+
+PreservedAnalyses LoopStrideInterchangePass::run(Function &F, FunctionAnalysisManager &AM) {
+
+  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+  TargetTransformInfo &TTI = AM.getResult<TargetIRAnalysis>(F);
+  OptimizationRemarkEmitter &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+  bool Transformed = false;
+  int cont = 0;
+  uint64_t lineSize = TTI.getCacheLineSize() ? TTI.getCacheLineSize() : 64;
+
+  /*I nidi vengono analizzati tutti prima di modificare il codice*/
+  SmallVector<InterchangeCandidate, 2> candidates;
+  SmallPtrSet<Loop *, 8> visited;
+  for(Loop * loop : LI.getLoopsInPreorder()){
+    if(visited.count(loop)){
+      continue;
+    }
+
+    SmallVector<Loop *, 4> nest;
+    collectPerfectNest(loop, SE, nest);
+    visited.insert(nest.begin(), nest.end());
+    if(nest.size() < 2 || nest.size() > InterchangeMaxDepth || !nest.back()->isInnermost()){
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "\n ------------------------ Nido N" << cont << ": " << nest.size() << " loop ------------------------ \n");
+    myPrintLoop(loop, cont++);
+
+    InterchangeCandidate IC;
+    bool canonical = true;
+    for(Loop * L : nest){
+      CanonicalLoop CL;
+      canonical &= getCanonicalLoop(L, SE, CL);
+      IC.loops.push_back(CL);
+    }
+    if(!canonical){
+      LLVM_DEBUG(dbgs() << "\n -------- Un loop del nido NON è in forma canonica -------- \n");
+      continue;
+    }
+
+    if(!checkInterchangeable(IC.loops, SE)){
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "\n -------- Costo dei loop in posizione più interna:");
+    for(CanonicalLoop & CL : IC.loops){
+      IC.costs.push_back(getLoopStrideCost(loop, CL.loop, SE, lineSize));
+      LLVM_DEBUG(dbgs() << " " << IC.costs.back());
+    }
+    LLVM_DEBUG(dbgs() << " -------- \n");
+
+    chooseLoopOrder(IC, DI);
+    if(std::is_sorted(IC.order.begin(), IC.order.end())){
+      LLVM_DEBUG(dbgs() << "\n -------- L'ordine originale è già il migliore (o l'unico legale) -------- \n");
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotInterchanged", loop->getStartLoc(), loop->getHeader())
+               << "no legal loop order has more unit-stride inner accesses";
+      });
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "\n -------- Nuovo ordine:");
+    for(unsigned k : IC.order){
+      LLVM_DEBUG(dbgs() << " " << k);
+    }
+    LLVM_DEBUG(dbgs() << " -------- \n");
+    candidates.push_back(std::move(IC));
+  }
+
+  for(InterchangeCandidate & IC : candidates){
+    Loop * outer = IC.loops.front().loop;
+    unsigned innermost = IC.order.back();
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Interchanged", outer->getStartLoc(), outer->getHeader())
+             << "interchanged loop nest, loop " << ore::NV("Loop", innermost) << " is now innermost";
+    });
+    interchangeLoops(IC);
+    Transformed = true;
+  }
+
+  LLVM_DEBUG(dbgs() << "\n -------------------------------- END -------------------------------- \n");
+
+  if(Transformed){
+    return PreservedAnalyses::none();
+  }
+  return PreservedAnalyses::all();
+}
@@ -0,0 +1,17 @@
+#ifndef LLVM_TRANSFORMS_LOOPSTRIDEINTERCHANGE_H
+#define LLVM_TRANSFORMS_LOOPSTRIDEINTERCHANGE_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/LoopTilingPass.h"
+
+namespace llvm {
+
+class LoopStrideInterchangePass : public PassInfoMixin<LoopStrideInterchangePass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager  &AM);
+};
+
+} // namespace llvm
+
+/*Analisi condivise con LoopJamPass*/
+bool checkInterchangeLegal(llvm::ArrayRef<CanonicalLoop> loops, llvm::ArrayRef<unsigned> order, llvm::DependenceInfo & DI);
+#endif // LLVM_TRANSFORMS_LOOPSTRIDEINTERCHANGE_H
@@ -0,0 +1,634 @@
+//===-- LoopTilingPass.cpp - Example Transformations --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/LoopTilingPass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "looptilingpass"
+
+static cl::opt<unsigned> TilingCacheSize(
+    "looptilingpass-cache-size", cl::init(0), cl::Hidden,
+    cl::desc("Size in bytes of the cache the tiles must fit in (0 = L2 size from the target, or 256 KiB)"));
+
+static cl::opt<unsigned> TilingCacheUse(
+    "looptilingpass-cache-use", cl::init(50), cl::Hidden,
+    cl::desc("Percentage of the cache the working set of a tile may occupy"));
+
+static cl::opt<unsigned> TilingTileSize(
+    "looptilingpass-tile-size", cl::init(0), cl::Hidden,
+    cl::desc("Fixed tile size for every loop of the nest (0 = computed from the cache model)"));
+
+/*Lato massimo dei blocchi quando il numero di iterazioni non è noto*/
+static const unsigned MaxTileSize = 1 << 16;
+
+/*Nido perfetto da dividere in blocchi: i loop dal più esterno al più interno
+e la regione di codice (Guardia/PreHeader fino al blocco che segue il nido)
+che i loop dei blocchi racchiudono. Del blocco entry solo il branch finale
+entra nei loop dei blocchi, il resto viene eseguito una volta prima*/
+struct TilingCandidate {
+  SmallVector<CanonicalLoop, 4> loops;
+  BasicBlock * entry = nullptr;
+  BasicBlock * exit = nullptr;
+  SmallPtrSet<BasicBlock *, 16> region;
+  unsigned tileSize = 0;
+  // Loop invariant starts and bounds computed inside the region
+  SmallVector<Instruction *, 4> hoist;
+};
+
+/*Riconosce la forma canonica del loop:
+1. Loop Simplify Form con un solo Exiting Block (header o latch)
+2. Il branch di uscita resta nel loop sul ramo vero
+3. Il confronto è tra la IV (IV + 1 nel latch dei loop ruotati) e un limite
+invariante, con < o !=
+4. La IV è {start,+,1}*/
+bool getCanonicalLoop(Loop * loop, ScalarEvolution & SE, CanonicalLoop & CL){
+  if(!loop->isLoopSimplifyForm() || !loop->getExitBlock()){
+    return false;
+  }
+
+  BasicBlock * exiting = loop->getExitingBlock();
+  if(!exiting || (exiting != loop->getHeader() && exiting != loop->getLoopLatch())){
+    return false;
+  }
+
+  BranchInst * exitBranch = dyn_cast<BranchInst>(exiting->getTerminator());
+  if(!exitBranch || !exitBranch->isConditional() || !loop->contains(exitBranch->getSuccessor(0))){
+    return false;
+  }
+
+  ICmpInst * cmp = dyn_cast<ICmpInst>(exitBranch->getCondition());
+  if(!cmp){
+    return false;
+  }
+
+  for(unsigned idx = 0; idx < 2; ++idx){
+    Value * op = cmp->getOperand(idx);
+    Value * bound = cmp->getOperand(1 - idx);
+    if(!loop->isLoopInvariant(bound)){
+      continue;
+    }
+
+    // The header tests the IV, the latch of a rotated loop its increment
+    PHINode * IV = dyn_cast<PHINode>(op);
+    BinaryOperator * inc = dyn_cast<BinaryOperator>(op);
+    if(exiting == loop->getLoopLatch() && exiting != loop->getHeader()){
+      IV = nullptr;
+      if(inc && inc->getOpcode() == Instruction::Add && isa<ConstantInt>(inc->getOperand(1)) && cast<ConstantInt>(inc->getOperand(1))->isOne()){
+        IV = dyn_cast<PHINode>(inc->getOperand(0));
+      }
+    }
+    if(!IV || IV->getParent() != loop->getHeader() || IV->getNumIncomingValues() != 2){
+      continue;
+    }
+
+    const SCEVAddRecExpr * AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(IV));
+    if(!AR || AR->getLoop() != loop || !AR->isAffine() || !AR->getStepRecurrence(SE)->isOne()){
+      continue;
+    }
+
+    ICmpInst::Predicate pred = idx == 0 ? cmp->getPredicate() : cmp->getSwappedPredicate();
+    if(pred != ICmpInst::ICMP_SLT && pred != ICmpInst::ICMP_ULT && pred != ICmpInst::ICMP_NE){
+      continue;
+    }
+
+    CL.loop = loop;
+    CL.IV = IV;
+    CL.start = IV->getIncomingValueForBlock(loop->getLoopPreheader());
+    CL.exitCmp = cmp;
+    CL.boundIdx = 1 - idx;
+    CL.isSigned = pred != ICmpInst::ICMP_ULT;
+    return true;
+  }
+
+  return false;
+}
+
+/*Nido perfetto a partire da outer: si scende finché il loop ha un solo figlio
+perfettamente annidato. Il nido deve terminare con un loop più interno*/
+void collectPerfectNest(Loop * outer, ScalarEvolution & SE, SmallVectorImpl<Loop *> & nest){
+  nest.push_back(outer);
+  while(nest.back()->getSubLoops().size() == 1){
+    Loop * inner = nest.back()->getSubLoops().front();
+    if(!LoopNest::arePerfectlyNested(*nest.back(), *inner, SE)){
+      break;
+    }
+    nest.push_back(inner);
+  }
+}
+
+/*Distanza di dipendenza lungo un loop: un valore noto oppure qualsiasi (*)*/
+struct NestDistance {
+  bool known = false;
+  int64_t value = 0;
+};
+
+/*Scompone il pedice come c + somma dei coeff[l] * IV[l], dal loop più interno
+al più esterno, con le ricorrenze di LoopFusionPass*/
+bool decomposeSubscript(const SCEV * subscript, ArrayRef<CanonicalLoop> loops, ScalarEvolution & SE, SmallVectorImpl<const SCEV *> & coeffs, const SCEV *& constant){
+  coeffs.assign(loops.size(), nullptr);
+  for(int l = loops.size() - 1; l >= 0; --l){
+    const SCEV * start;
+    const SCEV * step;
+    if(!getSubscriptRecurrence(subscript, loops[l].loop, SE, start, step)){
+      return false;
+    }
+    coeffs[l] = step;
+    subscript = start;
+  }
+  constant = subscript;
+  return true;
+}
+
+/*Vettore delle distanze di dipendenza tra A e B sui loop del nido, risolvendo
+per ogni dimensione coeff * d = cA - cB quando i due accessi hanno gli stessi
+coefficienti. Restituisce false se gli accessi sono sicuramente indipendenti*/
+bool getNestDistances(Instruction * A, Instruction * B, ArrayRef<CanonicalLoop> loops, ScalarEvolution & SE, SmallVectorImpl<NestDistance> & distances){
+  distances.assign(loops.size(), NestDistance());
+
+  AccessFunction AFA;
+  AccessFunction AFB;
+  bool delinearizeAccess = getAccessFunction(A, SE, true, AFA) && getAccessFunction(B, SE, true, AFB) && isSameAccessShape(AFA, AFB);
+  if(!delinearizeAccess){
+    AFA = AccessFunction();
+    AFB = AccessFunction();
+    if(!getAccessFunction(A, SE, false, AFA) || !getAccessFunction(B, SE, false, AFB) || !isSameAccessShape(AFA, AFB)){
+      return true;
+    }
+  }
+
+  // A base loaded in the nest (a row of int **a) changes at every iteration
+  if(!SE.isLoopInvariant(AFA.base, loops.front().loop)){
+    return true;
+  }
+
+  for(unsigned k = 0; k < AFA.subscripts.size(); ++k){
+    SmallVector<const SCEV *, 4> coeffsA;
+    SmallVector<const SCEV *, 4> coeffsB;
+    const SCEV * constantA;
+    const SCEV * constantB;
+    if(!decomposeSubscript(AFA.subscripts[k], loops, SE, coeffsA, constantA) || !decomposeSubscript(AFB.subscripts[k], loops, SE, coeffsB, constantB)){
+      return true;
+    }
+
+    // Loops whose IV appears in the subscript of this dimension
+    SmallVector<unsigned, 4> involved;
+    bool uniform = true;
+    for(unsigned l = 0; l < loops.size(); ++l){
+      if(!coeffsA[l]->isZero() || !coeffsB[l]->isZero()){
+        involved.push_back(l);
+        uniform &= coeffsA[l] == coeffsB[l];
+      }
+    }
+
+    Type * Ty = SE.getWiderType(constantA->getType(), constantB->getType());
+    const SCEVConstant * difference = dyn_cast<SCEVConstant>(SE.getMinusSCEV(SE.getNoopOrSignExtend(constantA, Ty), SE.getNoopOrSignExtend(constantB, Ty)));
+
+    if(involved.empty()){
+      if(difference && !difference->isZero()){
+        return false;
+      }
+      continue;
+    }
+
+    // Coupled or non uniform subscripts leave the distances unknown
+    if(!uniform || involved.size() > 1){
+      continue;
+    }
+
+    unsigned l = involved.front();
+    const SCEVConstant * coeff = dyn_cast<SCEVConstant>(coeffsA[l]);
+    if(!difference || !coeff){
+      continue;
+    }
+
+    int64_t num = difference->getAPInt().getSExtValue();
+    int64_t den = coeff->getAPInt().getSExtValue();
+    if(num % den){
+      continue;
+    }
+
+    if(distances[l].known && distances[l].value != num / den){
+      return false;
+    }
+    distances[l].known = true;
+    distances[l].value = num / den;
+  }
+
+  return true;
+}
+
+/*Distanze di dipendenza ricavate da DependenceInfo per accessi ad array
+diversi che possono essere lo stesso: conta solo il segno, < e > diventano
+le distanze 1 e -1*/
+void getDependenceDistances(Dependence & dep, unsigned firstLevel, ArrayRef<CanonicalLoop> loops, SmallVectorImpl<NestDistance> & distances){
+  distances.assign(loops.size(), NestDistance());
+  for(unsigned l = 0; l < loops.size(); ++l){
+    unsigned level = firstLevel + l;
+    unsigned dir = dep.getDirection(level);
+    if(const SCEVConstant * distance = dyn_cast_or_null<SCEVConstant>(dep.getDistance(level))){
+      distances[l].known = true;
+      distances[l].value = distance->getAPInt().getSExtValue();
+    }
+    else if(dir == Dependence::DVEntry::EQ || dir == Dependence::DVEntry::LT || dir == Dependence::DVEntry::GT){
+      distances[l].known = true;
+      distances[l].value = dir == Dependence::DVEntry::LT ? 1 : dir == Dependence::DVEntry::GT ? -1 : 0;
+    }
+  }
+}
+
+/*Il tiling è legale se il nido è completamente permutabile: nessuna
+dipendenza può avere una distanza positiva su un loop e negativa su un altro.
+Solo le coppie che DependenceInfo dimostra indipendenti sono ignorate*/
+bool checkTilingLegal(Loop * outer, ArrayRef<CanonicalLoop> loops, ScalarEvolution & SE, DependenceInfo & DI){
+  SmallVector<Instruction *, 16> accesses;
+  for(BasicBlock * BB : outer->blocks()){
+    for(Instruction & I : *BB){
+      if(isa<LoadInst>(I) || isa<StoreInst>(I)){
+        accesses.push_back(&I);
+      }
+      else if(I.mayReadOrWriteMemory()){
+        LLVM_DEBUG(dbgs() << "\n -------- Istruzione con accessi in memoria sconosciuti: " << I << " -------- \n");
+        return false;
+      }
+    }
+  }
+
+  unsigned firstLevel = outer->getLoopDepth();
+  for(unsigned a = 0; a < accesses.size(); ++a){
+    for(unsigned b = a; b < accesses.size(); ++b){
+      Instruction * A = accesses[a];
+      Instruction * B = accesses[b];
+      if(!A->mayWriteToMemory() && !B->mayWriteToMemory()){
+        continue;
+      }
+
+      // Pointer parameters may alias: only NoAlias pairs are independent
+      std::unique_ptr<Dependence> dep = DI.depends(A, B, true);
+      if(!dep || dep->isInput()){
+        continue;
+      }
+      if(dep->isConfused() || dep->getLevels() < firstLevel + loops.size() - 1){
+        LLVM_DEBUG(dbgs() << "\n -------- Dipendenza sconosciuta tra: " << *A << " e " << *B << " -------- \n");
+        return false;
+      }
+
+      SmallVector<NestDistance, 4> distances;
+      if(!isSameArray(A, B)){
+        getDependenceDistances(*dep, firstLevel, loops, distances);
+      }
+      else if(!getNestDistances(A, B, loops, SE, distances)){
+        continue;
+      }
+
+      bool canBePositive = false;
+      bool canBeNegative = false;
+      for(unsigned l = 0; l < loops.size(); ++l){
+        bool positive = !distances[l].known || distances[l].value > 0;
+        bool negative = !distances[l].known || distances[l].value < 0;
+        if((positive && canBeNegative) || (negative && canBePositive) || (positive && negative && (canBePositive || canBeNegative))){
+          LLVM_DEBUG(dbgs() << "\n -------- Dipendenza che impedisce il tiling tra: " << *A << " e " << *B << " -------- \n");
+          return false;
+        }
+        canBePositive |= positive;
+        canBeNegative |= negative;
+      }
+    }
+  }
+
+  return true;
+}
+
+/*Modello della cache: la dimensione del blocco è il più grande multiplo
+della linea di cache per cui l'insieme di lavoro di un blocco (per ogni array
+il prodotto dei lati dei loop che ne indicizzano i pedici) sta nella frazione
+di cache disponibile. Restituisce 0 se l'intero nido sta già in cache*/
+unsigned chooseTileSize(Loop * outer, ArrayRef<CanonicalLoop> loops, ScalarEvolution & SE, TargetTransformInfo & TTI, const DataLayout & DL){
+  uint64_t cacheSize = TilingCacheSize;
+  if(!cacheSize){
+    cacheSize = 256 * 1024;
+    if(auto L2 = TTI.getCacheSize(TargetTransformInfo::CacheLevel::L2D)){
+      cacheSize = *L2;
+    }
+  }
+  uint64_t budget = cacheSize * TilingCacheUse / 100;
+  uint64_t lineSize = TTI.getCacheLineSize() ? TTI.getCacheLineSize() : 64;
+
+  // For every array: element size and mask of the loops indexing it
+  DenseMap<const Value *, std::pair<uint64_t, unsigned>> arrays;
+  for(BasicBlock * BB : outer->blocks()){
+    for(Instruction & I : *BB){
+      if(!isa<LoadInst>(I) && !isa<StoreInst>(I)){
+        continue;
+      }
+
+      std::pair<uint64_t, unsigned> & array = arrays[getAccessBase(getLoadStorePointerOperand(&I))];
+      array.first = std::max<uint64_t>(array.first, DL.getTypeStoreSize(getLoadStoreType(&I)).getFixedValue());
+      const SCEV * ptr = SE.getSCEV(getLoadStorePointerOperand(&I));
+      for(unsigned l = 0; l < loops.size(); ++l){
+        if(!SE.isLoopInvariant(ptr, loops[l].loop)){
+          array.second |= 1 << l;
+        }
+      }
+    }
+  }
+
+  // Without arrays indexed by the loops the working set does not grow with the tiles
+  if(none_of(arrays, [](auto & entry) { return entry.second.second != 0; })){
+    return 0;
+  }
+
+  auto footprint = [&](ArrayRef<uint64_t> sides) -> uint64_t {
+    uint64_t bytes = 0;
+    for(auto & entry : arrays){
+      uint64_t elements = 1;
+      for(unsigned l = 0; l < loops.size(); ++l){
+        if(entry.second.second & (1 << l)){
+          elements = SaturatingMultiply(elements, sides[l]);
+        }
+      }
+      bytes = SaturatingAdd(bytes, SaturatingMultiply(elements, entry.second.first));
+    }
+    return bytes;
+  };
+
+  // A nest with known trip counts that already fits needs no tiling
+  SmallVector<uint64_t, 4> tripCounts;
+  for(const CanonicalLoop & TL : loops){
+    unsigned tripCount = SE.getSmallConstantTripCount(TL.loop);
+    if(tripCount){
+      tripCounts.push_back(tripCount);
+    }
+  }
+  if(tripCounts.size() == loops.size() && footprint(tripCounts) <= budget){
+    return 0;
+  }
+
+  if(TilingTileSize){
+    return TilingTileSize;
+  }
+
+  uint64_t elementSize = 1;
+  for(auto & entry : arrays){
+    elementSize = std::max(elementSize, entry.second.first);
+  }
+  unsigned lineElements = std::max<uint64_t>(lineSize / elementSize, 1);
+
+  // Tiles do not grow past the longest loop, or MaxTileSize if a trip count is unknown
+  uint64_t maxTileSize = MaxTileSize;
+  if(tripCounts.size() == loops.size()){
+    maxTileSize = *std::max_element(tripCounts.begin(), tripCounts.end());
+  }
+
+  unsigned tileSize = lineElements;
+  SmallVector<uint64_t, 4> sides(loops.size(), 2 * tileSize);
+  while(tileSize < maxTileSize && footprint(sides) <= budget){
+    tileSize *= 2;
+    sides.assign(loops.size(), 2 * tileSize);
+  }
+  return tileSize;
+}
+
+/*Regione a singolo ingresso e singola uscita occupata dal nido: dalla
+Guardia/PreHeader del loop esterno fino al blocco che lo segue (escluso).
+Le istruzioni di entry (tranne il branch) restano fuori dalla regione, gli
+altri blocchi fuori dal loop esterno vengono rieseguiti per ogni blocco e non
+devono accedere alla memoria né avere effetti collaterali.
+I valori calcolati nella regione non devono essere usati fuori; start e
+limiti devono essere disponibili prima della regione, eventualmente spostando
+le istruzioni senza effetti collaterali che li calcolano*/
+bool buildTilingRegion(TilingCandidate & TC){
+  Loop * outer = TC.loops.front().loop;
+  TC.entry = topLoopBB(outer);
+  TC.exit = bottomLoopBB(outer);
+  if(!TC.entry || !TC.exit || isa<PHINode>(TC.exit->front())){
+    return false;
+  }
+
+  SmallVector<BasicBlock *, 16> worklist;
+  worklist.push_back(TC.entry);
+  while(!worklist.empty()){
+    BasicBlock * BB = worklist.pop_back_val();
+    if(BB == TC.exit || !TC.region.insert(BB).second){
+      continue;
+    }
+    for(BasicBlock * succ : successors(BB)){
+      worklist.push_back(succ);
+    }
+  }
+
+  for(BasicBlock * BB : TC.region){
+    if(BB == TC.entry){
+      continue;
+    }
+    for(BasicBlock * pred : predecessors(BB)){
+      if(!TC.region.count(pred)){
+        return false;
+      }
+    }
+  }
+
+  for(BasicBlock * BB : TC.region){
+    if(BB == TC.entry || outer->contains(BB)){
+      continue;
+    }
+    for(Instruction & I : *BB){
+      if(isa<AllocaInst>(I) || I.mayReadOrWriteMemory() || I.mayHaveSideEffects()){
+        LLVM_DEBUG(dbgs() << "\n -------- Istruzione che verrebbe ripetuta per ogni blocco: " << I << " -------- \n");
+        return false;
+      }
+    }
+  }
+
+  for(BasicBlock * BB : TC.region){
+    if(BB == TC.entry){
+      continue;
+    }
+    for(Instruction & I : *BB){
+      for(User * U : I.users()){
+        if(!TC.region.count(cast<Instruction>(U)->getParent())){
+          return false;
+        }
+      }
+    }
+  }
+
+  for(CanonicalLoop & TL : TC.loops){
+    for(Value * V : {TL.start, TL.exitCmp->getOperand(TL.boundIdx)}){
+      Instruction * I = dyn_cast<Instruction>(V);
+      if(!I || !TC.region.count(I->getParent()) || I->getParent() == TC.entry || is_contained(TC.hoist, I)){
+        continue;
+      }
+      if(isa<PHINode>(I) || I->mayReadOrWriteMemory() || I->mayHaveSideEffects()){
+        return false;
+      }
+      for(Value * operand : I->operands()){
+        Instruction * def = dyn_cast<Instruction>(operand);
+        if(def && TC.region.count(def->getParent()) && def->getParent() != TC.entry){
+          return false;
+        }
+      }
+      TC.hoist.push_back(I);
+    }
+  }
+
+  return true;
+}
+
+/*Strip-mining di ogni loop e interscambio dei loop dei blocchi verso l'esterno:
+per (ii, jj, ...) i loop dei blocchi avanzano di tileSize e racchiudono la
+regione; ogni loop originale parte dalla IV del suo blocco e termina a
+IV del blocco + min(limite - IV del blocco, tileSize), senza overflow*/
+void tileLoopNest(TilingCandidate & TC, Function & F, LoopInfo & LI){
+  LLVMContext & Ctx = F.getContext();
+  unsigned depth = TC.loops.size();
+
+  // Only the branch of the Guard/PreHeader is repeated for every tile
+  BasicBlock * entry = SplitBlock(TC.entry, TC.entry->getTerminator(), static_cast<DominatorTree *>(nullptr), &LI);
+  TC.region.erase(TC.entry);
+  TC.region.insert(entry);
+  TC.entry = entry;
+
+  BasicBlock * preHeader = BasicBlock::Create(Ctx, "tile.ph", &F, TC.entry);
+  SmallVector<BasicBlock *, 4> headers;
+  SmallVector<BasicBlock *, 4> latches;
+  for(unsigned k = 0; k < depth; ++k){
+    headers.push_back(BasicBlock::Create(Ctx, "tile.header", &F, TC.entry));
+    latches.push_back(BasicBlock::Create(Ctx, "tile.latch", &F, TC.entry));
+  }
+
+  SmallVector<BasicBlock *, 4> preds(predecessors(TC.entry));
+  for(BasicBlock * pred : preds){
+    pred->getTerminator()->replaceUsesOfWith(TC.entry, preHeader);
+  }
+
+  BranchInst::Create(headers.front(), preHeader);
+  for(Instruction * I : TC.hoist){
+    I->moveBefore(preHeader->getTerminator());
+  }
+
+  for(unsigned k = 0; k < depth; ++k){
+    CanonicalLoop & TL = TC.loops[k];
+    Value * bound = TL.exitCmp->getOperand(TL.boundIdx);
+    ICmpInst::Predicate pred = TL.isSigned ? ICmpInst::ICMP_SLT : ICmpInst::ICMP_ULT;
+    Constant * tileSize = ConstantInt::get(TL.IV->getType(), TC.tileSize);
+
+    IRBuilder<> Builder(headers[k]);
+    PHINode * tileIV = Builder.CreatePHI(TL.IV->getType(), 2, "tile.iv");
+    tileIV->addIncoming(TL.start, k == 0 ? preHeader : headers[k - 1]);
+    Value * inTile = Builder.CreateICmp(pred, tileIV, bound, "tile.cond");
+    // In the tile tileIV < bound: bound - tileIV is exact as an unsigned value
+    Value * remaining = Builder.CreateSub(bound, tileIV, "tile.remaining");
+    Value * tileSide = Builder.CreateSelect(Builder.CreateICmpULT(remaining, tileSize), remaining, tileSize, "tile.side");
+    Value * tileBound = Builder.CreateAdd(tileIV, tileSide, "tile.bound");
+    Builder.CreateCondBr(inTile, k + 1 < depth ? headers[k + 1] : TC.entry, k == 0 ? TC.exit : latches[k - 1]);
+
+    // The next tile starts at the bound of this one, which never wraps
+    Builder.SetInsertPoint(latches[k]);
+    tileIV->addIncoming(tileBound, latches[k]);
+    Builder.CreateBr(headers[k]);
+
+    //Il loop originale percorre solo il suo blocco
+    TL.IV->setIncomingValueForBlock(TL.loop->getLoopPreheader(), tileIV);
+    TL.exitCmp->setOperand(TL.boundIdx, tileBound);
+  }
+
+  for(BasicBlock * BB : TC.region){
+    BB->getTerminator()->replaceUsesOfWith(TC.exit, latches.back());
+  }
+}
+
+PreservedAnalyses LoopTilingPass::run(Function &F, FunctionAnalysisManager &AM) {
+
+  LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+  ScalarEvolution &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  DependenceInfo &DI = AM.getResult<DependenceAnalysis>(F);
+  TargetTransformInfo &TTI = AM.getResult<TargetIRAnalysis>(F);
+  OptimizationRemarkEmitter &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  bool Transformed = false;
+  int cont = 0;
+
+  /*I nidi vengono analizzati tutti prima di modificare il codice*/
+  SmallVector<TilingCandidate, 2> candidates;
+  SmallPtrSet<Loop *, 8> visited;
+  for(Loop * loop : LI.getLoopsInPreorder()){
+    if(visited.count(loop)){
+      continue;
+    }
+
+    SmallVector<Loop *, 4> nest;
+    collectPerfectNest(loop, SE, nest);
+    visited.insert(nest.begin(), nest.end());
+    if(nest.size() < 2 || !nest.back()->isInnermost()){
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "\n ------------------------ Nido N" << cont << ": " << nest.size() << " loop ------------------------ \n");
+    myPrintLoop(loop, cont++);
+
+    TilingCandidate TC;
+    bool canonical = true;
+    for(Loop * L : nest){
+      CanonicalLoop TL;
+      canonical &= getCanonicalLoop(L, SE, TL);
+      TC.loops.push_back(TL);
+    }
+    if(!canonical){
+      LLVM_DEBUG(dbgs() << "\n -------- Un loop del nido NON è in forma canonica -------- \n");
+      continue;
+    }
+
+    if(!buildTilingRegion(TC)){
+      LLVM_DEBUG(dbgs() << "\n -------- Il nido NON è una regione a singolo ingresso e singola uscita -------- \n");
+      continue;
+    }
+
+    if(!checkTilingLegal(loop, TC.loops, SE, DI)){
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotTiled", loop->getStartLoc(), loop->getHeader())
+               << "loop nest is not fully permutable";
+      });
+      continue;
+    }
+
+    unsigned tileSize = chooseTileSize(loop, TC.loops, SE, TTI, DL);
+    if(!tileSize){
+      LLVM_DEBUG(dbgs() << "\n -------- Il nido sta già in cache -------- \n");
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotTiled", loop->getStartLoc(), loop->getHeader())
+               << "loop nest already fits in the cache";
+      });
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "\n -------- Blocchi di lato " << tileSize << " -------- \n");
+    TC.tileSize = tileSize;
+    candidates.push_back(std::move(TC));
+  }
+
+  for(TilingCandidate & TC : candidates){
+    Loop * outer = TC.loops.front().loop;
+    unsigned depth = TC.loops.size();
+    unsigned tileSize = TC.tileSize;
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Tiled", outer->getStartLoc(), outer->getHeader())
+             << "tiled loop nest of depth " << ore::NV("Depth", depth) << " with tile size " << ore::NV("TileSize", tileSize);
+    });
+    tileLoopNest(TC, F, LI);
+    Transformed = true;
+  }
+
+  LLVM_DEBUG(dbgs() << "\n -------------------------------- END -------------------------------- \n");
+
+  if(Transformed){
+    return PreservedAnalyses::none();
+  }
+  return PreservedAnalyses::all();
+}
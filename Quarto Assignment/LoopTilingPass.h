@@ -0,0 +1,31 @@
+#ifndef LLVM_TRANSFORMS_LOOPTILING_H
+#define LLVM_TRANSFORMS_LOOPTILING_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/LoopFusionPass.h"
+#include "llvm/IR/IRBuilder.h"
+
+namespace llvm {
+
+class LoopTilingPass : public PassInfoMixin<LoopTilingPass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager  &AM);
+};
+
+} // namespace llvm
+
+/*Loop del nido in forma canonica: variabile di induzione che parte da start
+con passo 1 che percorre [start, bound)*/
+struct CanonicalLoop {
+  llvm::Loop * loop = nullptr;
+  llvm::PHINode * IV = nullptr;
+  llvm::Value * start = nullptr;
+  llvm::ICmpInst * exitCmp = nullptr;
+  unsigned boundIdx = 0;
+  bool isSigned = true;
+};
+
+/*Analisi condivise con LoopInterchangePass*/
+bool getCanonicalLoop(llvm::Loop * loop, llvm::ScalarEvolution & SE, CanonicalLoop & CL);
+void collectPerfectNest(llvm::Loop * outer, llvm::ScalarEvolution & SE, llvm::SmallVectorImpl<llvm::Loop *> & nest);
+
+#endif // LLVM_TRANSFORMS_LOOPTILING_H
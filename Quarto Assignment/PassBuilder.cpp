@@ -243,6 +243,13 @@
 #include "llvm/Transforms/Utils/LocalOptsPersonal.h"
 #include "llvm/Transforms/Utils/LoopWalk.h"
 #include "llvm/Transforms/Utils/LoopFusionPass.h"
+#include "llvm/Transforms/Utils/LoopFissionPass.h"
+#include "llvm/Transforms/Utils/LoopTilingPass.h"
+#include "llvm/Transforms/Utils/LoopStrideInterchangePass.h"
+#include "llvm/Transforms/Utils/LoopJamPass.h"
+#include "llvm/Transforms/Utils/DataflowAnalyses.h"
+#include "llvm/Transforms/Utils/SparseConstantPropagation.h"
+#include "llvm/Transforms/Utils/LazyCodeMotionPass.h"
 #include "llvm/Transforms/Utils/LoopSimplify.h"
 #include "llvm/Transforms/Utils/LoopVersioning.h"
 #include "llvm/Transforms/Utils/LowerGlobalDtors.h"
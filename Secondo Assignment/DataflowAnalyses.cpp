@@ -0,0 +1,427 @@
+//===-- DataflowAnalyses.cpp - Example Analyses --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/DataflowAnalyses.h"
+
+using namespace llvm;
+
+AnalysisKey VeryBusyExpressionsAnalysis::Key;
+AnalysisKey DataflowDominatorsAnalysis::Key;
+AnalysisKey ConstantPropagationAnalysis::Key;
+
+/*Stampa un blocco come operando (%nome)*/
+void printBlockName(raw_ostream &OS, const BasicBlock * BB){
+  BB->printAsOperand(OS, false);
+}
+
+/*Stampa gli elementi di un insieme, in ordine di indice*/
+template <typename PrintElementT>
+void printSet(raw_ostream &OS, const DataflowSet & set, PrintElementT printElement){
+  OS << "{";
+  for(unsigned idx : set.set_bits()){
+    OS << " ";
+    printElement(idx);
+  }
+  OS << " }";
+}
+
+//===----------------------------------------------------------------------===//
+// Very Busy Expressions
+//===----------------------------------------------------------------------===//
+
+/*Le espressioni considerate sono le operazioni binarie e i confronti*/
+bool isDataflowExpression(const Instruction & I){
+  return isa<BinaryOperator>(I) || isa<CmpInst>(I);
+}
+
+/*Due istruzioni calcolano la stessa espressione se hanno lo stesso opcode,
+lo stesso predicato e gli stessi operandi (in qualsiasi ordine se commutativa)*/
+ExpressionKey getExpressionKey(const Instruction & I){
+  const Value * op0 = I.getOperand(0);
+  const Value * op1 = I.getOperand(1);
+  if(I.isCommutative() && std::less<const Value *>()(op1, op0)){
+    std::swap(op0, op1);
+  }
+  unsigned predicate = isa<CmpInst>(I) ? cast<CmpInst>(I).getPredicate() : 0;
+  return std::make_tuple(I.getOpcode(), predicate, op0, op1);
+}
+
+/*Formalizzazione:
+1. Dominio: insieme delle espressioni, analisi Backward
+2. Transfer: IN[B] = gen[B] ∪ (OUT[B] - kill[B]), dove gen sono le
+   espressioni valutate in B con operandi definiti fuori da B e kill quelle
+   che usano un valore definito in B
+3. Meet: intersezione; valore al confine (uscite) vuoto, inizializzazione
+   con tutte le espressioni*/
+VeryBusyExpressionsInfo VeryBusyExpressionsAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  VeryBusyExpressionsInfo Info;
+
+  DenseMap<ExpressionKey, unsigned> ids;
+  DenseMap<const Value *, SmallVector<unsigned, 4>> users;
+  for(BasicBlock & BB : F){
+    for(Instruction & I : BB){
+      if(!isDataflowExpression(I)){
+        continue;
+      }
+      auto inserted = ids.insert(std::make_pair(getExpressionKey(I), Info.expressions.size()));
+      if(!inserted.second){
+        continue;
+      }
+      Info.expressions.push_back(&I);
+      for(Value * operand : I.operands()){
+        users[operand].push_back(inserted.first->second);
+      }
+    }
+  }
+
+  BitVectorDataflowProblem<DataflowDirection::Backward, true> problem;
+  problem.size = Info.expressions.size();
+  for(BasicBlock & BB : F){
+    DataflowSet & gen = problem.gen[&BB];
+    DataflowSet & kill = problem.kill[&BB];
+    gen = DataflowSet(problem.size);
+    kill = DataflowSet(problem.size);
+
+    for(Instruction & I : BB){
+      if(isDataflowExpression(I)){
+        bool definedOutside = none_of(I.operands(), [&](Value * operand) {
+          Instruction * def = dyn_cast<Instruction>(operand);
+          return def && def->getParent() == &BB;
+        });
+        if(definedOutside){
+          gen.set(ids[getExpressionKey(I)]);
+        }
+      }
+
+      auto found = users.find(&I);
+      if(found != users.end()){
+        for(unsigned id : found->second){
+          kill.set(id);
+        }
+      }
+    }
+  }
+
+  Info.result = solveDataflow(F, problem);
+  return Info;
+}
+
+bool VeryBusyExpressionsInfo::isVeryBusyAtEntry(const BasicBlock * BB, const Instruction * expression) const {
+  auto found = result.in.find(BB);
+  if(found == result.in.end() || !isDataflowExpression(*expression)){
+    return false;
+  }
+  ExpressionKey key = getExpressionKey(*expression);
+  for(unsigned idx : found->second.set_bits()){
+    if(getExpressionKey(*expressions[idx]) == key){
+      return true;
+    }
+  }
+  return false;
+}
+
+void VeryBusyExpressionsInfo::print(raw_ostream &OS) const {
+  auto printExpression = [&](unsigned idx) {
+    const Instruction * I = expressions[idx];
+    OS << I->getOpcodeName();
+    if(const CmpInst * cmp = dyn_cast<CmpInst>(I)){
+      OS << " " << CmpInst::getPredicateName(cmp->getPredicate());
+    }
+    OS << "(";
+    I->getOperand(0)->printAsOperand(OS, false);
+    OS << ", ";
+    I->getOperand(1)->printAsOperand(OS, false);
+    OS << ")";
+  };
+
+  for(const BasicBlock & BB : *expressions.front()->getFunction()){
+    if(!result.in.count(&BB)){
+      continue;
+    }
+    OS << "  ";
+    printBlockName(OS, &BB);
+    OS << ":\n    IN:  ";
+    printSet(OS, result.in.lookup(&BB), printExpression);
+    OS << "\n    OUT: ";
+    printSet(OS, result.out.lookup(&BB), printExpression);
+    OS << "\n";
+  }
+}
+
+PreservedAnalyses VeryBusyExpressionsPrinterPass::run(Function &F, FunctionAnalysisManager &AM) {
+  VeryBusyExpressionsInfo &Info = AM.getResult<VeryBusyExpressionsAnalysis>(F);
+  OS << "Very Busy Expressions di '" << F.getName() << "' (" << Info.result.iterations << " iterazioni, " << Info.result.skipped << " saltate):\n";
+  if(!Info.expressions.empty()){
+    Info.print(OS);
+  }
+  return PreservedAnalyses::all();
+}
+
+//===----------------------------------------------------------------------===//
+// Dominator Analysis
+//===----------------------------------------------------------------------===//
+
+/*Formalizzazione:
+1. Dominio: insieme dei blocchi, analisi Forward
+2. Transfer: OUT[B] = {B} ∪ IN[B]
+3. Meet: intersezione; valore al confine (entry) vuoto, inizializzazione
+   con tutti i blocchi*/
+DataflowDominatorsInfo DataflowDominatorsAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  DataflowDominatorsInfo Info;
+  for(BasicBlock & BB : F){
+    Info.index[&BB] = Info.blocks.size();
+    Info.blocks.push_back(&BB);
+  }
+
+  BitVectorDataflowProblem<DataflowDirection::Forward, true> problem;
+  problem.size = Info.blocks.size();
+  for(BasicBlock & BB : F){
+    DataflowSet & gen = problem.gen[&BB];
+    gen = DataflowSet(problem.size);
+    gen.set(Info.index[&BB]);
+  }
+
+  Info.result = solveDataflow(F, problem);
+  return Info;
+}
+
+bool DataflowDominatorsInfo::dominates(const BasicBlock * A, const BasicBlock * B) const {
+  auto found = result.out.find(B);
+  // As in DominatorTree, unreachable blocks are dominated by every block
+  if(found == result.out.end()){
+    return true;
+  }
+  return found->second.test(index.lookup(A));
+}
+
+void DataflowDominatorsInfo::print(raw_ostream &OS) const {
+  auto printBlock = [&](unsigned idx) {
+    printBlockName(OS, blocks[idx]);
+  };
+
+  for(const BasicBlock * BB : blocks){
+    if(!result.out.count(BB)){
+      continue;
+    }
+    OS << "  ";
+    printBlockName(OS, BB);
+    OS << ": dominato da ";
+    printSet(OS, result.out.lookup(BB), printBlock);
+    OS << "\n";
+  }
+}
+
+PreservedAnalyses DataflowDominatorsPrinterPass::run(Function &F, FunctionAnalysisManager &AM) {
+  DataflowDominatorsInfo &Info = AM.getResult<DataflowDominatorsAnalysis>(F);
+  OS << "Dominatori di '" << F.getName() << "' (" << Info.result.iterations << " iterazioni, " << Info.result.skipped << " saltate):\n";
+  Info.print(OS);
+  return PreservedAnalyses::all();
+}
+
+//===----------------------------------------------------------------------===//
+// Constant Propagation
+//===----------------------------------------------------------------------===//
+
+/*Incontro di due valori del lattice: indefinito è l'elemento neutro, due
+costanti diverse (o un valore non costante) danno un valore non costante*/
+ConstantLatticeValue meetLatticeValues(const ConstantLatticeValue & A, const ConstantLatticeValue & B){
+  if(A.state == ConstantLatticeValue::Undefined){
+    return B;
+  }
+  if(B.state == ConstantLatticeValue::Undefined || A == B){
+    return A;
+  }
+  return ConstantLatticeValue{ConstantLatticeValue::Overdefined, nullptr};
+}
+
+/*Le alloca intere usate solo come indirizzo di load e store sono variabili
+che nessun'altra istruzione può modificare*/
+bool isTrackedAlloca(const Instruction & I){
+  const AllocaInst * alloca = dyn_cast<AllocaInst>(&I);
+  if(!alloca || !alloca->getAllocatedType()->isIntegerTy()){
+    return false;
+  }
+  return all_of(alloca->users(), [&](const User * U) {
+    if(const LoadInst * load = dyn_cast<LoadInst>(U)){
+      return load->getType() == alloca->getAllocatedType();
+    }
+    const StoreInst * store = dyn_cast<StoreInst>(U);
+    return store && store->getPointerOperand() == alloca && store->getValueOperand()->getType() == alloca->getAllocatedType();
+  });
+}
+
+/*Formalizzazione:
+1. Dominio: per ogni variabile un valore del lattice (indefinito, costante,
+   non costante), analisi Forward
+2. Transfer: si valutano le istruzioni del blocco in ordine; una store su una
+   variabile ne assegna il valore, una load lo legge, le PHI fanno l'incontro
+   dei valori entranti e le altre istruzioni vengono valutate se tutti gli
+   operandi sono costanti
+3. Meet: incontro nel lattice variabile per variabile; al confine (entry) e
+   all'inizializzazione tutte le variabili sono indefinite*/
+struct ConstantPropagationProblem {
+  using Domain = DenseMap<const Value *, ConstantLatticeValue>;
+  static constexpr DataflowDirection direction = DataflowDirection::Forward;
+
+  const DataLayout & DL;
+  SmallPtrSet<const Value *, 16> tracked;
+
+  explicit ConstantPropagationProblem(const DataLayout & DL) : DL(DL) {}
+
+  Domain boundary() const {
+    return Domain();
+  }
+
+  Domain top() const {
+    return Domain();
+  }
+
+  void meet(Domain & acc, const Domain & value) const {
+    for(auto & entry : value){
+      ConstantLatticeValue & current = acc[entry.first];
+      current = meetLatticeValues(current, entry.second);
+    }
+  }
+
+  ConstantLatticeValue getValue(const Value * V, const Domain & state) const {
+    if(ConstantInt * C = dyn_cast<ConstantInt>(const_cast<Value *>(V))){
+      return ConstantLatticeValue{ConstantLatticeValue::SingleConstant, C};
+    }
+    if(isa<UndefValue>(V)){
+      return ConstantLatticeValue();
+    }
+    if(tracked.count(V)){
+      return state.lookup(V);
+    }
+    // Arguments, globals and untracked memory are never constant
+    return ConstantLatticeValue{ConstantLatticeValue::Overdefined, nullptr};
+  }
+
+  ConstantLatticeValue evaluate(const Instruction & I, const Domain & state) const {
+    ConstantLatticeValue overdefined{ConstantLatticeValue::Overdefined, nullptr};
+    if(const PHINode * phi = dyn_cast<PHINode>(&I)){
+      ConstantLatticeValue value;
+      for(const Value * incoming : phi->incoming_values()){
+        value = meetLatticeValues(value, getValue(incoming, state));
+      }
+      return value;
+    }
+
+    if(!isa<BinaryOperator>(I) && !isa<CmpInst>(I) && !isa<CastInst>(I) && !isa<SelectInst>(I)){
+      return overdefined;
+    }
+
+    SmallVector<Constant *, 3> operands;
+    for(const Value * operand : I.operands()){
+      ConstantLatticeValue value = getValue(operand, state);
+      if(value.state != ConstantLatticeValue::SingleConstant){
+        return value.state == ConstantLatticeValue::Undefined ? ConstantLatticeValue() : overdefined;
+      }
+      operands.push_back(value.value);
+    }
+
+    Constant * folded = nullptr;
+    if(const CmpInst * cmp = dyn_cast<CmpInst>(&I)){
+      folded = ConstantFoldCompareInstOperands(cmp->getPredicate(), operands[0], operands[1], DL);
+    }else{
+      folded = ConstantFoldInstOperands(const_cast<Instruction *>(&I), operands, DL);
+    }
+    if(!folded || !isa<ConstantInt>(folded)){
+      return overdefined;
+    }
+    return ConstantLatticeValue{ConstantLatticeValue::SingleConstant, folded};
+  }
+
+  Domain transfer(const BasicBlock & BB, const Domain & input) const {
+    Domain output = input;
+    for(const Instruction & I : BB){
+      if(const StoreInst * store = dyn_cast<StoreInst>(&I)){
+        if(tracked.count(store->getPointerOperand())){
+          output[store->getPointerOperand()] = getValue(store->getValueOperand(), output);
+        }
+        continue;
+      }
+      if(!tracked.count(&I) || isa<AllocaInst>(I)){
+        continue;
+      }
+      if(const LoadInst * load = dyn_cast<LoadInst>(&I)){
+        output[&I] = tracked.count(load->getPointerOperand()) ? output.lookup(load->getPointerOperand()) : ConstantLatticeValue{ConstantLatticeValue::Overdefined, nullptr};
+        continue;
+      }
+      output[&I] = evaluate(I, output);
+    }
+    return output;
+  }
+};
+
+ConstantPropagationInfo ConstantPropagationAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  ConstantPropagationInfo Info;
+  ConstantPropagationProblem problem(F.getParent()->getDataLayout());
+  for(BasicBlock & BB : F){
+    for(Instruction & I : BB){
+      if(isTrackedAlloca(I) || (!isa<AllocaInst>(I) && I.getType()->isIntegerTy())){
+        problem.tracked.insert(&I);
+        Info.variables.push_back(&I);
+      }
+    }
+  }
+
+  Info.result = solveDataflow(F, problem);
+  return Info;
+}
+
+Constant * ConstantPropagationInfo::getConstantAtExit(const BasicBlock * BB, const Value * V) const {
+  auto found = result.out.find(BB);
+  if(found == result.out.end()){
+    return nullptr;
+  }
+  ConstantLatticeValue value = found->second.lookup(V);
+  return value.state == ConstantLatticeValue::SingleConstant ? value.value : nullptr;
+}
+
+void ConstantPropagationInfo::print(raw_ostream &OS) const {
+  // Memory variables are printed everywhere, SSA values only in the block defining them
+  auto printConstants = [&](const DenseMap<const Value *, ConstantLatticeValue> & state, const BasicBlock * BB) {
+    OS << "{";
+    for(const Value * V : variables){
+      ConstantLatticeValue value = state.lookup(V);
+      if(value.state != ConstantLatticeValue::SingleConstant){
+        continue;
+      }
+      if(!isa<AllocaInst>(V) && cast<Instruction>(V)->getParent() != BB){
+        continue;
+      }
+      OS << " ";
+      V->printAsOperand(OS, false);
+      OS << " = " << cast<ConstantInt>(value.value)->getValue();
+    }
+    OS << " }";
+  };
+
+  for(const BasicBlock & BB : *cast<Instruction>(variables.front())->getFunction()){
+    if(!result.in.count(&BB)){
+      continue;
+    }
+    OS << "  ";
+    printBlockName(OS, &BB);
+    OS << ":\n    IN:  ";
+    printConstants(result.in.lookup(&BB), nullptr);
+    OS << "\n    OUT: ";
+    printConstants(result.out.lookup(&BB), &BB);
+    OS << "\n";
+  }
+}
+
+PreservedAnalyses ConstantPropagationPrinterPass::run(Function &F, FunctionAnalysisManager &AM) {
+  ConstantPropagationInfo &Info = AM.getResult<ConstantPropagationAnalysis>(F);
+  OS << "Constant Propagation di '" << F.getName() << "' (" << Info.result.iterations << " iterazioni, " << Info.result.skipped << " saltate):\n";
+  if(!Info.variables.empty()){
+    Info.print(OS);
+  }
+  return PreservedAnalyses::all();
+}
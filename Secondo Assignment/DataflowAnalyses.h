@@ -0,0 +1,125 @@
+#ifndef LLVM_TRANSFORMS_DATAFLOWANALYSES_H
+#define LLVM_TRANSFORMS_DATAFLOWANALYSES_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/DataflowFramework.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Debug.h"
+
+namespace llvm {
+
+/*Very Busy Expressions: espressioni binarie che, da un punto del programma,
+vengono valutate su ogni cammino prima che un loro operando venga ridefinito
+(analisi Backward, meet = intersezione)*/
+struct VeryBusyExpressionsInfo {
+  // One instruction computing each expression, indexed as the bits of the sets
+  SmallVector<const Instruction *, 16> expressions;
+  DataflowResult<DataflowSet> result;
+
+  bool isVeryBusyAtEntry(const BasicBlock * BB, const Instruction * expression) const;
+  void print(raw_ostream &OS) const;
+};
+
+class VeryBusyExpressionsAnalysis : public AnalysisInfoMixin<VeryBusyExpressionsAnalysis> {
+  friend AnalysisInfoMixin<VeryBusyExpressionsAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  using Result = VeryBusyExpressionsInfo;
+  Result run(Function &F, FunctionAnalysisManager &AM);
+};
+
+class VeryBusyExpressionsPrinterPass : public PassInfoMixin<VeryBusyExpressionsPrinterPass> {
+  raw_ostream &OS;
+
+public:
+  explicit VeryBusyExpressionsPrinterPass(raw_ostream &OS) : OS(OS) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+/*Dominator Analysis: i blocchi attraversati da ogni cammino dall'entry
+(analisi Forward, meet = intersezione)*/
+struct DataflowDominatorsInfo {
+  // Blocks in function order, indexed as the bits of the sets
+  SmallVector<const BasicBlock *, 16> blocks;
+  DenseMap<const BasicBlock *, unsigned> index;
+  DataflowResult<DataflowSet> result;
+
+  bool dominates(const BasicBlock * A, const BasicBlock * B) const;
+  void print(raw_ostream &OS) const;
+};
+
+class DataflowDominatorsAnalysis : public AnalysisInfoMixin<DataflowDominatorsAnalysis> {
+  friend AnalysisInfoMixin<DataflowDominatorsAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  using Result = DataflowDominatorsInfo;
+  Result run(Function &F, FunctionAnalysisManager &AM);
+};
+
+class DataflowDominatorsPrinterPass : public PassInfoMixin<DataflowDominatorsPrinterPass> {
+  raw_ostream &OS;
+
+public:
+  explicit DataflowDominatorsPrinterPass(raw_ostream &OS) : OS(OS) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+/*Valore di una variabile nel lattice della Constant Propagation:
+indefinito (nessuna informazione, top), costante, oppure non costante (bottom)*/
+struct ConstantLatticeValue {
+  enum StateTy { Undefined, SingleConstant, Overdefined };
+  StateTy state = Undefined;
+  Constant * value = nullptr;
+
+  bool operator==(const ConstantLatticeValue &Other) const {
+    return state == Other.state && value == Other.value;
+  }
+  bool operator!=(const ConstantLatticeValue &Other) const {
+    return !(*this == Other);
+  }
+};
+
+/*Constant Propagation: per ogni punto del programma, le variabili intere
+(valori SSA e alloca mai passate ad altre istruzioni) che hanno un valore
+costante su ogni cammino (analisi Forward, meet = incontro nel lattice)*/
+struct ConstantPropagationInfo {
+  // Tracked variables in function order
+  SmallVector<const Value *, 16> variables;
+  DataflowResult<DenseMap<const Value *, ConstantLatticeValue>> result;
+
+  Constant * getConstantAtExit(const BasicBlock * BB, const Value * V) const;
+  void print(raw_ostream &OS) const;
+};
+
+class ConstantPropagationAnalysis : public AnalysisInfoMixin<ConstantPropagationAnalysis> {
+  friend AnalysisInfoMixin<ConstantPropagationAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  using Result = ConstantPropagationInfo;
+  Result run(Function &F, FunctionAnalysisManager &AM);
+};
+
+class ConstantPropagationPrinterPass : public PassInfoMixin<ConstantPropagationPrinterPass> {
+  raw_ostream &OS;
+
+public:
+  explicit ConstantPropagationPrinterPass(raw_ostream &OS) : OS(OS) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+} // namespace llvm
+
+/*Funzioni condivise con SparseConstantPropagation e LazyCodeMotionPass*/
+using ExpressionKey = std::tuple<unsigned, unsigned, const llvm::Value *, const llvm::Value *>;
+
+void printBlockName(llvm::raw_ostream &OS, const llvm::BasicBlock * BB);
+bool isDataflowExpression(const llvm::Instruction & I);
+ExpressionKey getExpressionKey(const llvm::Instruction & I);
+llvm::ConstantLatticeValue meetLatticeValues(const llvm::ConstantLatticeValue & A, const llvm::ConstantLatticeValue & B);
+
+#endif // LLVM_TRANSFORMS_DATAFLOWANALYSES_H
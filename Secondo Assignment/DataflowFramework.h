@@ -0,0 +1,172 @@
+#ifndef LLVM_TRANSFORMS_DATAFLOWFRAMEWORK_H
+#define LLVM_TRANSFORMS_DATAFLOWFRAMEWORK_H
+#include "llvm/IR/Function.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Transforms/Utils/DataflowSet.h"
+
+/*Verso in cui si propagano le informazioni*/
+enum class DataflowDirection { Forward, Backward };
+
+/*Soluzione di un problema di Dataflow: il valore all'ingresso e all'uscita
+di ogni blocco (in e out seguono il verso del programma, non quello
+dell'analisi), il numero di applicazioni della funzione di trasferimento e
+il numero di visite in cui è stata evitata perché l'input non era cambiato*/
+template <typename DomainT>
+struct DataflowResult {
+  llvm::DenseMap<const llvm::BasicBlock *, DomainT> in;
+  llvm::DenseMap<const llvm::BasicBlock *, DomainT> out;
+  unsigned iterations = 0;
+  unsigned skipped = 0;
+};
+
+/*Algoritmo iterativo generico per un problema di Dataflow. Il problema fornisce:
+1. Domain: il tipo dei valori del semilattice, confrontabile con ==
+2. direction: Forward o Backward
+3. boundary(): il valore all'ingresso (Forward) o alle uscite (Backward) della funzione
+4. top(): il valore iniziale degli altri blocchi
+5. meet(acc, value): acc = acc ∧ value
+6. transfer(BB, input): il valore dall'altra parte del blocco
+I blocchi sono visitati con una worklist ordinata in reverse post-order sul
+grafo dell'analisi (post-order del CFG per i problemi Backward), così ogni
+blocco vede già aggiornati i predecessori lungo gli archi in avanti.
+transfer dipende solo dall'input, quindi un blocco rimesso in worklist il cui
+meet non è cambiato mantiene l'output precedente senza ricalcolarlo.
+I blocchi irraggiungibili dall'entry non fanno parte della soluzione*/
+template <typename ProblemT>
+DataflowResult<typename ProblemT::Domain> solveDataflow(llvm::Function & F, const ProblemT & problem){
+  using Domain = typename ProblemT::Domain;
+  constexpr bool forward = ProblemT::direction == DataflowDirection::Forward;
+
+  llvm::SmallVector<const llvm::BasicBlock *, 32> order;
+  for(const llvm::BasicBlock * BB : llvm::ReversePostOrderTraversal<llvm::Function *>(&F)){
+    order.push_back(BB);
+  }
+  if(!forward){
+    std::reverse(order.begin(), order.end());
+  }
+
+  llvm::DenseMap<const llvm::BasicBlock *, unsigned> position;
+  for(unsigned i = 0; i < order.size(); ++i){
+    position[order[i]] = i;
+  }
+
+  // input is the side the analysis reads from, output the side transfer writes
+  DataflowResult<Domain> result;
+  auto & input = forward ? result.in : result.out;
+  auto & output = forward ? result.out : result.in;
+  for(const llvm::BasicBlock * BB : order){
+    output[BB] = problem.top();
+  }
+
+  llvm::BitVector pending(order.size(), true);
+  for(int i = pending.find_first(); i != -1; i = pending.find_first()){
+    pending.reset(i);
+    const llvm::BasicBlock * BB = order[i];
+
+    // Meet over the blocks flowing into BB
+    Domain value = problem.top();
+    bool boundary = true;
+    auto meetFrom = [&](const llvm::BasicBlock * other) {
+      auto found = output.find(other);
+      if(found != output.end()){
+        problem.meet(value, found->second);
+        boundary = false;
+      }
+    };
+    if(forward){
+      for(const llvm::BasicBlock * pred : llvm::predecessors(BB)){
+        meetFrom(pred);
+      }
+      boundary = BB->isEntryBlock();
+    }else{
+      for(const llvm::BasicBlock * succ : llvm::successors(BB)){
+        meetFrom(succ);
+      }
+    }
+    if(boundary){
+      value = problem.boundary();
+    }
+
+    auto previous = input.find(BB);
+    if(previous != input.end() && previous->second == value){
+      result.skipped++;
+      continue;
+    }
+
+    Domain transferred = problem.transfer(*BB, value);
+    input[BB] = std::move(value);
+    result.iterations++;
+    if(transferred == output[BB]){
+      continue;
+    }
+    output[BB] = std::move(transferred);
+
+    auto push = [&](const llvm::BasicBlock * other) {
+      auto found = position.find(other);
+      if(found != position.end()){
+        pending.set(found->second);
+      }
+    };
+    if(forward){
+      for(const llvm::BasicBlock * succ : llvm::successors(BB)){
+        push(succ);
+      }
+    }else{
+      for(const llvm::BasicBlock * pred : llvm::predecessors(BB)){
+        push(pred);
+      }
+    }
+  }
+
+  return result;
+}
+
+/*Base dei problemi il cui dominio è un insieme di fatti numerati da 0 a
+size - 1, rappresentato con un DataflowSet (denso o sparso secondo il
+numero di elementi). meet è l'unione o
+l'intersezione, transfer è out = gen ∪ (in - kill) con gen e kill per blocco*/
+template <DataflowDirection Direction, bool Intersection>
+struct BitVectorDataflowProblem {
+  using Domain = DataflowSet;
+  static constexpr DataflowDirection direction = Direction;
+
+  unsigned size = 0;
+  llvm::DenseMap<const llvm::BasicBlock *, DataflowSet> gen;
+  llvm::DenseMap<const llvm::BasicBlock *, DataflowSet> kill;
+  DataflowSet boundaryValue;
+
+  Domain boundary() const {
+    return boundaryValue.size() == size ? boundaryValue : DataflowSet(size);
+  }
+
+  Domain top() const {
+    return DataflowSet(size, Intersection);
+  }
+
+  void meet(Domain & acc, const Domain & value) const {
+    if(Intersection){
+      acc &= value;
+    }else{
+      acc |= value;
+    }
+  }
+
+  Domain transfer(const llvm::BasicBlock & BB, const Domain & input) const {
+    Domain output = input;
+    auto killed = kill.find(&BB);
+    if(killed != kill.end()){
+      output.reset(killed->second);
+    }
+    auto generated = gen.find(&BB);
+    if(generated != gen.end()){
+      output |= generated->second;
+    }
+    return output;
+  }
+};
+
+#endif // LLVM_TRANSFORMS_DATAFLOWFRAMEWORK_H
@@ -0,0 +1,357 @@
+#ifndef LLVM_TRANSFORMS_DATAFLOWSET_H
+#define LLVM_TRANSFORMS_DATAFLOWSET_H
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define DATAFLOWSET_AVX2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*Operazioni parola per parola sugli insiemi densi: 4 parole alla volta con
+AVX2, 2 con NEON, altrimenti una parola da 64 bit alla volta. Le versioni
+AVX2 sono compilate con l'attributo target, qualunque siano i flag della
+build, e si usano solo se la CPU le supporta. Ogni operazione restituisce
+il numero di bit di dst alla fine, contati mentre le parole si scrivono*/
+namespace dataflowwords {
+
+inline unsigned popcount(uint64_t word){
+  return std::bitset<64>(word).count();
+}
+
+#if defined(DATAFLOWSET_AVX2)
+inline bool hasAVX2(){
+  static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+  return supported;
+}
+
+__attribute__((target("avx2,popcnt"))) inline unsigned countVectorAVX2(__m256i v){
+  return __builtin_popcountll(_mm256_extract_epi64(v, 0)) + __builtin_popcountll(_mm256_extract_epi64(v, 1)) +
+         __builtin_popcountll(_mm256_extract_epi64(v, 2)) + __builtin_popcountll(_mm256_extract_epi64(v, 3));
+}
+
+__attribute__((target("avx2,popcnt"))) inline unsigned orWordsAVX2(uint64_t * dst, const uint64_t * src, unsigned n){
+  unsigned count = 0;
+  unsigned i = 0;
+  for(; i + 4 <= n; i += 4){
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i r = _mm256_or_si256(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+    count += countVectorAVX2(r);
+  }
+  for(; i < n; ++i){
+    dst[i] |= src[i];
+    count += __builtin_popcountll(dst[i]);
+  }
+  return count;
+}
+
+__attribute__((target("avx2,popcnt"))) inline unsigned andWordsAVX2(uint64_t * dst, const uint64_t * src, unsigned n){
+  unsigned count = 0;
+  unsigned i = 0;
+  for(; i + 4 <= n; i += 4){
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i r = _mm256_and_si256(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+    count += countVectorAVX2(r);
+  }
+  for(; i < n; ++i){
+    dst[i] &= src[i];
+    count += __builtin_popcountll(dst[i]);
+  }
+  return count;
+}
+
+__attribute__((target("avx2,popcnt"))) inline unsigned andNotWordsAVX2(uint64_t * dst, const uint64_t * src, unsigned n){
+  unsigned count = 0;
+  unsigned i = 0;
+  for(; i + 4 <= n; i += 4){
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i r = _mm256_andnot_si256(b, a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);
+    count += countVectorAVX2(r);
+  }
+  for(; i < n; ++i){
+    dst[i] &= ~src[i];
+    count += __builtin_popcountll(dst[i]);
+  }
+  return count;
+}
+#endif
+
+inline unsigned orWords(uint64_t * dst, const uint64_t * src, unsigned n){
+#if defined(DATAFLOWSET_AVX2)
+  if(hasAVX2()){
+    return orWordsAVX2(dst, src, n);
+  }
+#endif
+  unsigned count = 0;
+  unsigned i = 0;
+#if defined(__ARM_NEON)
+  for(; i + 2 <= n; i += 2){
+    vst1q_u64(dst + i, vorrq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    count += popcount(dst[i]) + popcount(dst[i + 1]);
+  }
+#endif
+  for(; i < n; ++i){
+    dst[i] |= src[i];
+    count += popcount(dst[i]);
+  }
+  return count;
+}
+
+inline unsigned andWords(uint64_t * dst, const uint64_t * src, unsigned n){
+#if defined(DATAFLOWSET_AVX2)
+  if(hasAVX2()){
+    return andWordsAVX2(dst, src, n);
+  }
+#endif
+  unsigned count = 0;
+  unsigned i = 0;
+#if defined(__ARM_NEON)
+  for(; i + 2 <= n; i += 2){
+    vst1q_u64(dst + i, vandq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    count += popcount(dst[i]) + popcount(dst[i + 1]);
+  }
+#endif
+  for(; i < n; ++i){
+    dst[i] &= src[i];
+    count += popcount(dst[i]);
+  }
+  return count;
+}
+
+// dst = dst & ~src
+inline unsigned andNotWords(uint64_t * dst, const uint64_t * src, unsigned n){
+#if defined(DATAFLOWSET_AVX2)
+  if(hasAVX2()){
+    return andNotWordsAVX2(dst, src, n);
+  }
+#endif
+  unsigned count = 0;
+  unsigned i = 0;
+#if defined(__ARM_NEON)
+  for(; i + 2 <= n; i += 2){
+    vst1q_u64(dst + i, vbicq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    count += popcount(dst[i]) + popcount(dst[i + 1]);
+  }
+#endif
+  for(; i < n; ++i){
+    dst[i] &= ~src[i];
+    count += popcount(dst[i]);
+  }
+  return count;
+}
+
+} // namespace dataflowwords
+
+/*Insieme di fatti 0 .. size - 1 per lo stato del risolutore di Dataflow.
+Finché l'insieme è denso si usa un vettore di bit con operazioni parola per
+parola; quando contiene meno di un elemento ogni SparseRatio posizioni passa
+a un vettore ordinato di indici, e torna denso oltre il doppio di quella
+soglia (l'isteresi evita di convertire a ogni operazione). Il numero di
+elementi dell'insieme denso è tenuto aggiornato, così la scelta della
+rappresentazione non riconta i bit. Le operazioni accettano operandi in
+rappresentazioni diverse.
+L'interfaccia segue BitVector: test, set, reset, count, set_bits, |=, &=*/
+class DataflowSet {
+  static constexpr unsigned SparseRatio = 64;
+
+  unsigned Size = 0;
+  bool Sparse = false;
+  llvm::SmallVector<uint64_t, 4> Words;
+  // Elements of the dense set (the sparse one is Elements.size())
+  unsigned Count = 0;
+  llvm::SmallVector<unsigned, 8> Elements;
+
+  static unsigned numWords(unsigned size){
+    return (size + 63) / 64;
+  }
+
+  void toDense(){
+    if(!Sparse){
+      return;
+    }
+    Words.assign(numWords(Size), 0);
+    for(unsigned idx : Elements){
+      Words[idx / 64] |= uint64_t(1) << (idx % 64);
+    }
+    Count = Elements.size();
+    Elements.clear();
+    Sparse = false;
+  }
+
+  void toSparse(){
+    if(Sparse){
+      return;
+    }
+    Elements.clear();
+    for(unsigned w = 0; w < Words.size(); ++w){
+      for(uint64_t word = Words[w]; word; word &= word - 1){
+        // Lowest set bit: the ones below it are counted with a popcount
+        Elements.push_back(w * 64 + dataflowwords::popcount((word & -word) - 1));
+      }
+    }
+    Words.clear();
+    Sparse = true;
+  }
+
+  // Picks the representation for the current number of elements
+  void normalize(){
+    if(Sparse){
+      if(Elements.size() * SparseRatio > 2 * Size){
+        toDense();
+      }
+    }else if(count() * SparseRatio < Size){
+      toSparse();
+    }
+  }
+
+public:
+  DataflowSet() = default;
+
+  explicit DataflowSet(unsigned size, bool value = false) : Size(size) {
+    Words.assign(numWords(size), value ? ~uint64_t(0) : 0);
+    if(value && size % 64){
+      Words.back() = (uint64_t(1) << (size % 64)) - 1;
+    }
+    Count = value ? size : 0;
+    normalize();
+  }
+
+  unsigned size() const {
+    return Size;
+  }
+
+  bool isSparse() const {
+    return Sparse;
+  }
+
+  bool test(unsigned idx) const {
+    if(Sparse){
+      return std::binary_search(Elements.begin(), Elements.end(), idx);
+    }
+    return (Words[idx / 64] >> (idx % 64)) & 1;
+  }
+
+  DataflowSet & set(unsigned idx){
+    if(Sparse){
+      auto position = std::lower_bound(Elements.begin(), Elements.end(), idx);
+      if(position == Elements.end() || *position != idx){
+        Elements.insert(position, idx);
+        normalize();
+      }
+      return *this;
+    }
+    uint64_t bit = uint64_t(1) << (idx % 64);
+    Count += !(Words[idx / 64] & bit);
+    Words[idx / 64] |= bit;
+    return *this;
+  }
+
+  DataflowSet & reset(unsigned idx){
+    if(Sparse){
+      auto position = std::lower_bound(Elements.begin(), Elements.end(), idx);
+      if(position != Elements.end() && *position == idx){
+        Elements.erase(position);
+      }
+      return *this;
+    }
+    uint64_t bit = uint64_t(1) << (idx % 64);
+    Count -= !!(Words[idx / 64] & bit);
+    Words[idx / 64] &= ~bit;
+    return *this;
+  }
+
+  unsigned count() const {
+    return Sparse ? Elements.size() : Count;
+  }
+
+  bool any() const {
+    return count() != 0;
+  }
+
+  // Indices of the elements, in increasing order
+  llvm::SmallVector<unsigned, 8> set_bits() const {
+    if(Sparse){
+      return Elements;
+    }
+    DataflowSet copy = *this;
+    copy.toSparse();
+    return copy.Elements;
+  }
+
+  // Union
+  DataflowSet & operator|=(const DataflowSet & other){
+    if(Sparse && other.Sparse){
+      llvm::SmallVector<unsigned, 8> merged;
+      std::set_union(Elements.begin(), Elements.end(), other.Elements.begin(), other.Elements.end(), std::back_inserter(merged));
+      Elements = std::move(merged);
+    }else if(!Sparse && other.Sparse){
+      for(unsigned idx : other.Elements){
+        set(idx);
+      }
+    }else{
+      toDense();
+      Count = dataflowwords::orWords(Words.data(), other.Words.data(), Words.size());
+    }
+    normalize();
+    return *this;
+  }
+
+  // Intersection
+  DataflowSet & operator&=(const DataflowSet & other){
+    if(Sparse || other.Sparse){
+      toSparse();
+      llvm::erase_if(Elements, [&](unsigned idx) { return !other.test(idx); });
+    }else{
+      Count = dataflowwords::andWords(Words.data(), other.Words.data(), Words.size());
+    }
+    normalize();
+    return *this;
+  }
+
+  // Difference: removes the elements of other
+  DataflowSet & reset(const DataflowSet & other){
+    if(Sparse){
+      llvm::erase_if(Elements, [&](unsigned idx) { return other.test(idx); });
+    }else if(other.Sparse){
+      for(unsigned idx : other.Elements){
+        reset(idx);
+      }
+    }else{
+      Count = dataflowwords::andNotWords(Words.data(), other.Words.data(), Words.size());
+    }
+    normalize();
+    return *this;
+  }
+
+  bool operator==(const DataflowSet & other) const {
+    if(Size != other.Size){
+      return false;
+    }
+    if(Sparse && other.Sparse){
+      return Elements == other.Elements;
+    }
+    if(!Sparse && !other.Sparse){
+      return std::memcmp(Words.data(), other.Words.data(), Words.size() * sizeof(uint64_t)) == 0;
+    }
+    const DataflowSet & sparse = Sparse ? *this : other;
+    const DataflowSet & dense = Sparse ? other : *this;
+    return sparse.Elements.size() == dense.count() && std::all_of(sparse.Elements.begin(), sparse.Elements.end(), [&](unsigned idx) { return dense.test(idx); });
+  }
+
+  bool operator!=(const DataflowSet & other) const {
+    return !(*this == other);
+  }
+};
+
+#endif // LLVM_TRANSFORMS_DATAFLOWSET_H
@@ -0,0 +1,366 @@
+//===-- LazyCodeMotionPass.cpp - Example Transformations -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/LazyCodeMotionPass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "lazycodemotionpass"
+
+/*Espressioni candidate e insiemi di ogni blocco raggiungibile. Le nuove
+valutazioni si inseriscono all'inizio dei blocchi, subito dopo le PHI, e
+gli insiemi per blocco si riferiscono a quel punto:
+- use: espressioni valutate nel blocco con gli operandi già definiti al punto di inserimento
+- bodyKill: espressioni con un operando definito dopo le PHI del blocco
+- phiKill: espressioni con un operando definito da una PHI del blocco, che
+  quindi non possono attraversare gli archi entranti*/
+struct LazyCodeMotionInfo {
+  SmallVector<Instruction *, 16> expressions;
+  DenseMap<ExpressionKey, unsigned> ids;
+  // Expression of every evaluation: the keys change once the operands are replaced
+  DenseMap<const Instruction *, unsigned> instanceOf;
+  SmallVector<BasicBlock *, 32> blocks;
+  DenseMap<const BasicBlock *, DataflowSet> use;
+  DenseMap<const BasicBlock *, DataflowSet> bodyKill;
+  DenseMap<const BasicBlock *, DataflowSet> phiKill;
+  DenseMap<const BasicBlock *, DataflowSet> anticipated;
+  DenseMap<const BasicBlock *, DataflowSet> earliest;
+  DenseMap<const BasicBlock *, DataflowSet> postponable;
+  DenseMap<const BasicBlock *, DataflowSet> latest;
+  DenseMap<const BasicBlock *, DataflowSet> usedOut;
+};
+
+/*Il punto di inserimento deve esistere in ogni blocco e ogni arco critico
+deve poter essere spezzato*/
+bool isLazyCodeMotionSupported(Function & F){
+  for(BasicBlock & BB : F){
+    if(BB.isEHPad() || isa<IndirectBrInst>(BB.getTerminator()) || isa<CallBrInst>(BB.getTerminator())){
+      return false;
+    }
+  }
+  return true;
+}
+
+/*Numera le espressioni dei blocchi raggiungibili e calcola use, bodyKill e phiKill*/
+void computeLocalSets(Function & F, LazyCodeMotionInfo & Info){
+  for(BasicBlock * BB : ReversePostOrderTraversal<Function *>(&F)){
+    Info.blocks.push_back(BB);
+  }
+
+  DenseMap<const Value *, SmallVector<unsigned, 4>> users;
+  for(BasicBlock * BB : Info.blocks){
+    for(Instruction & I : *BB){
+      if(!isDataflowExpression(I)){
+        continue;
+      }
+      auto inserted = Info.ids.insert(std::make_pair(getExpressionKey(I), Info.expressions.size()));
+      Info.instanceOf[&I] = inserted.first->second;
+      if(!inserted.second){
+        continue;
+      }
+      Info.expressions.push_back(&I);
+      for(Value * operand : I.operands()){
+        users[operand].push_back(inserted.first->second);
+      }
+    }
+  }
+
+  // Divisions that may trap cannot move above an instruction that may not return
+  unsigned size = Info.expressions.size();
+  DataflowSet trapping(size);
+  for(unsigned id = 0; id < size; ++id){
+    if(!isSafeToSpeculativelyExecute(Info.expressions[id])){
+      trapping.set(id);
+    }
+  }
+
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & use = Info.use[BB] = DataflowSet(size);
+    DataflowSet & bodyKill = Info.bodyKill[BB] = DataflowSet(size);
+    DataflowSet & phiKill = Info.phiKill[BB] = DataflowSet(size);
+    bool transfers = true;
+    for(Instruction & I : *BB){
+      auto found = users.find(&I);
+      if(found != users.end()){
+        for(unsigned id : found->second){
+          (isa<PHINode>(I) ? phiKill : bodyKill).set(id);
+        }
+      }
+
+      // In SSA the operands are defined before I: I is upward exposed unless one of them is defined in the body of BB
+      auto instance = Info.instanceOf.find(&I);
+      if(instance != Info.instanceOf.end()){
+        unsigned id = instance->second;
+        bool exposed = none_of(I.operands(), [&](Value * operand) {
+          Instruction * def = dyn_cast<Instruction>(operand);
+          return def && def->getParent() == BB && !isa<PHINode>(def);
+        });
+        if(exposed && (transfers || !trapping.test(id))){
+          use.set(id);
+        }
+      }
+
+      if(transfers && !isGuaranteedToTransferExecutionToSuccessor(&I)){
+        transfers = false;
+        bodyKill |= trapping;
+      }
+    }
+  }
+}
+
+/*1. Anticipated Expressions (Backward, intersezione):
+ANT_IN[B] = use[B] ∪ (ANT_OUT[B] - bodyKill[B]), ANT_OUT[B] = ∩ (ANT_IN[S] - phiKill[S]).
+Il risolutore propaga ANT_IN[B] - phiKill[B], cioè quanto vedono i predecessori*/
+void computeAnticipated(Function & F, LazyCodeMotionInfo & Info){
+  BitVectorDataflowProblem<DataflowDirection::Backward, true> problem;
+  problem.size = Info.expressions.size();
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & gen = problem.gen[BB] = Info.use[BB];
+    gen.reset(Info.phiKill[BB]);
+    DataflowSet & kill = problem.kill[BB] = Info.bodyKill[BB];
+    kill |= Info.phiKill[BB];
+  }
+
+  DataflowResult<DataflowSet> result = solveDataflow(F, problem);
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & anticipated = Info.anticipated[BB] = result.out[BB];
+    anticipated.reset(Info.bodyKill[BB]);
+    anticipated |= Info.use[BB];
+  }
+}
+
+/*2. Available Expressions (Forward, intersezione), supponendo di valutare
+ogni espressione dove è anticipata:
+AV_OUT[B] = (ANT_IN[B] ∪ AV_IN[B]) - bodyKill[B], AV_IN[B] = (∩ AV_OUT[P]) - phiKill[B].
+EARLIEST[B] = ANT_IN[B] - AV_IN[B]*/
+void computeEarliest(Function & F, LazyCodeMotionInfo & Info){
+  BitVectorDataflowProblem<DataflowDirection::Forward, true> problem;
+  problem.size = Info.expressions.size();
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & gen = problem.gen[BB] = Info.anticipated[BB];
+    gen.reset(Info.bodyKill[BB]);
+    DataflowSet & kill = problem.kill[BB] = Info.bodyKill[BB];
+    kill |= Info.phiKill[BB];
+  }
+
+  DataflowResult<DataflowSet> result = solveDataflow(F, problem);
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet available = result.in[BB];
+    available.reset(Info.phiKill[BB]);
+    DataflowSet & earliest = Info.earliest[BB] = Info.anticipated[BB];
+    earliest.reset(available);
+  }
+}
+
+/*3. Postponable Expressions (Forward, intersezione): la valutazione può
+scendere finché non incontra un uso.
+POST_OUT[B] = (EARLIEST[B] ∪ POST_IN[B]) - use[B], POST_IN[B] = (∩ POST_OUT[P]) - phiKill[B]*/
+void computePostponable(Function & F, LazyCodeMotionInfo & Info){
+  BitVectorDataflowProblem<DataflowDirection::Forward, true> problem;
+  problem.size = Info.expressions.size();
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & gen = problem.gen[BB] = Info.earliest[BB];
+    gen.reset(Info.use[BB]);
+    DataflowSet & kill = problem.kill[BB] = Info.use[BB];
+    kill |= Info.phiKill[BB];
+  }
+
+  DataflowResult<DataflowSet> result = solveDataflow(F, problem);
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & postponable = Info.postponable[BB] = result.in[BB];
+    postponable.reset(Info.phiKill[BB]);
+  }
+}
+
+/*LATEST[B] = (EARLIEST[B] ∪ POST_IN[B]) ∩ (use[B] ∪ ¬(∩ (EARLIEST[S] ∪ POST_IN[S]) - phiKill[S])):
+il punto più basso oltre cui la valutazione non può essere rimandata*/
+void computeLatest(LazyCodeMotionInfo & Info){
+  unsigned size = Info.expressions.size();
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet postponeFurther(size, true);
+    for(BasicBlock * succ : successors(BB)){
+      DataflowSet value = Info.earliest[succ];
+      value |= Info.postponable[succ];
+      value.reset(Info.phiKill[succ]);
+      postponeFurther &= value;
+    }
+    postponeFurther.reset(Info.use[BB]);
+
+    DataflowSet & latest = Info.latest[BB] = Info.earliest[BB];
+    latest |= Info.postponable[BB];
+    latest.reset(postponeFurther);
+  }
+}
+
+/*4. Used Expressions (Backward, unione): il valore calcolato in LATEST serve più avanti.
+USED_IN[B] = (use[B] ∪ USED_OUT[B]) - LATEST[B], USED_OUT[B] = ∪ (USED_IN[S] - phiKill[S])*/
+void computeUsed(Function & F, LazyCodeMotionInfo & Info){
+  BitVectorDataflowProblem<DataflowDirection::Backward, false> problem;
+  problem.size = Info.expressions.size();
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet & gen = problem.gen[BB] = Info.use[BB];
+    gen.reset(Info.latest[BB]);
+    gen.reset(Info.phiKill[BB]);
+    DataflowSet & kill = problem.kill[BB] = Info.latest[BB];
+    kill |= Info.phiKill[BB];
+  }
+
+  DataflowResult<DataflowSet> result = solveDataflow(F, problem);
+  for(BasicBlock * BB : Info.blocks){
+    Info.usedOut[BB] = result.out[BB];
+  }
+}
+
+/*Trasformazione:
+1. Per ogni espressione in LATEST[B] ∩ USED_OUT[B] si inserisce una nuova
+   valutazione t all'inizio di B
+2. Ogni valutazione esposta verso l'alto (use[B]) viene sostituita da t,
+   tranne in LATEST[B] - USED_OUT[B] dove resta al suo posto (e le copie
+   successive nello stesso blocco usano quella)
+I valori di t nei blocchi senza inserimenti, con le PHI necessarie, li
+costruisce SSAUpdater*/
+bool applyLazyCodeMotion(LazyCodeMotionInfo & Info){
+  bool modified = false;
+  unsigned size = Info.expressions.size();
+
+  SmallVector<SmallVector<Instruction *, 4>, 16> instances(size);
+  for(BasicBlock * BB : Info.blocks){
+    for(Instruction & I : *BB){
+      auto found = Info.instanceOf.find(&I);
+      if(found != Info.instanceOf.end()){
+        instances[found->second].push_back(&I);
+      }
+    }
+  }
+
+  DenseMap<std::pair<const BasicBlock *, unsigned>, Instruction *> insertedAt;
+  SmallVector<std::unique_ptr<SSAUpdater>, 16> updaters;
+  updaters.resize(size);
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet insert = Info.latest[BB];
+    insert &= Info.usedOut[BB];
+    for(unsigned id : insert.set_bits()){
+      Instruction * expression = Info.expressions[id];
+      // An evaluation exposed in BB is moved to the insertion point rather than copied
+      Instruction * evaluation = nullptr;
+      if(Info.use[BB].test(id)){
+        evaluation = *find_if(instances[id], [&](Instruction * instance) { return instance->getParent() == BB; });
+        evaluation->moveBefore(&*BB->getFirstInsertionPt());
+      }else{
+        evaluation = expression->clone();
+        evaluation->setDebugLoc(DebugLoc());
+        evaluation->setName(expression->getName() + ".lcm");
+        evaluation->insertBefore(&*BB->getFirstInsertionPt());
+        LLVM_DEBUG({
+          dbgs() << "Inserita" << *evaluation << " all'inizio di ";
+          printBlockName(dbgs(), BB);
+          dbgs() << "\n";
+        });
+      }
+      modified = true;
+      // The evaluation replaces all the others: it keeps only the flags they share
+      for(Instruction * instance : instances[id]){
+        evaluation->andIRFlags(instance);
+      }
+      insertedAt[{BB, id}] = evaluation;
+
+      if(!updaters[id]){
+        updaters[id] = std::make_unique<SSAUpdater>();
+        updaters[id]->Initialize(expression->getType(), expression->getName());
+      }
+      updaters[id]->AddAvailableValue(BB, evaluation);
+    }
+  }
+
+  for(BasicBlock * BB : Info.blocks){
+    DataflowSet keep = Info.latest[BB];
+    keep.reset(Info.usedOut[BB]);
+    DenseMap<unsigned, Instruction *> local;
+
+    for(Instruction & I : make_early_inc_range(*BB)){
+      auto found = Info.instanceOf.find(&I);
+      if(found == Info.instanceOf.end()){
+        continue;
+      }
+      unsigned id = found->second;
+      if(!Info.use[BB].test(id)){
+        continue;
+      }
+
+      Value * value = nullptr;
+      if(keep.test(id)){
+        auto inserted = local.insert(std::make_pair(id, &I));
+        if(inserted.second){
+          continue;
+        }
+        value = inserted.first->second;
+      }else{
+        value = insertedAt.lookup({BB, id});
+        if(value == &I){
+          continue;
+        }
+        if(!value){
+          value = updaters[id]->GetValueInMiddleOfBlock(BB);
+        }
+      }
+
+      LLVM_DEBUG({
+        dbgs() << I << " è ridondante, sostituita da ";
+        value->printAsOperand(dbgs(), false);
+        dbgs() << "\n";
+      });
+      I.replaceAllUsesWith(value);
+      Info.instanceOf.erase(&I);
+      I.eraseFromParent();
+      modified = true;
+    }
+  }
+
+  return modified;
+}
+
+PreservedAnalyses LazyCodeMotionPass::run(Function &F, FunctionAnalysisManager &AM) {
+  if(F.isDeclaration() || !isLazyCodeMotionSupported(F)){
+    return PreservedAnalyses::all();
+  }
+
+  // Insertions on critical edges need a block of their own
+  SmallPtrSet<BasicBlock *, 32> original;
+  for(BasicBlock & BB : F){
+    original.insert(&BB);
+  }
+  unsigned split = SplitAllCriticalEdges(F);
+
+  LazyCodeMotionInfo Info;
+  computeLocalSets(F, Info);
+  bool modified = false;
+  if(!Info.expressions.empty()){
+    computeAnticipated(F, Info);
+    computeEarliest(F, Info);
+    computePostponable(F, Info);
+    computeLatest(Info);
+    computeUsed(F, Info);
+    modified = applyLazyCodeMotion(Info);
+  }
+
+  // The split blocks that received nothing are removed again
+  SmallVector<BasicBlock *, 16> empty;
+  for(BasicBlock & BB : F){
+    if(!original.count(&BB) && BB.size() == 1){
+      empty.push_back(&BB);
+    }
+  }
+  for(BasicBlock * BB : empty){
+    TryToSimplifyUncondBranchFromEmptyBlock(BB);
+  }
+
+  if(!modified && !split){
+    return PreservedAnalyses::all();
+  }
+  return PreservedAnalyses::none();
+}
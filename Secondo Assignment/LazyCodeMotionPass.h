@@ -0,0 +1,18 @@
+#ifndef LLVM_TRANSFORMS_LAZYCODEMOTION_H
+#define LLVM_TRANSFORMS_LAZYCODEMOTION_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/DataflowAnalyses.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+namespace llvm {
+
+class LazyCodeMotionPass : public PassInfoMixin<LazyCodeMotionPass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+} // namespace llvm
+#endif // LLVM_TRANSFORMS_LAZYCODEMOTION_H
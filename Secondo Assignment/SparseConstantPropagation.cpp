@@ -0,0 +1,298 @@
+//===-- SparseConstantPropagation.cpp - Example Analyses -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/SparseConstantPropagation.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sparse-constant-folding"
+
+AnalysisKey SparseConstantPropagationAnalysis::Key;
+
+/*Risolutore con due worklist: i blocchi appena diventati eseguibili, le cui
+istruzioni vanno valutate tutte, e le istruzioni i cui operandi hanno
+cambiato valore. I valori scendono soltanto nel lattice (indefinito,
+costante, non costante), quindi ogni istruzione cambia al più due volte*/
+struct SparseConstantPropagationSolver {
+  const DataLayout & DL;
+  SparseConstantPropagationInfo & Info;
+  SmallVector<const BasicBlock *, 16> blockWorklist;
+  SmallVector<const Instruction *, 32> valueWorklist;
+
+  SparseConstantPropagationSolver(const DataLayout & DL, SparseConstantPropagationInfo & Info) : DL(DL), Info(Info) {}
+
+  ConstantLatticeValue getValue(const Value * V) const {
+    return Info.getLatticeValue(V);
+  }
+
+  void markEdge(const BasicBlock * From, const BasicBlock * To){
+    if(!Info.executableEdges.insert({From, To}).second){
+      return;
+    }
+    if(Info.executableBlocks.insert(To).second){
+      blockWorklist.push_back(To);
+      return;
+    }
+    // A new incoming edge only changes the PHIs of a block already visited
+    for(const PHINode & phi : To->phis()){
+      valueWorklist.push_back(&phi);
+    }
+  }
+
+  void update(const Instruction * I, const ConstantLatticeValue & value){
+    ConstantLatticeValue & current = Info.values[I];
+    ConstantLatticeValue lowered = meetLatticeValues(current, value);
+    if(lowered == current){
+      return;
+    }
+    current = lowered;
+    for(const User * U : I->users()){
+      const Instruction * user = dyn_cast<Instruction>(U);
+      if(user && Info.isExecutable(user->getParent())){
+        valueWorklist.push_back(user);
+      }
+    }
+  }
+
+  ConstantLatticeValue evaluate(const Instruction & I) const {
+    ConstantLatticeValue overdefined{ConstantLatticeValue::Overdefined, nullptr};
+    if(const PHINode * phi = dyn_cast<PHINode>(&I)){
+      ConstantLatticeValue value;
+      for(unsigned i = 0; i < phi->getNumIncomingValues(); ++i){
+        if(Info.isEdgeExecutable(phi->getIncomingBlock(i), phi->getParent())){
+          value = meetLatticeValues(value, getValue(phi->getIncomingValue(i)));
+        }
+      }
+      return value;
+    }
+
+    if(const SelectInst * select = dyn_cast<SelectInst>(&I)){
+      ConstantLatticeValue condition = getValue(select->getCondition());
+      if(condition.state == ConstantLatticeValue::SingleConstant){
+        return getValue(condition.value->isZeroValue() ? select->getFalseValue() : select->getTrueValue());
+      }
+      if(condition.state == ConstantLatticeValue::Undefined){
+        return ConstantLatticeValue();
+      }
+      return meetLatticeValues(getValue(select->getTrueValue()), getValue(select->getFalseValue()));
+    }
+
+    if(!isa<BinaryOperator>(I) && !isa<CmpInst>(I) && !isa<CastInst>(I)){
+      return overdefined;
+    }
+
+    SmallVector<Constant *, 2> operands;
+    bool undefined = false;
+    for(const Value * operand : I.operands()){
+      ConstantLatticeValue value = getValue(operand);
+      if(value.state == ConstantLatticeValue::Overdefined){
+        return overdefined;
+      }
+      undefined |= value.state == ConstantLatticeValue::Undefined;
+      operands.push_back(value.value);
+    }
+    if(undefined){
+      return ConstantLatticeValue();
+    }
+
+    Constant * folded = nullptr;
+    if(const CmpInst * cmp = dyn_cast<CmpInst>(&I)){
+      folded = ConstantFoldCompareInstOperands(cmp->getPredicate(), operands[0], operands[1], DL);
+    }else{
+      folded = ConstantFoldInstOperands(const_cast<Instruction *>(&I), operands, DL);
+    }
+    // Poison results (division by zero, oversized shifts) are not constants
+    if(!folded || !isa<ConstantInt>(folded)){
+      return overdefined;
+    }
+    return ConstantLatticeValue{ConstantLatticeValue::SingleConstant, folded};
+  }
+
+  void visitTerminator(const Instruction & I){
+    const BasicBlock * BB = I.getParent();
+    if(const BranchInst * branch = dyn_cast<BranchInst>(&I)){
+      if(branch->isConditional()){
+        ConstantLatticeValue condition = getValue(branch->getCondition());
+        if(condition.state == ConstantLatticeValue::Undefined){
+          return;
+        }
+        if(condition.state == ConstantLatticeValue::SingleConstant){
+          markEdge(BB, branch->getSuccessor(condition.value->isZeroValue() ? 1 : 0));
+          return;
+        }
+      }
+    }else if(const SwitchInst * sw = dyn_cast<SwitchInst>(&I)){
+      ConstantLatticeValue condition = getValue(sw->getCondition());
+      if(condition.state == ConstantLatticeValue::Undefined){
+        return;
+      }
+      if(condition.state == ConstantLatticeValue::SingleConstant){
+        markEdge(BB, const_cast<SwitchInst *>(sw)->findCaseValue(cast<ConstantInt>(condition.value))->getCaseSuccessor());
+        return;
+      }
+    }
+    for(const BasicBlock * succ : successors(BB)){
+      markEdge(BB, succ);
+    }
+  }
+
+  void visit(const Instruction & I){
+    Info.visits++;
+    if(I.isTerminator()){
+      visitTerminator(I);
+    }else if(I.getType()->isIntegerTy()){
+      update(&I, evaluate(I));
+    }
+  }
+
+  void solve(const Function & F){
+    Info.executableBlocks.insert(&F.getEntryBlock());
+    blockWorklist.push_back(&F.getEntryBlock());
+    while(!blockWorklist.empty() || !valueWorklist.empty()){
+      // Values first: a block is visited after the values it depends on settle
+      while(!valueWorklist.empty()){
+        visit(*valueWorklist.pop_back_val());
+      }
+      if(!blockWorklist.empty()){
+        for(const Instruction & I : *blockWorklist.pop_back_val()){
+          visit(I);
+        }
+      }
+    }
+  }
+};
+
+SparseConstantPropagationInfo computeSparseConstantPropagation(Function &F) {
+  SparseConstantPropagationInfo Info;
+  Info.function = &F;
+  if(F.isDeclaration()){
+    return Info;
+  }
+  SparseConstantPropagationSolver solver(F.getParent()->getDataLayout(), Info);
+  solver.solve(F);
+  return Info;
+}
+
+ConstantLatticeValue SparseConstantPropagationInfo::getLatticeValue(const Value * V) const {
+  if(ConstantInt * C = dyn_cast<ConstantInt>(const_cast<Value *>(V))){
+    return ConstantLatticeValue{ConstantLatticeValue::SingleConstant, C};
+  }
+  if(isa<UndefValue>(V)){
+    return ConstantLatticeValue();
+  }
+  const Instruction * I = dyn_cast<Instruction>(V);
+  if(I && I->getType()->isIntegerTy()){
+    return values.lookup(I);
+  }
+  // Arguments, globals and non-integer values are never constant
+  return ConstantLatticeValue{ConstantLatticeValue::Overdefined, nullptr};
+}
+
+ConstantInt * SparseConstantPropagationInfo::getConstantInt(const Value * V) const {
+  ConstantLatticeValue value = getLatticeValue(V);
+  return value.state == ConstantLatticeValue::SingleConstant ? cast<ConstantInt>(value.value) : nullptr;
+}
+
+bool SparseConstantPropagationInfo::isExecutable(const BasicBlock * BB) const {
+  return executableBlocks.count(BB);
+}
+
+bool SparseConstantPropagationInfo::isEdgeExecutable(const BasicBlock * From, const BasicBlock * To) const {
+  return executableEdges.count({From, To});
+}
+
+void SparseConstantPropagationInfo::forget(const Instruction * I) {
+  values.erase(I);
+}
+
+void SparseConstantPropagationInfo::print(raw_ostream &OS) const {
+  for(const BasicBlock & BB : *function){
+    OS << "  ";
+    printBlockName(OS, &BB);
+    if(!isExecutable(&BB)){
+      OS << ": non eseguibile\n";
+      continue;
+    }
+    OS << ":";
+    for(const Instruction & I : BB){
+      ConstantInt * C = isa<ConstantInt>(&I) ? nullptr : getConstantInt(&I);
+      if(C){
+        OS << " ";
+        I.printAsOperand(OS, false);
+        OS << " = ";
+        // Conditions are printed as 0/1 rather than 0/-1
+        C->getValue().print(OS, !C->getType()->isIntegerTy(1));
+      }
+    }
+    OS << "\n";
+  }
+}
+
+SparseConstantPropagationInfo SparseConstantPropagationAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  return computeSparseConstantPropagation(F);
+}
+
+PreservedAnalyses SparseConstantPropagationPrinterPass::run(Function &F, FunctionAnalysisManager &AM) {
+  SparseConstantPropagationInfo &Info = AM.getResult<SparseConstantPropagationAnalysis>(F);
+  OS << "Sparse Conditional Constant Propagation di '" << F.getName() << "' (" << Info.visits << " visite):\n";
+  if(!F.isDeclaration()){
+    Info.print(OS);
+  }
+  return PreservedAnalyses::all();
+}
+
+PreservedAnalyses SparseConstantFoldingPass::run(Function &F, FunctionAnalysisManager &AM) {
+  if(F.isDeclaration()){
+    return PreservedAnalyses::all();
+  }
+  SparseConstantPropagationInfo &Info = AM.getResult<SparseConstantPropagationAnalysis>(F);
+  bool modified = false;
+
+  // 1. Constant values: the uses are replaced, the instruction erased when it has no side effects
+  SmallVector<Instruction *, 16> toErase;
+  for(BasicBlock & BB : F){
+    if(!Info.isExecutable(&BB)){
+      continue;
+    }
+    for(Instruction & I : BB){
+      ConstantInt * C = Info.getConstantInt(&I);
+      if(!C){
+        continue;
+      }
+      LLVM_DEBUG({
+        dbgs() << I << " vale sempre ";
+        C->getValue().print(dbgs(), !C->getType()->isIntegerTy(1));
+        dbgs() << "\n";
+      });
+      I.replaceAllUsesWith(C);
+      modified = true;
+      if(wouldInstructionBeTriviallyDead(&I)){
+        toErase.push_back(&I);
+      }
+    }
+  }
+  for(Instruction * I : toErase){
+    I->eraseFromParent();
+  }
+
+  // 2. Branches on a constant condition keep only the executable successor
+  for(BasicBlock & BB : F){
+    if(Info.isExecutable(&BB) && ConstantFoldTerminator(&BB, true)){
+      modified = true;
+    }
+  }
+
+  // 3. Blocks never reached
+  if(removeUnreachableBlocks(F)){
+    LLVM_DEBUG(dbgs() << "Eliminati i blocchi irraggiungibili di '" << F.getName() << "'\n");
+    modified = true;
+  }
+
+  return modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,59 @@
+#ifndef LLVM_TRANSFORMS_SPARSECONSTANTPROPAGATION_H
+#define LLVM_TRANSFORMS_SPARSECONSTANTPROPAGATION_H
+#include "llvm/IR/PassManager.h"
+#include "llvm/Transforms/Utils/DataflowAnalyses.h"
+#include "llvm/ADT/DenseSet.h"
+
+namespace llvm {
+
+/*Sparse Conditional Constant Propagation (Wegman-Zadeck): un valore del
+lattice per ogni valore SSA intero, propagato lungo gli archi def-use, e
+l'insieme dei blocchi e degli archi del CFG eseguibili. Un ramo con
+condizione costante rende eseguibile solo il successore scelto, quindi le PHI
+ignorano i valori che arrivano da cammini morti*/
+struct SparseConstantPropagationInfo {
+  const Function * function = nullptr;
+  DenseMap<const Value *, ConstantLatticeValue> values;
+  DenseSet<const BasicBlock *> executableBlocks;
+  DenseSet<std::pair<const BasicBlock *, const BasicBlock *>> executableEdges;
+  unsigned visits = 0;
+
+  ConstantLatticeValue getLatticeValue(const Value * V) const;
+  // The value as an integer constant, directly or through the lattice; nullptr otherwise
+  ConstantInt * getConstantInt(const Value * V) const;
+  bool isExecutable(const BasicBlock * BB) const;
+  bool isEdgeExecutable(const BasicBlock * From, const BasicBlock * To) const;
+  // Drops an instruction about to be erased, so its address cannot alias a new one
+  void forget(const Instruction * I);
+  void print(raw_ostream &OS) const;
+};
+
+class SparseConstantPropagationAnalysis : public AnalysisInfoMixin<SparseConstantPropagationAnalysis> {
+  friend AnalysisInfoMixin<SparseConstantPropagationAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  using Result = SparseConstantPropagationInfo;
+  Result run(Function &F, FunctionAnalysisManager &AM);
+};
+
+class SparseConstantPropagationPrinterPass : public PassInfoMixin<SparseConstantPropagationPrinterPass> {
+  raw_ostream &OS;
+
+public:
+  explicit SparseConstantPropagationPrinterPass(raw_ostream &OS) : OS(OS) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+/*Sostituisce i valori costanti con le costanti, risolve i rami con
+condizione costante ed elimina i blocchi diventati irraggiungibili*/
+class SparseConstantFoldingPass : public PassInfoMixin<SparseConstantFoldingPass> {
+public:
+PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+} // namespace llvm
+
+llvm::SparseConstantPropagationInfo computeSparseConstantPropagation(llvm::Function &F);
+
+#endif // LLVM_TRANSFORMS_SPARSECONSTANTPROPAGATION_H
@@ -0,0 +1,107 @@
+; Esempi del Secondo Assignment, da eseguire con:
+; opt -passes='print<very-busy-expressions>,print<dataflow-dominators>,print<constant-propagation>' -disable-output DataflowTest.ll
+
+; Very Busy Expressions: b - a e a - b sono very busy in entry e in if.then,
+; a - b non lo è più dopo la ridefinizione di a in if.else
+define i32 @veryBusy(i32 %a, i32 %b) {
+entry:
+  %cmp = icmp ne i32 %a, %b
+  br i1 %cmp, label %if.then, label %if.else
+
+if.then:
+  %sub = sub nsw i32 %b, %a
+  %sub1 = sub nsw i32 %a, %b
+  br label %if.end
+
+if.else:
+  %sub2 = sub nsw i32 %b, %a
+  %a.new = add nsw i32 %a, 0
+  %sub3 = sub nsw i32 %a.new, %b
+  br label %if.end
+
+if.end:
+  %x = phi i32 [ %sub1, %if.then ], [ %sub3, %if.else ]
+  %y = phi i32 [ %sub, %if.then ], [ %sub2, %if.else ]
+  %r = add nsw i32 %x, %y
+  ret i32 %r
+}
+
+; Dominator Analysis sul CFG A -> (B, C), C -> (D, E), D -> F, E -> F, B -> G, F -> G
+define void @dominators(i1 %c0, i1 %c1) {
+A:
+  br i1 %c0, label %B, label %C
+
+B:
+  br label %G
+
+C:
+  br i1 %c1, label %D, label %E
+
+D:
+  br label %F
+
+E:
+  br label %F
+
+F:
+  br label %G
+
+G:
+  ret void
+}
+
+; Constant Propagation: k = 2; a = k + 2 oppure a = k * 2 (sempre 4);
+; x = 5 oppure 8; k = a; while(...) { b = 2; x = a + k; y = a * b; k++; }
+define i32 @constantPropagation(i1 %c0, i1 %c1) {
+entry:
+  %k = alloca i32
+  %a = alloca i32
+  %x = alloca i32
+  %b = alloca i32
+  %y = alloca i32
+  store i32 2, i32* %k
+  br i1 %c0, label %if.then, label %if.else
+
+if.then:
+  %k0 = load i32, i32* %k
+  %add = add nsw i32 %k0, 2
+  store i32 %add, i32* %a
+  store i32 5, i32* %x
+  br label %if.end
+
+if.else:
+  %k1 = load i32, i32* %k
+  %mul = mul nsw i32 %k1, 2
+  store i32 %mul, i32* %a
+  store i32 8, i32* %x
+  br label %if.end
+
+if.end:
+  %a0 = load i32, i32* %a
+  store i32 %a0, i32* %k
+  br label %while.cond
+
+while.cond:
+  br i1 %c1, label %while.body, label %while.end
+
+while.body:
+  store i32 2, i32* %b
+  %a1 = load i32, i32* %a
+  %k2 = load i32, i32* %k
+  %add1 = add nsw i32 %a1, %k2
+  store i32 %add1, i32* %x
+  %a2 = load i32, i32* %a
+  %b0 = load i32, i32* %b
+  %mul1 = mul nsw i32 %a2, %b0
+  store i32 %mul1, i32* %y
+  %k3 = load i32, i32* %k
+  %inc = add nsw i32 %k3, 1
+  store i32 %inc, i32* %k
+  br label %while.cond
+
+while.end:
+  %a3 = load i32, i32* %a
+  %x0 = load i32, i32* %x
+  %add2 = add nsw i32 %a3, %x0
+  ret i32 %add2
+}
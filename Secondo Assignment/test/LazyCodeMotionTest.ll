@@ -0,0 +1,48 @@
+; c + 3 è calcolata su un solo ramo e ricalcolata dopo la join: parzialmente
+; ridondante, la lazy code motion la valuta una volta per cammino
+define dso_local i32 @partiallyRedundant(i32 noundef %c, i32 noundef %z) {
+entry:
+  %cmp = icmp slt i32 %z, 5
+  br i1 %cmp, label %if.then, label %if.else
+
+if.then:
+  %add = add nsw i32 %c, 3
+  br label %if.end
+
+if.else:
+  %sub = sub nsw i32 %z, 1
+  br label %if.end
+
+if.end:
+  %h = phi i32 [ %add, %if.then ], [ %sub, %if.else ]
+  %y = add nsw i32 %c, 3
+  %r = add nsw i32 %h, %y
+  ret i32 %r
+}
+
+; c + 7 è invariante e il corpo del loop ruotato viene sempre eseguito:
+; la valutazione sale nel preheader
+define dso_local i32 @loopInvariant(i32 noundef %c, i32 noundef %n) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  br label %for.body
+
+for.body:
+  %i = phi i32 [ 0, %for.body.preheader ], [ %inc, %for.body ]
+  %sum = phi i32 [ 0, %for.body.preheader ], [ %acc, %for.body ]
+  %q = add nsw i32 %c, 7
+  %acc = add nsw i32 %sum, %q
+  %inc = add nsw i32 %i, 1
+  %cmp = icmp slt i32 %inc, %n
+  br i1 %cmp, label %for.body, label %for.end.loopexit
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  %res = phi i32 [ 0, %entry ], [ %acc, %for.end.loopexit ]
+  ret i32 %res
+}
@@ -0,0 +1,49 @@
+; Valori costanti solo attraverso PHI e rami: la Sparse Conditional Constant
+; Propagation li riconosce, e i passi di LocalOpts li trattano come immediati
+
+; %c è sempre vero: if.else non è eseguibile e %k vale 16
+define dso_local i32 @deadBranch(i32 noundef %x) {
+entry:
+  %t = add nsw i32 3, 4
+  %c = icmp eq i32 %t, 7
+  br i1 %c, label %if.then, label %if.else
+
+if.then:
+  br label %if.end
+
+if.else:
+  br label %if.end
+
+if.end:
+  %k = phi i32 [ 16, %if.then ], [ 8, %if.else ]
+  %mul = mul nsw i32 %x, %k
+  %div = sdiv i32 %mul, %k
+  ret i32 %div
+}
+
+; %a e %zero dipendono l'una dall'altra lungo il ciclo: partendo ottimisti
+; valgono sempre 9 (come a = 9 in LICM.c) e 0
+define dso_local i32 @loopConstant(i32 noundef %n) {
+entry:
+  br label %for.cond
+
+for.cond:
+  %i = phi i32 [ 0, %entry ], [ %inc, %for.body ]
+  %a = phi i32 [ 9, %entry ], [ %a.next, %for.body ]
+  %zero = phi i32 [ 0, %entry ], [ %zero.next, %for.body ]
+  %sum = phi i32 [ 0, %entry ], [ %add, %for.body ]
+  %cmp = icmp slt i32 %i, %n
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %mul = mul nsw i32 %i, %a
+  %add0 = add nsw i32 %sum, %zero
+  %add = add nsw i32 %add0, %mul
+  %a.next = add nsw i32 %a, %zero
+  %zero.next = sub nsw i32 %a, 9
+  %inc = add nsw i32 %i, 1
+  br label %for.cond
+
+for.end:
+  ret i32 %sum
+}
@@ -3,11 +3,18 @@ fileC="$1.c"
 intermediateRappresentation="$1.ll";
 optimizedIntermediateRappresentation="$1.optimized.ll";
 binaryCode="$1.optimized.bc";
+# PASS_PLUGIN=<build>/CompilatoriPasses.so uses the stock opt instead of ../../BUILD
+if [ -n "$PASS_PLUGIN" ]
+then
+    opt="opt -load-pass-plugin $PASS_PLUGIN";
+else
+    opt="../../BUILD/bin/opt";
+fi
 clang -O0 -S -emit-llvm -c $fileC -o $intermediateRappresentation;
 vim $intermediateRappresentation;
-../../BUILD/bin/opt -p "mem2reg" $intermediateRappresentation -o $binaryCode;
+$opt -p "mem2reg" $intermediateRappresentation -o $binaryCode;
 llvm-dis $binaryCode -o $optimizedIntermediateRappresentation;
-../../BUILD/bin/opt -p "loopwalk" $optimizedIntermediateRappresentation -o $binaryCode;
+$opt -p "loopwalk" $optimizedIntermediateRappresentation -o $binaryCode;
 if [ -e "$binaryCode" ]
 then
     echo "Optimized files created!";
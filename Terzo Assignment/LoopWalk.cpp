@@ -1,10 +1,22 @@
 #include "llvm/Transforms/Utils/LoopWalk.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Dominators.h"
-#include <vector>
+#include <optional>
 using namespace llvm;
 
-bool isLoopInvariant(Instruction &I, std::vector<Instruction*> const &LoopInvariantInstructions, Loop const &L) {
+#define DEBUG_TYPE "loopwalk"
+
+STATISTIC(NumLoopInvariants, "Number of loop-invariant instructions found");
+STATISTIC(NumDeadInvariants, "Number of loop-invariant instructions erased because unused");
+STATISTIC(NumCodeMotionCandidates, "Number of code motion candidates");
+STATISTIC(NumHoisted, "Number of instructions hoisted to the preheader");
+STATISTIC(NumLoopsTooLarge, "Number of loops skipped because over the instruction budget");
+
+// The invariant and code motion scans are quadratic in the size of the loop
+static cl::opt<unsigned> LoopWalkMaxLoopInstructions("loopwalk-max-loop-instructions", cl::init(2000), cl::Hidden,
+    cl::desc("Skip loops with more instructions than this (0 = no limit)"));
+
+bool isLoopInvariant(Instruction &I, SmallSetVector<Instruction*, 32> const &LoopInvariantInstructions, Loop const &L) {
   if (I.isTerminator()) {
     return false;
   }
@@ -13,6 +25,11 @@ bool isLoopInvariant(Instruction &I, std::vector<Instruction*> const &LoopInvari
     return false;
   }
 
+  // Stores and calls must still run at every iteration, loads may read a store of the loop
+  if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+    return false;
+  }
+
   for (auto Iter = I.op_begin(); Iter != I.op_end(); ++Iter) {
     Value *Operand = *Iter;
 
@@ -29,7 +46,7 @@ bool isLoopInvariant(Instruction &I, std::vector<Instruction*> const &LoopInvari
     }
 
     // Check if operand is loop invariant
-    if (std::find(LoopInvariantInstructions.begin(), LoopInvariantInstructions.end(), Def) != LoopInvariantInstructions.end()) {
+    if (LoopInvariantInstructions.count(Def)) {
       continue;
     }
 
@@ -39,12 +56,14 @@ bool isLoopInvariant(Instruction &I, std::vector<Instruction*> const &LoopInvari
   return true;
 }
 
-void findLoopInvariantInstructions(std::vector<Instruction*> &LoopInvariantInstructions, Loop const &L) {
+void findLoopInvariantInstructions(SmallSetVector<Instruction*, 32> &LoopInvariantInstructions, Loop const &L) {
+  TimeTraceScope TimeScope("LoopWalkInvariants");
   for (Loop::block_iterator BI = L.block_begin(); BI != L.block_end(); ++BI) {
     BasicBlock &BB = **BI;
     for (auto I = BB.begin(); I != BB.end(); ++I) {
       if (isLoopInvariant(*I, LoopInvariantInstructions, L)) {
-        LoopInvariantInstructions.push_back(&*I);
+        LoopInvariantInstructions.insert(&*I);
+        ++NumLoopInvariants;
       }
     }
   }
@@ -86,38 +105,46 @@ bool isDominatorOfAllExits(Instruction &I, SmallVector<BasicBlock*> const &Exiti
   return dominatesAllExits;
 }
 
-void findCodeMotionInstructions(std::vector<Instruction*> &CodeMotionInstructions, std::vector<Instruction*> const &LoopInvariantInstructions, Loop const &L, DominatorTree const &DT) {
+// Returns true if unused loop-invariant instructions have been erased
+bool findCodeMotionInstructions(SmallVectorImpl<Instruction*> &CodeMotionInstructions, SmallSetVector<Instruction*, 32> const &LoopInvariantInstructions, Loop const &L, DominatorTree const &DT) {
+  TimeTraceScope TimeScope("LoopWalkCandidates");
   SmallVector<BasicBlock*> ExitingBlocks;
   L.getExitingBlocks(ExitingBlocks);
 
+  bool Erased = false;
   for (auto &I : LoopInvariantInstructions) {
     // Check if instruction is dead code
     if (I->getNumUses() == 0) {
       I->eraseFromParent();
+      ++NumDeadInvariants;
+      Erased = true;
       continue;
     }
     
-    // Check if instruction is dead outside the loop
-    if (isDeadOutsideLoop(*I, L)) {
+    // Check if instruction is dead outside the loop, it may not run in the loop: only if it cannot trap
+    if (isDeadOutsideLoop(*I, L) && isSafeToSpeculativelyExecute(I)) {
       CodeMotionInstructions.push_back(I);
+      ++NumCodeMotionCandidates;
       continue;
     }
 
     // If instruction is not dead, check if instruction dominates all exits
     if (isDominatorOfAllExits(*I, ExitingBlocks, DT)) {
       CodeMotionInstructions.push_back(I);
+      ++NumCodeMotionCandidates;
     }
   }
+  return Erased;
 }
 
-bool isMovable(Instruction &I, std::vector<Instruction*> const &LoopInvariantInstructions, BasicBlock *Preheader) {
+bool isMovable(Instruction &I, SmallSetVector<Instruction*, 32> const &LoopInvariantInstructions, BasicBlock *Preheader) {
   bool isMovable = true;
   for (auto Iter = I.op_begin(); Iter != I.op_end(); ++Iter) {
     Value *Operand = *Iter;
     Instruction *Def = dyn_cast<Instruction>(Operand);
 
     // Check if operand reaching definition is not a loop-invariant instruction of the loop
-    if (!Def || std::find(LoopInvariantInstructions.begin(), LoopInvariantInstructions.end(), Def) == LoopInvariantInstructions.end()) {
+    if (!Def || !LoopInvariantInstructions.count(Def)) {
       continue;
     }
 
@@ -134,50 +161,92 @@ bool isMovable(Instruction &I, std::vector<Instruction*> const &LoopInvariantIns
 }
 
 PreservedAnalyses LoopWalk::run(Loop &L, LoopAnalysisManager &AM, LoopStandardAnalysisResults &AR, LPMUpdater &U) {
-  outs() << "\n---------- PROGRAM CFG ----------\n";
   BasicBlock *Head = L.getHeader();
   Function *F = Head->getParent();
-  for (auto &BB : *F) {
-    outs() << BB;
+
+  unsigned Size = 0;
+  for (BasicBlock *BB : L.blocks()) {
+    Size += BB->size();
   }
-  
-  outs() << "\n---------- LOOP CFG ----------\n";
-  for (Loop::block_iterator BI = L.block_begin(); BI != L.block_end(); ++BI) {
-    outs() << **BI;
+  if (LoopWalkMaxLoopInstructions && Size > LoopWalkMaxLoopInstructions) {
+    LLVM_DEBUG(dbgs() << "\n---------- LOOP TOO LARGE: " << Size << " INSTRUCTIONS ----------\n");
+    ++NumLoopsTooLarge;
+    // A loop pass cannot compute function analyses: the emitter of the FunctionAnalysisManager if cached.
+    // With hotness it holds the BlockFrequencyInfo, which loop passes do not preserve
+    OptimizationRemarkEmitter *ORE = nullptr;
+    if (!F->getContext().getDiagnosticsHotnessRequested()) {
+      ORE = AM.getResult<FunctionAnalysisManagerLoopProxy>(L, AR).getCachedResult<OptimizationRemarkEmitterAnalysis>(*F);
+    }
+    std::optional<OptimizationRemarkEmitter> LocalORE;
+    if (!ORE) {
+      ORE = &LocalORE.emplace(F);
+    }
+    ORE->emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "LoopTooLarge", L.getStartLoc(), Head)
+             << "loop not optimized: " << ore::NV("Instructions", Size)
+             << " instructions, budget " << ore::NV("Budget", unsigned(LoopWalkMaxLoopInstructions));
+    });
+    return PreservedAnalyses::all();
   }
 
-  outs() << "\n---------- LOOP-INVARIANT INSTRUCTIONS ----------\n\n";
-  std::vector<Instruction*> LoopInvariantInstructions;
-  findLoopInvariantInstructions(LoopInvariantInstructions, L);
-  for (auto &I : LoopInvariantInstructions) {
-    outs() << *I << "\n";
+  // Instructions are hoisted to the preheader
+  BasicBlock *Preheader = L.getLoopPreheader();
+  if (!Preheader) {
+    return PreservedAnalyses::all();
   }
 
-  outs() << "\n---------- CODE MOTION CANDIDATE INSTRUCTIONS ----------\n\n";
-  std::vector<Instruction*> CodeMotionInstructions;
-  DominatorTree &DT = AR.DT;
-  findCodeMotionInstructions(CodeMotionInstructions, LoopInvariantInstructions, L, DT);
-  for (auto &I : CodeMotionInstructions) {
-    outs() << *I << "\n";
-  }
+  LLVM_DEBUG({
+    dbgs() << "\n---------- PROGRAM CFG ----------\n";
+    for (auto &BB : *F) {
+      dbgs() << BB;
+    }
 
-  outs() << "\n---------- LOOP CFG AFTER LICM ----------\n";
-  BasicBlock *Preheader = L.getLoopPreheader();
-  Instruction &PreheaderLastI = *(Preheader->rbegin());
-  bool Transformed = false;
-  for (auto &I : CodeMotionInstructions) {
-    if (!isMovable(*I, LoopInvariantInstructions, Preheader)) {
-      continue;
+    dbgs() << "\n---------- LOOP CFG ----------\n";
+    for (Loop::block_iterator BI = L.block_begin(); BI != L.block_end(); ++BI) {
+      dbgs() << **BI;
     }
+  });
 
-    Transformed = true;
-    I->moveBefore(&PreheaderLastI);
-  }
+  LoopInvariantInstructions.clear();
+  findLoopInvariantInstructions(LoopInvariantInstructions, L);
+  LLVM_DEBUG({
+    dbgs() << "\n---------- LOOP-INVARIANT INSTRUCTIONS ----------\n\n";
+    for (auto &I : LoopInvariantInstructions) {
+      dbgs() << *I << "\n";
+    }
+  });
 
-  for (auto &BB : *F) {
-    outs() << BB;
+  CodeMotionInstructions.clear();
+  DominatorTree &DT = AR.DT;
+  bool Transformed = findCodeMotionInstructions(CodeMotionInstructions, LoopInvariantInstructions, L, DT);
+  LLVM_DEBUG({
+    dbgs() << "\n---------- CODE MOTION CANDIDATE INSTRUCTIONS ----------\n\n";
+    for (auto &I : CodeMotionInstructions) {
+      dbgs() << *I << "\n";
+    }
+  });
+
+  Instruction *PreheaderLastI = Preheader->getTerminator();
+  {
+    TimeTraceScope TimeScope("LoopWalkCodeMotion");
+    for (auto &I : CodeMotionInstructions) {
+      if (!isMovable(*I, LoopInvariantInstructions, Preheader)) {
+        continue;
+      }
+
+      Transformed = true;
+      I->moveBefore(PreheaderLastI);
+      ++NumHoisted;
+    }
   }
 
+  LLVM_DEBUG({
+    dbgs() << "\n---------- LOOP CFG AFTER LICM ----------\n";
+    for (auto &BB : *F) {
+      dbgs() << BB;
+    }
+  });
+
   if (Transformed) {
     return PreservedAnalyses::none();
   }
@@ -2,8 +2,20 @@
 #define LLVM_TRANSFORMS_LOOPWALK_H
 #include "llvm/IR/PassManager.h"
 #include "llvm/Transforms/Scalar/LoopPassManager.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
 namespace llvm {
 class LoopWalk : public PassInfoMixin<LoopWalk> {
+  // Scratch of run, cleared and reused by every loop
+  SmallSetVector<Instruction *, 32> LoopInvariantInstructions;
+  SmallVector<Instruction *, 32> CodeMotionInstructions;
+
 public:
 PreservedAnalyses run(Loop &L, LoopAnalysisManager &AM, LoopStandardAnalysisResults &AR, LPMUpdater &U);
 };